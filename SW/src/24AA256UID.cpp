@@ -7,8 +7,17 @@
 // Content address range is 0x0000 to 0x7FFF
 // Page start addresses are: 0x00, 0x40, 0x80, 0xC0, ...
 #define PAGE_SIZE 64
+// Largest transfers in one I2C transaction: the Wire buffer also holds the 2 address bytes of a write
+#ifdef BUFFER_LENGTH
+#define WIRE_BUFFER_SIZE BUFFER_LENGTH
+#else
+#define WIRE_BUFFER_SIZE 32
+#endif
+#define READ_CHUNK WIRE_BUFFER_SIZE
+#define WRITE_CHUNK (WIRE_BUFFER_SIZE - 2)
+// A write cycle takes at most 5 ms
+#define WRITE_TIMEOUT 10
 // This code makes no effort to do wear levelling, as writing is supposed to be extremely rare.
-// It also doesn't take the busy flag into account, which one should do if you write a lot.
 //
 //
 // Content organisation:
@@ -25,6 +34,8 @@
 // Default instrument: 0x7F04 (1 byte)
 #define DEFAULT_INSTRUMENT_START 0x7F04
 
+// Macros of the Prologix server: from MACRO_EEPROM_START (0x0000), 10 x MACRO_SLOT_SIZE bytes, see config.h
+
 
 
 _24AA256UID::_24AA256UID(uint8_t address, bool pinswap, bool debug) : deviceAddress(address), pinswap(pinswap), debugEnabled(debug) {}
@@ -74,53 +85,64 @@ void _24AA256UID::setDefaultInstrument(uint8_t instrument){
     writeByte(DEFAULT_INSTRUMENT_START, instrument);
 }
 
+// Read any number of bytes
+void _24AA256UID::readBlock(uint16_t address, uint8_t* buffer, size_t length) {
+    readBytes(address, buffer, length);
+}
+
+// Write any number of bytes
+void _24AA256UID::writeBlock(uint16_t address, const uint8_t* buffer, size_t length) {
+    writeBytes(address, buffer, length);
+}
+
 uint8_t _24AA256UID::readByte(uint16_t address) {
-    Wire.beginTransmission(deviceAddress);
-    Wire.write((address >> 8) & 0xFF);
-    Wire.write(address & 0xFF);
-    Wire.endTransmission();
-    Wire.requestFrom(deviceAddress, (size_t)1);
-    printDebug("Byte read.");
-    return Wire.available() ? Wire.read() : 0xFF; // Return 0xFF if no data is available
+    uint8_t data = 0xFF; // 0xFF if no data is available
+    readBytes(address, &data, 1);
+    return data;
 }
 
 void _24AA256UID::writeByte(uint16_t address, uint8_t data) {
-    Wire.beginTransmission(deviceAddress);
-    Wire.write((address >> 8) & 0xFF);
-    Wire.write(address & 0xFF);
-    Wire.write(data & 0xFF);
-    Wire.endTransmission();
-    delay(10);
-    printDebug("Byte written.");
+    writePage(address, &data, 1);
 }
 
+// Reads in transfers of at most READ_CHUNK. The address counter of the device goes on over the page boundaries.
 void _24AA256UID::readBytes(uint16_t address, uint8_t* buffer, size_t length) {
-    Wire.beginTransmission(deviceAddress);
-    Wire.write((address >> 8) & 0xFF);
-    Wire.write(address & 0xFF);
-    Wire.endTransmission();
-    Wire.requestFrom(deviceAddress, (size_t)length);
-    for (int i = 0; i < length && Wire.available(); i++) {
-        buffer[i] = Wire.read();
+    while (length > 0) {
+        size_t n = length < READ_CHUNK ? length : READ_CHUNK;
+        Wire.beginTransmission(deviceAddress);
+        Wire.write((address >> 8) & 0xFF);
+        Wire.write(address & 0xFF);
+        Wire.endTransmission();
+        Wire.requestFrom(deviceAddress, n);
+        for (size_t i = 0; i < n && Wire.available(); i++) {
+            buffer[i] = Wire.read();
+        }
+        address += n;
+        buffer += n;
+        length -= n;
     }
     printDebug("Bytes read.");
 }
 
+// Writes in transfers of at most WRITE_CHUNK that do not cross a page boundary:
+// the address counter of the device wraps around within the page.
 void _24AA256UID::writeBytes(uint16_t address, const uint8_t* buffer, size_t length) {
-    Wire.beginTransmission(deviceAddress);
-    Wire.write((address >> 8) & 0xFF);
-    Wire.write(address & 0xFF);
-    for (int i = 0; i < length; i++) {
-        Wire.write(buffer[i] & 0xFF);
+    while (length > 0) {
+        size_t n = PAGE_SIZE - (address % PAGE_SIZE);
+        if (n > WRITE_CHUNK) n = WRITE_CHUNK;
+        if (n > length) n = length;
+        writePage(address, buffer, n);
+        address += n;
+        buffer += n;
+        length -= n;
     }
-    Wire.endTransmission();
-    delay(10);
     printDebug("Bytes written.");
 }
 
+// One write transaction, followed by the write cycle of the device
 void _24AA256UID::writePage(uint16_t address, const uint8_t* data, size_t length) {
-    if (length > PAGE_SIZE) {
-        printDebug("Error: Length exceeds page size!");
+    if (length > WRITE_CHUNK) {
+        printDebug("Error: Length exceeds the Wire buffer!");
         return;
     }
 
@@ -137,8 +159,7 @@ void _24AA256UID::writePage(uint16_t address, const uint8_t* data, size_t length
         Wire.write(data[i]);
     }
     Wire.endTransmission();
-    delay(10);
-    printDebug("Page written within boundary.");
+    waitReady();
 }
 
 void _24AA256UID::readPage(uint16_t address, uint8_t* data) {
@@ -146,16 +167,21 @@ void _24AA256UID::readPage(uint16_t address, uint8_t* data) {
         printDebug("Error: Address is not page aligned!");
         return;
     }
+    readBytes(address, data, PAGE_SIZE);
+}
 
-    Wire.beginTransmission(deviceAddress);
-    Wire.write((address >> 8) & 0xFF);
-    Wire.write(address & 0xFF);
-    Wire.endTransmission();
-    Wire.requestFrom(deviceAddress, (size_t)PAGE_SIZE);
-    for (uint8_t i = 0; i < PAGE_SIZE && Wire.available(); i++) {
-        data[i] = Wire.read();
-    }
-    printDebug("Page read.");
+// ACK polling: the device does not acknowledge its address until the write cycle is done.
+// That takes at most 5 ms, usually less, which is faster than a fixed delay.
+bool _24AA256UID::waitReady() {
+    unsigned long start = millis();
+    do {
+        Wire.beginTransmission(deviceAddress);
+        if (Wire.endTransmission() == 0) {
+            return true;
+        }
+    } while (millis() - start < WRITE_TIMEOUT);
+    printDebug("Error: Write cycle timeout!");
+    return false;
 }
 
 void _24AA256UID::printDebug(const String& message) {
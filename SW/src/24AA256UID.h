@@ -16,6 +16,8 @@ public:
     void setIPAddress(uint8_t* ip);
     uint8_t getDefaultInstrument(void);
     void setDefaultInstrument(uint8_t instrument);
+    void readBlock(uint16_t address, uint8_t* buffer, size_t length);
+    void writeBlock(uint16_t address, const uint8_t* buffer, size_t length);
 
 private:
     uint8_t readByte(uint16_t address);
@@ -25,6 +27,7 @@ private:
 
     void writePage(uint16_t address, const uint8_t* data, size_t length);
     void readPage(uint16_t address, uint8_t* data);
+    bool waitReady();
 
     uint8_t deviceAddress;
     bool debugEnabled;
@@ -38,7 +38,7 @@
   #endif
 
 // >>> CHANGED FROM AR488 UPSTREAM >>> added maintainDataPort(), ethernetPort and startDataPort
-  int maintainDataPort() { return 0; }
+  int maintainDataPort(int8_t busy) { return 0; }
 #else
   EthernetStream ethernetPort;
   EthernetStream& dataPort = ethernetPort;
@@ -66,8 +66,8 @@ void startDataPort(unsigned long baud) {
  * 
  * @return int return the active number of clients
  */
-int maintainDataPort() {
-  return ethernetPort.maintain();
+int maintainDataPort(int8_t busy) {
+  return ethernetPort.maintain(busy);
 }
 #endif  // >>> CHANGED FROM AR488 UPSTREAM >>> endif AR_ETHERNET_PORT
 #else
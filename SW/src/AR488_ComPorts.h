@@ -31,7 +31,7 @@
   extern Stream& dataPort;
 #endif
 // >>> CHANGED FROM AR488 UPSTREAM >>> added maintainDataPort()
-  int maintainDataPort(); 
+  int maintainDataPort(int8_t busy = -1); 
   void startDataPort(unsigned long baud);
 
   #define DATAPORT_START() startDataPort()
@@ -13,6 +13,8 @@
 /***** Forward declarations of internal functions *****/
 uint16_t getCRC16(uint8_t bytes[], size_t bsize);
 unsigned long int getCRC32(uint8_t bytes[], size_t bsize);
+// >>> CHANGED FROM AR488 UPSTREAM >>> CRC16 of data that is not in one array
+uint16_t addCRC16(uint16_t crc, uint8_t byte);
 
 
 /********************************/
@@ -55,37 +57,209 @@ void epErase() {
 }
 
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> journaled configuration store
+/*
+ * The configuration is not written at a fixed place, but appended to a
+ * journal that goes around the EEPROM. A record starts at a slot of
+ * EP_SLOT bytes:
+ *   sequence number (2 bytes, EP_BLANK is never used), offset (1 byte),
+ *   length (1 byte), CRC16 of these 4 bytes and the data (2 bytes), data.
+ * A snapshot holds the whole configuration (offset 0). The records after
+ * it, with the next sequence numbers, only hold the bytes that changed.
+ * A record with a wrong CRC, e.g. after a power loss while writing it,
+ * ends the journal.
+ *
+ * A new record is a snapshot when the records after it would not leave
+ * room for the next snapshot, so the current snapshot is only overwritten
+ * after a newer one is complete.
+ *
+ * Without a journal (firmware update), the configuration is read from the
+ * fixed block of the upstream code (CRC at 0, data from EESTART), and the
+ * first snapshot is written after that block.
+ */
+
+#define EP_SLOT 8                    // Records start at a multiple of EP_SLOT
+#define EP_SLOTS (EESIZE / EP_SLOT)  // Slots of the journal, at most 32 (see epScan())
+#define EP_HEAD 6                    // Size of the header of a record
+#define EP_BLANK 0xFFFF              // Sequence number of erased EEPROM
+
+/***** The records of the configuration, found by epScan() *****/
+struct epJournal {
+  uint8_t nr;               // Number of records: the snapshot and the changes after it
+  uint8_t slots[EP_SLOTS];  // Their slots, oldest first
+  uint8_t used;             // Slots taken by them
+  uint8_t head;             // Slot of the next record
+  uint16_t maxSeq;          // Highest sequence number of all valid records
+  bool broken;              // There are newer records than the last one of the journal
+};
+
+static uint8_t epRead(uint16_t addr) {
+  return EEPROM.read(addr % EESIZE);
+}
+
+static uint16_t epSeq(uint8_t slot) {
+  return epRead(slot * EP_SLOT) | (epRead(slot * EP_SLOT + 1) << 8);
+}
+
+static uint8_t epSlotsOf(size_t length) {
+  return (EP_HEAD + length + EP_SLOT - 1) / EP_SLOT;
+}
+
+/***** Check the header and the CRC of the record at a slot *****/
+static bool epIsValid(uint8_t slot, size_t cfgsize) {
+  uint16_t addr = slot * EP_SLOT;
+  uint8_t offset = epRead(addr + 2);
+  uint8_t length = epRead(addr + 3);
+  uint16_t crc = 0xFFFF;
+
+  if (epSeq(slot) == EP_BLANK || length == 0 || offset + length > cfgsize) return false;
+  for (uint8_t i = 0; i < 4; i++) {
+    crc = addCRC16(crc, epRead(addr + i));
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    crc = addCRC16(crc, epRead(addr + EP_HEAD + i));
+  }
+  return crc == (epRead(addr + 4) | (epRead(addr + 5) << 8));
+}
+
+/***** Find the newest snapshot and the records after it *****/
+/*
+ * Only the headers of the slots are read, and the CRC of the ones that
+ * look like a record. Returns false if there is no snapshot.
+ */
+static bool epScan(epJournal &j, size_t cfgsize) {
+  uint32_t valid = 0;
+  bool found = false;
+  uint8_t base = 0;
+  uint16_t seq;
+
+  j.nr = 0;
+  j.used = 0;
+  j.maxSeq = EP_BLANK;
+  for (uint8_t slot = 0; slot < EP_SLOTS; slot++) {
+    if (!epIsValid(slot, cfgsize)) continue;
+    valid |= (1UL << slot);
+    seq = epSeq(slot);
+    if (j.maxSeq == EP_BLANK || (int16_t)(seq - j.maxSeq) > 0) j.maxSeq = seq;
+    // A snapshot, newer than the one found so far?
+    if (epRead(slot * EP_SLOT + 3) == cfgsize && (!found || (int16_t)(seq - epSeq(base)) > 0)) {
+      base = slot;
+      found = true;
+    }
+  }
+  if (!found) {
+    // The first snapshot goes after the block of the upstream code
+    j.head = ((EESTART + cfgsize + EP_SLOT - 1) / EP_SLOT) % EP_SLOTS;
+    j.broken = true;
+    return false;
+  }
+  // The records are written one after the other
+  uint8_t slot = base;
+  seq = epSeq(base);
+  do {
+    j.slots[j.nr++] = slot;
+    j.used += epSlotsOf(epRead(slot * EP_SLOT + 3));
+    slot = (base + j.used) % EP_SLOTS;
+    seq++;
+  } while (j.used < EP_SLOTS && (valid & (1UL << slot)) && epSeq(slot) == seq
+           && j.used + epSlotsOf(epRead(slot * EP_SLOT + 3)) <= EP_SLOTS);
+  j.head = slot;
+  j.broken = (uint16_t)(seq - 1) != j.maxSeq;
+  return true;
+}
+
+/***** Stored value of a byte of the configuration: the newest record that has it *****/
+static uint8_t epStoredByte(const epJournal &j, uint8_t i) {
+  for (int8_t k = j.nr - 1; k >= 0; k--) {
+    uint16_t addr = j.slots[k] * EP_SLOT;
+    uint8_t offset = epRead(addr + 2);
+    if (i >= offset && i < offset + epRead(addr + 3)) {
+      return epRead(addr + EP_HEAD + i - offset);
+    }
+  }
+  return 0xFF;
+}
+
+/***** Write a record: data first, then the header with the CRC *****/
+static void epWriteRecord(uint8_t slot, uint16_t seq, uint8_t offset, const uint8_t data[], uint8_t length) {
+  uint16_t addr = slot * EP_SLOT;
+  uint8_t head[4] = { (uint8_t)(seq & 0xFF), (uint8_t)(seq >> 8), offset, length };
+  uint16_t crc = 0xFFFF;
+
+  for (uint8_t i = 0; i < 4; i++) {
+    crc = addCRC16(crc, head[i]);
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    crc = addCRC16(crc, data[i]);
+    EEPROM.update((addr + EP_HEAD + i) % EESIZE, data[i]);
+  }
+  for (uint8_t i = 0; i < 4; i++) {
+    EEPROM.update((addr + i) % EESIZE, head[i]);
+  }
+  EEPROM.update((addr + 4) % EESIZE, crc & 0xFF);
+  EEPROM.update((addr + 5) % EESIZE, crc >> 8);
+}
+
+
 /***** Write data to EEPROM (with CRC) *****/
 /*
- * EESTART = starting EEPROM address for configuration data
+ * Appends the bytes that differ from the stored configuration to the
+ * journal, or a snapshot. Nothing is written when nothing changed.
  * cfg = config data union object
  * csize = size of config data object
  */
 void epWriteData(uint8_t cfgdata[], size_t cfgsize) {
-  uint16_t crc;
-  uint16_t i = 0;
- 
-  // Write data
-  for (i=0; i<cfgsize; i++){
-    EEPROM.update(i+EESTART,cfgdata[i]);
+  epJournal j;
+  uint8_t first = 0;
+  uint8_t last = cfgsize - 1;
+  uint16_t seq;
+
+  if (epScan(j, cfgsize)) {
+    // Range of the bytes that changed
+    bool changed = false;
+    for (uint8_t i = 0; i < cfgsize; i++) {
+      if (epStoredByte(j, i) != cfgdata[i]) {
+        if (!changed) first = i;
+        last = i;
+        changed = true;
+      }
+    }
+    if (!changed) return;
   }
-  // Write CRC
-  crc = getCRC16(cfgdata, cfgsize);
-  EEPROM.put(0, crc);
-  // Commit write to Flash
+  seq = j.maxSeq + 1;
+  // Keep room for the next snapshot
+  if (j.broken || seq == EP_BLANK || EP_SLOTS - j.used - epSlotsOf(last - first + 1) < epSlotsOf(cfgsize)) {
+    first = 0;
+    last = cfgsize - 1;
+    if (seq == EP_BLANK) seq = 0;
+  }
+  epWriteRecord(j.head, seq, first, cfgdata + first, last - first + 1);
 }
 
 
 /***** Read data from EEPROM (with CRC check) *****/
 /*
- * EESTART = starting EEPROM address for configuration data
+ * The snapshot and the changes after it, or the block of the upstream code.
  * cfg = config data union object
  * csize = size of config data object
  */
 bool epReadData(uint8_t cfgdata[], size_t cfgsize) {
+  epJournal j;
   uint16_t crc1;
   uint16_t crc2;
 
+  if (epScan(j, cfgsize)) {
+    for (uint8_t k = 0; k < j.nr; k++) {
+      uint16_t addr = j.slots[k] * EP_SLOT;
+      uint8_t offset = epRead(addr + 2);
+      uint8_t length = epRead(addr + 3);
+      for (uint8_t i = 0; i < length; i++) {
+        cfgdata[offset + i] = epRead(addr + EP_HEAD + i);
+      }
+    }
+    return true;
+  }
+
   // Read CRC
   EEPROM.get(0,crc1);
   // Read data
@@ -102,18 +276,17 @@ bool epReadData(uint8_t cfgdata[], size_t cfgsize) {
 }
 
 
+/***** Check if the EEPROM is erased: the headers of the slots only *****/
+/*
+ * Slot 0 also holds the CRC of the block of the upstream code.
+ */
 bool isEepromClear(){
-  int16_t crc = 0;
-
-  // Load (first 16 bits) data from EEPROM
-  EEPROM.get(0, crc);
-  // Return result
-  if (crc==-1) {
-    return true;
-  }else{
-    return false;
+  for (uint8_t slot = 0; slot < EP_SLOTS; slot++) {
+    if (epSeq(slot) != EP_BLANK) return false;
   }
+  return true;
 }
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
 #endif
 
@@ -262,13 +435,20 @@ unsigned long int getCRC32(uint8_t bytes[], size_t bsize) {
 }
 
 uint16_t getCRC16(uint8_t bytes[], size_t bsize){
-  uint8_t x;
   uint16_t crc = 0xFFFF;
 
   for (size_t idx=0; idx<bsize; ++idx) {
-    x = crc >> 8 ^ bytes[idx];
-    x ^= x>>4;
-    crc = (crc << 8) ^ ((uint16_t)(x << 12)) ^ ((uint16_t)(x <<5)) ^ ((uint16_t)x);
+    crc = addCRC16(crc, bytes[idx]);
   }
   return crc;
 }
+
+// >>> CHANGED FROM AR488 UPSTREAM >>> one step of getCRC16(), for the journal
+uint16_t addCRC16(uint16_t crc, uint8_t byte){
+  uint8_t x;
+
+  x = crc >> 8 ^ byte;
+  x ^= x>>4;
+  return (crc << 8) ^ ((uint16_t)(x << 12)) ^ ((uint16_t)(x <<5)) ^ ((uint16_t)x);
+}
+// <<< CHANGED FROM AR488 UPSTREAM <<<
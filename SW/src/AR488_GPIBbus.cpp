@@ -2,6 +2,11 @@
 //#include <SD.h>
 #include "AR488_Config.h"
 #include "AR488_GPIBbus.h"
+// >>> CHANGED FROM AR488 UPSTREAM >>> counters for /metrics
+#ifdef USE_METRICS
+#include "metrics.h"
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
 /***** AR488_GPIB.cpp, ver. 0.53.39, 29/01/2026 *****/
 
@@ -31,6 +36,9 @@ GPIBbus::GPIBbus() {
   setDefaultCfg();
   cstate = 0;
   deviceAddressed = TONONE;
+// >>> CHANGED FROM AR488 UPSTREAM >>> see serialPoll()
+  pollTalker = false;
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 }
 
 
@@ -89,6 +97,11 @@ void GPIBbus::startDeviceMode() {
   cfg.cmode = 1;
   // Set GPIB control bus to device idle mode
   setControls(DINI);
+// >>> CHANGED FROM AR488 UPSTREAM >>> the bus map is only known by a controller
+#ifdef USE_BUS_MAP
+  invalidateBusMap();
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
   // Initialise GPIB data lines (sets to INPUT_PULLUP)
 //  readyGpibDbus();
 #ifdef LEVEL_SHIFTER
@@ -277,6 +290,11 @@ void GPIBbus::sendIFC() {
   delayMicroseconds(150);
   // De-assert IFC
   clearSignal(IFC_BIT);
+// >>> CHANGED FROM AR488 UPSTREAM >>> the instruments may have changed
+#ifdef USE_BUS_MAP
+  invalidateBusMap();
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 }
 
 
@@ -440,6 +458,145 @@ bool GPIBbus::sendTCT(uint8_t addr){
 }
 
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> added serialPoll for a single device
+/***** Serial poll a single device *****/
+/*
+ * Only sends the command bytes that are needed: a device that is already
+ * addressed to talk (cfg.paddr) is just enabled with SPE, otherwise the
+ * listeners are removed and the device is addressed with TAD.
+ * The device is left addressed to talk with ATN asserted, so it can not send
+ * anything, and a next poll of the same device only costs SPE and SPD.
+ * addressDevice() starts with UNL and UNT, so any other transfer untalks it
+ * first; idleTalker() tells the users that only look at cfg.paddr.
+ */
+bool GPIBbus::serialPoll(uint8_t addr, uint8_t *sb) {
+  enum gpibHandshakeState state;
+  bool eoiDetected = false;
+  bool isTalker = (deviceAddressed == TOTALK) && (cfg.paddr == addr);
+
+  if (addr > 30) return ERR;
+
+  // Listeners would take part in the handshake of the status byte
+  if (!isTalker && deviceAddressed != TONONE) {
+    if (sendCmd(GC_UNL)) return ERR;
+    deviceAddressed = TONONE;
+  }
+  // Send Serial Poll Enable [SPE] to all devices
+  if (sendCmd(GC_SPE)) return ERR;
+  // Address the device to talk, this untalks any other talker
+  if (!isTalker) {
+    if (sendCmd(GC_TAD + addr)) return ERR;
+    deviceAddressed = TOTALK;
+  }
+  // Set GPIB control to controller active listner state (ATN unasserted), clear databus and set to input
+  setControls(CLAS);
+  // Read the response byte (usually device status) using handshake - suppress EOI detection
+  state = readByte(sb, false, &eoiDetected);
+  // Set GPIB control back to controller active talk state (ATN asserted)
+  setControls(CTAS);
+  // Send Serial Poll Disable [SPD] to all devices, also when the read failed
+  if (sendCmd(GC_SPD)) return ERR;
+  if (state != HANDSHAKE_COMPLETE) {
+#ifdef DEBUG_GPIB_COMMANDS
+    DB_PRINT(F("failed to read the status byte from "), addr);
+#endif
+    unAddressDevice();
+    return ERR;
+  }
+  pollTalker = true;
+  return OK;
+}
+
+
+/***** The only addressed device is the talker left by serialPoll() *****/
+/*
+ * Nothing is being read from it, so it can be untalked at any time.
+ */
+bool GPIBbus::idleTalker() {
+  return pollTalker && deviceAddressed == TOTALK;
+}
+
+
+// >>> CHANGED FROM AR488 UPSTREAM >>> added the cached bus map
+#ifdef USE_BUS_MAP
+/***** Check if a device listens at a primary address *****/
+/*
+ * The probe of fndl_h(): address the device to listen, and a device that
+ * is there asserts NDAC when ATN is released. Secondary addresses are not
+ * probed. The bus is left unaddressed.
+ */
+bool GPIBbus::probeDevice(uint8_t pri) {
+  uint16_t tmo = cfg.rtmo;
+  bool found = false;
+
+  // Set minimal timeout
+  cfg.rtmo = 35;
+  // Send UNL + UNT + LAD (addressDevice function adds 0x20 to pri)
+  if (addressDevice(pri, 0xFF, TOLISTEN) == OK) {
+    clearSignal(ATN_BIT);
+    delayMicroseconds(1600);
+    found = isAsserted(NDAC_PIN);
+  }
+  unAddressDevice();
+  setControls(CIDS);
+  cfg.rtmo = tmo;
+  return found;
+}
+
+
+/***** Probe all addresses at once *****/
+uint32_t GPIBbus::scanBusMap() {
+  busMap = 0;
+  for (uint8_t pri = 0; pri < 31; pri++) {
+    // Ignore the controller address
+    if (pri != cfg.caddr && probeDevice(pri)) {
+      busMap |= (1UL << pri);
+    }
+  }
+  busMapNext = 0;
+  busMapComplete = true;
+  busMapTime = millis();
+  return busMap;
+}
+
+
+/***** Probe the next address of the background scan *****/
+/*
+ * To be called when nobody uses the bus. After an IFC, the addresses are
+ * probed one per call until the map is complete. Then every address is
+ * probed again, one per call, BUS_MAP_REFRESH ms after the previous scan.
+ * A probe addresses the device to listen, which puts it in remote while REN
+ * is asserted: the caller should not run the background scan then.
+ */
+bool GPIBbus::busMapDue() {
+  return !busMapComplete || millis() - busMapTime >= BUS_MAP_REFRESH;
+}
+
+void GPIBbus::busMapStep() {
+  if (!busMapDue()) return;
+  if (busMapNext != cfg.caddr && probeDevice(busMapNext)) {
+    busMap |= (1UL << busMapNext);
+  } else {
+    busMap &= ~(1UL << busMapNext);
+  }
+  if (++busMapNext > 30) {
+    busMapNext = 0;
+    busMapComplete = true;
+    busMapTime = millis();
+  }
+}
+
+
+/***** Forget the bus map, the background scan starts again *****/
+void GPIBbus::invalidateBusMap() {
+  busMap = 0;
+  busMapComplete = false;
+  busMapNext = 0;
+}
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
+
 /***** Send request to clear to all devices to local *****/
 void GPIBbus::sendAllClear() {
   // Un-assert REN
@@ -755,10 +912,120 @@ enum receiveState GPIBbus::receiveData(Stream &dataStream, bool detectEoi, bool
     return ERR;
   }
 */
+// >>> CHANGED FROM AR488 UPSTREAM >>> counters for /metrics
+#ifdef USE_METRICS
+  metrics.countRead(cfg.paddr, (cfg.eot_en && maxSize > 0) ? x - 1 : x, rstate);
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
   return rstate;
 }
 
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> added isDataWaiting and receiveDataPart
+/***** Is a talker offering a byte? *****/
+/*
+ * Signals that we are ready for data (NRFD unasserted) and checks DAV,
+ * so that readByte() can be called without waiting for the talker.
+ * The listener controls (CLAS or DLAS) must be set.
+ */
+bool GPIBbus::isDataWaiting() {
+  clearSignal(NRFD_BIT);
+  return isAsserted(DAV_PIN);
+}
+
+
+/***** Receive the part of a message that the talker has ready *****/
+/*
+ * Resumable version of receiveData(): it never waits for the talker, it reads
+ * bytes as long as one is offered, until maxSize bytes or maxMicros have passed.
+ * The caller addresses the device and keeps bytes[] (the last 3 bytes received,
+ * zeroed at the start of a message) for the terminator detection between calls.
+ * Returns RECEIVE_INIT while the message goes on, otherwise how it ended; the
+ * bus is then set to idle and the EOT character is added as by receiveData().
+ */
+enum receiveState GPIBbus::receiveDataPart(Stream &dataStream, uint8_t bytes[3], bool detectEoi, bool detectEndByte, uint8_t endByte, size_t maxSize, unsigned long maxMicros) {
+
+  uint8_t eor = cfg.eor & 7;
+  size_t x = 0;
+  bool readWithEoi = (cfg.eoi || detectEoi || (cfg.eor == 7));
+  bool eoiDetected = false;
+  enum gpibHandshakeState hstate;
+  enum receiveState rstate = RECEIVE_INIT;
+  unsigned long start = micros();
+
+  if (cfg.cmode == 2) {
+    setControls(CLAS);
+  } else {
+    setControls(DLAS);
+    readWithEoi = true;
+  }
+
+  while (x < maxSize && (unsigned long)(micros() - start) < maxMicros) {
+
+    if (isAsserted(ATN_PIN)) {
+      rstate = RECEIVE_ATN;
+      break;
+    }
+
+    // Nothing offered yet, try again in the next call
+    if (!isDataWaiting()) break;
+
+    hstate = readByte(&bytes[0], readWithEoi, &eoiDetected);
+
+    if (hstate == IFC_ASSERTED) {
+      rstate = RECEIVE_IFC;
+      break;
+    }
+    if (hstate == ATN_ASSERTED) {
+      rstate = RECEIVE_ATN;
+      break;
+    }
+    if (hstate != HANDSHAKE_COMPLETE) {
+      rstate = RECEIVE_ERR;
+      break;
+    }
+
+    dataStream.print((char)bytes[0]);
+    x++;
+
+    if (readWithEoi) {
+      if (eoiDetected) {
+        rstate = RECEIVE_EOI;
+        break;
+      }
+    } else if (detectEndByte) {
+      if (bytes[0] == endByte) {
+        rstate = RECEIVE_ENDCHAR;
+        break;
+      }
+    } else if (isTerminatorDetected(bytes, eor)) {
+      rstate = RECEIVE_ENDL;
+      break;
+    }
+
+    bytes[2] = bytes[1];
+    bytes[1] = bytes[0];
+  }
+
+  if (eoiDetected && cfg.eot_en) dataStream.print(cfg.eot_ch);
+
+#ifdef USE_METRICS
+  metrics.countRead(cfg.paddr, x, rstate);
+#endif
+
+  if (rstate != RECEIVE_INIT) {
+    if (cfg.cmode == 2) {
+      setControls(CIDS);
+    } else {
+      setControls(DIDS);
+    }
+  }
+
+  return rstate;
+}
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
+
 /***** Send a series of characters as data to the GPIB bus *****/
 void GPIBbus::sendData(const char *data, uint8_t dsize, bool isLastPacket) {
   //  bool err = false;
@@ -819,6 +1086,12 @@ void GPIBbus::sendData(const char *data, uint8_t dsize, bool isLastPacket) {
   DB_PRINT(F("<- End of send loop."), "");
 #endif
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> counters for /metrics
+#ifdef USE_METRICS
+  metrics.countBytes(cfg.paddr, 0, dsize);
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
   // Terminators and EOI
   if ((state == HANDSHAKE_COMPLETE) && tc) {
     switch (cfg.eos) {
@@ -1011,6 +1284,9 @@ void GPIBbus::setDataVal(uint8_t value) {
 bool GPIBbus::unAddressDevice() {
   // De-bounce
   delayMicroseconds(30);
+// >>> CHANGED FROM AR488 UPSTREAM >>> see serialPoll()
+  pollTalker = false;
+// <<< CHANGED FROM AR488 UPSTREAM <<<
   // Utalk/unlisten
   if (sendCmd(GC_UNT)) return ERR;
   if (sendCmd(GC_UNL)) return ERR;
@@ -1032,6 +1308,9 @@ bool GPIBbus::addressDevice(uint8_t pri, uint8_t sec=0xFF, uint8_t dir=TOLISTEN)
 
   if ( sec<0x60 || (sec>0x7E && sec!=0xFF) ) return ERR;
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> see serialPoll()
+  pollTalker = false;
+// <<< CHANGED FROM AR488 UPSTREAM <<<
   if (sendCmd(GC_UNL)) return ERR;
   if (sendCmd(GC_UNT)) return ERR;
 
@@ -1182,6 +1461,12 @@ enum gpibHandshakeState GPIBbus::readByte(uint8_t *db, bool readWithEoi, bool *e
     currentMillis = millis();
   }
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> counters for /metrics
+#ifdef USE_METRICS
+  if (gpibState != IFC_ASSERTED && gpibState != ATN_ASSERTED) metrics.countHandshakeTimeout();
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
   // Otherwise return stage
 #ifdef DEBUG_GPIBbus_RECEIVE
   if ((gpibState == HANDSHAKE_START) || (gpibState == DATA_ACCEPTED)) {
@@ -1283,6 +1568,12 @@ enum gpibHandshakeState GPIBbus::writeByte(uint8_t db, bool isLastByte) {
     return gpibState;
   }
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> counters for /metrics
+#ifdef USE_METRICS
+  if (gpibState != IFC_ASSERTED && gpibState != ATN_ASSERTED) metrics.countHandshakeTimeout();
+#endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
   // Otherwise timeout or ATN/IFC return stage at which it ocurred
 #ifdef DEBUG_GPIBbus_SEND
   switch (gpibState) {
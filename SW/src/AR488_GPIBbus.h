@@ -198,6 +198,9 @@ public:
   bool sendSDC();
   bool sendTCT(uint8_t addr);
   void sendAllClear();
+// >>> CHANGED FROM AR488 UPSTREAM >>> added serialPoll and idleTalker
+  bool serialPoll(uint8_t addr, uint8_t *sb);
+  bool idleTalker();
 
   bool sendUNT();
   bool sendUNL();
@@ -215,6 +218,9 @@ public:
   enum gpibHandshakeState readByte(uint8_t *db, bool readWithEoi, bool *eoi);
   enum gpibHandshakeState writeByte(uint8_t db, bool isLastByte);
   enum receiveState receiveData(Stream &dataStream, bool detectEoi, bool detectEndByte, uint8_t endByte, size_t maxSize = 0);
+// >>> CHANGED FROM AR488 UPSTREAM >>> added isDataWaiting and receiveDataPart
+  bool isDataWaiting();
+  enum receiveState receiveDataPart(Stream &dataStream, uint8_t bytes[3], bool detectEoi, bool detectEndByte, uint8_t endByte, size_t maxSize, unsigned long maxMicros);
   void sendData(const char *data, uint8_t dsize, bool isLastPacket = true);
 //  void clearDataBus();
   void setControlVal(uint8_t value);
@@ -230,10 +236,28 @@ public:
   bool unAddressDevice();
   uint8_t haveAddressedDevice();
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> added the cached bus map
+#ifdef USE_BUS_MAP
+  bool probeDevice(uint8_t pri);
+  uint32_t scanBusMap();
+  bool busMapDue();
+  void busMapStep();
+  void invalidateBusMap();
+  uint32_t busMap = 0;           // bit N is set when an instrument listens at primary address N
+  bool busMapComplete = false;   // every address was probed since the last IFC
+  unsigned long busMapTime = 0;  // millis() at the end of the last complete scan
+#endif
+
 private:
+#ifdef USE_BUS_MAP
+  uint8_t busMapNext = 0;        // next address probed by busMapStep()
+#endif
 
   bool txBreak;  // Signal to break the GPIB transmission
   uint8_t deviceAddressed;
+// >>> CHANGED FROM AR488 UPSTREAM >>> the talker was addressed by serialPoll(), see idleTalker()
+  bool pollTalker;
+// <<< CHANGED FROM AR488 UPSTREAM <<<
   bool isTerminatorDetected(uint8_t bytes[3], uint8_t eorSequence);
   enum transmitMode _xmitMode;
 
@@ -1,8 +1,9 @@
 #include "EthernetStream.h"
+#include <utility/w5100.h>
 
 
 EthernetStream::EthernetStream()
-    : lastActivityTime(0), lastWriteTime(0), timeout(10000), timeout_write(500) {}
+    : current(0), bufferLength(0), lastWriteTime(0), timeout_write(ETHERNETSTREAM_FLUSH_TIMEOUT) {}
 
 
 bool EthernetStream::begin(uint32_t port) {
@@ -12,95 +13,244 @@ bool EthernetStream::begin(uint32_t port) {
     if (!server) return false;
 
     server->begin();
-    lastActivityTime = millis();
     return true;
 }
 
+// Forget the selected client when it disconnected
 void EthernetStream::checkClient() {
-    // This uses the 'server.available()' method. A client will become available once I have received data. 
-    // You can also only have one client this way
+    EthernetClient &client = clients[current];
     if (client && !client.connected()) {
         client.stop();
         client = EthernetClient();
+        bufferLength = 0;
     }
-    if (!client) {
-        client = server->available();
-    }
-    if (client) {
-        lastActivityTime = millis();
+}
+
+/**
+ * @brief Select the client for the next reads and writes
+ * 
+ * Whatever is still buffered for the previous client is sent first.
+ * 
+ * @param index the client, 0 to PROLOGIX_MAX_CLIENTS - 1
+ */
+void EthernetStream::select(uint8_t index) {
+    if (index == current || index >= PROLOGIX_MAX_CLIENTS) return;
+    if (clients[current]) {
+        sendBuffer();
     }
+    bufferLength = 0;
+    current = index;
+}
+
+/**
+ * @brief Check if a client is connected at an index
+ */
+bool EthernetStream::connected(uint8_t index) {
+    return index < PROLOGIX_MAX_CLIENTS && clients[index] && clients[index].connected();
 }
 
 int EthernetStream::available() {
     if (!server) return 0;
     checkClient();
-    if (!client) {
-        client = server->available();
-        if (client) {
-        }        
-    }
-    if (client) {
-        return client.available();
+    if (clients[current]) {
+        return clients[current].available();
     }
     return 0;
 }
 
 int EthernetStream::read() {
     checkClient();
-    if (client) {
-        return client.read();
+    if (clients[current]) {
+        int c = clients[current].read();
+        if (c >= 0) lastActivity[current] = millis();
+        return c;
     }
     return -1;
 }
 
+/**
+ * @brief Read what has been received, up to size bytes, with one transfer from the W5500
+ * 
+ * @return int the number of bytes read, 0 if nothing was received
+ */
+int EthernetStream::read(uint8_t *buffer, size_t size) {
+    checkClient();
+    if (clients[current] && clients[current].available()) {
+        int len = clients[current].read(buffer, size);
+        if (len <= 0) return 0;
+        lastActivity[current] = millis();
+        return len;
+    }
+    return 0;
+}
+
 int EthernetStream::peek() {
     checkClient();
-    if (client) {
-        return client.peek();
+    if (clients[current]) {
+        return clients[current].peek();
     }
     return -1;
 }
 
+/**
+ * @brief Number of bytes that can be written without waiting for the client
+ * 
+ * @return int the free space in the socket transmit buffer, minus what is still in our buffer
+ */
+int EthernetStream::availableForWrite() {
+    checkClient();
+    if (clients[current]) {
+        int room = clients[current].availableForWrite() - (int)bufferLength;
+        return room > 0 ? room : 0;
+    }
+    return 0;
+}
+
 void EthernetStream::flush() {
-    if (client) {
-        client.flush();
+    if (clients[current]) {
+        sendBuffer();
+        clients[current].flush();
     }
 }
 
-size_t EthernetStream::write(uint8_t b) {
-    if (client) {
-        buffer += static_cast<char>(b);
+// Send the transmit buffer in one write
+void EthernetStream::sendBuffer() {
+    if (bufferLength) {
+        clients[current].write(buffer, bufferLength);
+        bufferLength = 0;
+        lastActivity[current] = millis();
+    }
+}
 
+size_t EthernetStream::write(uint8_t b) {
+    if (clients[current]) {
         unsigned long now = millis();
-        if (b == '\n' || buffer.length() >= 1024) {// || (now - lastWriteTime) > timeout_write) {
-            client.print(buffer);
-            buffer = "";
+        if (bufferLength == 0) {
             lastWriteTime = now;
         }
+        buffer[bufferLength++] = b;
+
+        if (b == '\n' || bufferLength >= ETHERNETSTREAM_TX_SIZE || (now - lastWriteTime) > timeout_write) {
+            sendBuffer();
+        }
 
         return 1;
     }
     return 0;
 }
 
+size_t EthernetStream::write(const uint8_t *data, size_t size) {
+    if (!clients[current] || size == 0) {
+        return 0;
+    }
+    if (bufferLength + size > ETHERNETSTREAM_TX_SIZE) {
+        sendBuffer();
+    }
+    if (size >= ETHERNETSTREAM_TX_SIZE) {
+        // Too big to buffer, so it goes out directly
+        lastActivity[current] = millis();
+        return clients[current].write(data, size);
+    }
+    if (bufferLength == 0) {
+        lastWriteTime = millis();
+    }
+    memcpy(buffer + bufferLength, data, size);
+    bufferLength += size;
+    if (data[size - 1] == '\n' || (millis() - lastWriteTime) > timeout_write) {
+        sendBuffer();
+    }
+    return size;
+}
 
-int EthernetStream::maintain(void) {
-    unsigned long currentMillis = millis();
-    if (client && (currentMillis - lastActivityTime > timeout)) {
-        client.stop();
-        client = EthernetClient();
+
+/**
+ * @brief Check if a new client has connected and waits to be accepted
+ */
+bool EthernetStream::clientWaiting() {
+    for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+        if (EthernetServer::server_port[s] == port && EthernetClient(s).status() == SnSR::ESTABLISHED) {
+            return true;
+        }
     }
-    // TODO: Improve this. This only checks if a client is connected and has sent data
-    if (client) {
-        return 1;
-    } else {
-        return 0;
+    return false;
+}
+
+/**
+ * @brief Find the client that has been idle the longest, for more than PROLOGIX_IDLE_TIMEOUT
+ * 
+ * @param busy the client that holds the GPIB bus, it is not considered
+ * @return int the index, or -1 if there is none
+ */
+int EthernetStream::idleClient(int8_t busy) {
+    int index = -1;
+    unsigned long now = millis();
+    unsigned long longest = PROLOGIX_IDLE_TIMEOUT;
+    for (uint8_t i = 0; i < PROLOGIX_MAX_CLIENTS; i++) {
+        if (clients[i] && i != busy && now - lastActivity[i] > longest) {
+            longest = now - lastActivity[i];
+            index = i;
+        }
     }
+    return index;
+}
+
+/**
+ * @brief Accept new clients, drop the disconnected ones and send the buffer when it waited too long
+ * 
+ * When all clients are taken and a new one waits, the client that has been idle the longest
+ * is closed. Its slot goes to the new client in the next pass, so the session sees it go first.
+ * 
+ * @param busy the client that holds the GPIB bus, it is never closed
+ * @return int the number of connected clients
+ */
+int EthernetStream::maintain(int8_t busy) {
+    if (!server) return 0;
+    if (clients[current] && bufferLength && (millis() - lastWriteTime > timeout_write)) {
+        // Nothing was added for a while, e.g. a reply without a newline
+        sendBuffer();
+    }
+    int nrClients = 0;
+    int freeSlot = -1;
+    for (uint8_t i = 0; i < PROLOGIX_MAX_CLIENTS; i++) {
+        if (clients[i] && !clients[i].connected()) {
+            clients[i].stop();
+            clients[i] = EthernetClient();
+            if (i == current) bufferLength = 0;
+        }
+        if (clients[i]) {
+            nrClients++;
+        } else if (freeSlot < 0) {
+            freeSlot = i;
+        }
+    }
+    if (freeSlot >= 0) {
+        // accept() returns every new connection once, so every client gets its own slot
+        EthernetClient newClient = server->accept();
+        if (newClient) {
+            clients[freeSlot] = newClient;
+            lastActivity[freeSlot] = millis();
+            nrClients++;
+        }
+    } else if (clientWaiting()) {
+        int idle = idleClient(busy);
+        if (idle >= 0) {
+            if (idle == current) sendBuffer();
+            clients[idle].setConnectionTimeout(1);  // do not keep the other clients waiting for the close
+            clients[idle].stop();
+            clients[idle] = EthernetClient();
+            if (idle == current) bufferLength = 0;
+            nrClients--;
+        }
+    }
+    return nrClients;
 }
 
 void EthernetStream::killClients(void) {
-    if (client) {
-        client.stop();
-        client = EthernetClient();
+    for (uint8_t i = 0; i < PROLOGIX_MAX_CLIENTS; i++) {
+        if (clients[i]) {
+            clients[i].stop();
+            clients[i] = EthernetClient();
+        }
     }
+    bufferLength = 0;
 }
@@ -4,20 +4,36 @@
 #include <Arduino.h>
 #include <Ethernet.h>
 #include <SPI.h>
+#include "config.h"
 
+// Size of the transmit buffer: it is sent with one write when it is full, at a newline,
+// or when its oldest byte has waited ETHERNETSTREAM_FLUSH_TIMEOUT ms.
+#ifndef ETHERNETSTREAM_TX_SIZE
+#define ETHERNETSTREAM_TX_SIZE 128
+#endif
+#ifndef ETHERNETSTREAM_FLUSH_TIMEOUT
+#define ETHERNETSTREAM_FLUSH_TIMEOUT 20
+#endif
+
+// Up to PROLOGIX_MAX_CLIENTS clients can be connected at the same time.
+// select() chooses the client that the Stream functions read from and write to.
 class EthernetStream : public Stream {
 public:
     EthernetStream();
   
     bool begin(uint32_t port);
-    int maintain(void);
+    int maintain(int8_t busy = -1);
     void killClients(void);
+    void select(uint8_t index);
+    bool connected(uint8_t index);
     int available() override;
     int read() override;
+    int read(uint8_t *buffer, size_t size);
     int peek() override;
+    int availableForWrite() override;
     void flush() override;
     size_t write(uint8_t b) override;
-    //size_t write(const uint8_t *buffer, size_t size) override;  // Override for writing buffers
+    size_t write(const uint8_t *buffer, size_t size) override;  // Override for writing buffers
     using Print::write;  // Bring in other overloads of write from Print
 
 private:
@@ -25,12 +41,16 @@ private:
     IPAddress ip;
     uint16_t port;
     void checkClient();
+    void sendBuffer();
+    bool clientWaiting();
+    int idleClient(int8_t busy);
     EthernetServer *server;
-    EthernetClient client;
-    String buffer;
-    unsigned long lastActivityTime;  // Track the last activity time
-    const unsigned long timeout;  // Timeout period in milliseconds
-    unsigned long lastWriteTime; // Track time since last data to buffer
+    EthernetClient clients[PROLOGIX_MAX_CLIENTS];
+    unsigned long lastActivity[PROLOGIX_MAX_CLIENTS];  // Time of the last read or write of every client
+    uint8_t current;  // Index of the selected client
+    uint8_t buffer[ETHERNETSTREAM_TX_SIZE];  // Transmit buffer of the selected client
+    size_t bufferLength;  // Number of bytes in the transmit buffer
+    unsigned long lastWriteTime; // Time the oldest byte in the buffer was written
     const unsigned long timeout_write; // Flush buffer if no newline after timeout period
 
 };
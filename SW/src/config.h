@@ -24,6 +24,18 @@
 #endif
 // If you define both, well, you'll have to deal with the compiler telling you there is not enough ROM.
 
+// define INTERFACE_HISLIP to run a HiSLIP server next to the VXI-11 server (see the HiSLIP env in platformio.ini).
+// It shares the SCPI handler and the GPIB bus with the VXI-11 server.
+#if defined(INTERFACE_HISLIP) && !defined(INTERFACE_VXI11)
+#error "INTERFACE_HISLIP needs INTERFACE_VXI11"
+#endif
+
+// define INTERFACE_SCPI_SOCKET to run a raw SCPI socket server next to the VXI-11 server (see the SCPI-Socket env in platformio.ini).
+// It shares the SCPI handler and the GPIB bus with the VXI-11 server.
+#if defined(INTERFACE_SCPI_SOCKET) && !defined(INTERFACE_VXI11)
+#error "INTERFACE_SCPI_SOCKET needs INTERFACE_VXI11"
+#endif
+
 // Debugging:
 // Easy, englobing setting for debugging output on the USB Serial (debugPort)
 
@@ -76,6 +88,10 @@
 #ifdef INTERFACE_PROLOGIX
 #define DISABLE_WEB_SERVER
 #endif
+// Same for HiSLIP and the SCPI sockets, which also need the sockets of the web server
+#if defined(INTERFACE_HISLIP) || defined(INTERFACE_SCPI_SOCKET)
+#define DISABLE_WEB_SERVER
+#endif
 
 // The web server serves a static explanation page and maybe some interactive use (see below).
 #ifdef DISABLE_WEB_SERVER
@@ -91,19 +107,121 @@
 #define WEB_INTERACTIVE
 #endif
 
+// define USE_BUS_MAP to keep a map of the instruments on the bus in GPIBbus, for /fnd of the web server
+#ifdef WEB_INTERACTIVE
+#define USE_BUS_MAP
+#endif
+
+// define USE_WEBSOCKET for the console of the interactive web page on one WebSocket connection (/ws), instead of a request per command.
+#ifdef WEB_INTERACTIVE
+#define USE_WEBSOCKET
+#endif
+
+// define USE_METRICS for the counters of the gateway on /metrics (Prometheus) and /metrics.json of the web server.
+// They take about 200 bytes of RAM.
+#ifdef USE_WEBSERVER
+#define USE_METRICS
+#endif
+
 // PORTS
 
 // For the Prologix server: 
 #define AR_ETHERNET_PORT
 #define PROLOGIX_PORT 1234
+// Number of clients that can use the Prologix server at the same time, each with its own ++ settings.
+// Every client takes a socket and about 220 bytes of RAM.
+#define PROLOGIX_MAX_CLIENTS 3
+// When all clients are taken and a new one connects, the client that has been idle the longest,
+// for more than this many ms, is closed to make room
+#define PROLOGIX_IDLE_TIMEOUT 10000
+// Data block size for ++read bin: every block is sent as one frame
+#define PROLOGIX_BIN_BLOCK_SIZE 256
+// Every client has a receive buffer of this size: the input is read from the socket in blocks and split into lines
+#define PROLOGIX_RX_SIZE 64
+// Complete lines that were received together are executed in one go, for at most this many ms
+#define PROLOGIX_LINE_BUDGET 50
+// Continuous read (++auto 3), listen only and talk only mode move at most this many bytes, or spend
+// at most this many us, per pass of the loop, so the rest of the adapter keeps running
+#define PROLOGIX_STREAM_BYTES 64
+#define PROLOGIX_STREAM_TIME 2000
+// ++repeat: size of the sample buffer, maximum length of a stored reply and of the command
+#define PROLOGIX_ACQ_BUFFER_SIZE 256
+#define PROLOGIX_ACQ_REPLY_SIZE 32
+#define PROLOGIX_ACQ_QUERY_SIZE 48
+// ++macro set/add: macros 0-9 can be stored in the 24AA256, MACRO_SLOT_SIZE bytes each from MACRO_EEPROM_START.
+// A stored macro replaces the one with the same number in AR488_Config.h.
+#define MACRO_EEPROM_START 0x0000
+#define MACRO_SLOT_SIZE 1024
 
 // For the VXI server:
-#define VXI11_PORT 9010
+// The port mapper hands out a dedicated port out of this range to every new link, each with its own listening socket.
+#define VXI11_PORT_START 9010
+#define VXI11_PORT_END 9019
+// Time in ms after which a port handed out by the port mapper is released again when no client has connected to it
+#define VXI11_LISTEN_TIMEOUT 5000
+// Time in ms after which an idle link may be closed when a new link needs its slot or socket.
+// Links holding a device_lock are never closed. 0 disables the eviction.
+#define VXI11_IDLE_TIMEOUT 60000
+// A device_lock lasts until device_unlock or destroy_link. As a safety net for clients that crashed while
+// holding one, it is released after this many ms without any request on its link. 0 keeps it forever.
+#define VXI11_LOCK_TIMEOUT 3600000UL
 // Maximum number of clients for the VXI server:
 // Max sockets on the device. You will likely not even be able to reach that number, because of other sockets open or busy closing
 // MAX_SOCK_NUM is defined in the Ethernet library, and is 4 for W5100 and 8 for W5200 and W5500.
 #define MAX_VXI_CLIENTS MAX_SOCK_NUM
 
+// For the HiSLIP server:
+#define HISLIP_PORT 4880
+// Every session takes 2 sockets (synchronous and asynchronous channel)
+#define MAX_HISLIP_SESSIONS 2
+// Time in ms to wait for the first message on a new connection
+#define HISLIP_INIT_TIMEOUT 5000
+// The reply of the instrument is read after a message that ends with a '?' (a SCPI query).
+// Instruments without such queries (e.g. "F1R-2" on a HP 3478A) need a read after every message:
+// set bit N for GPIB address N (bit 0 for hislip0), e.g. -DHISLIP_READ_ALWAYS=0x20UL for address 5.
+#ifndef HISLIP_READ_ALWAYS
+#define HISLIP_READ_ALWAYS 0UL
+#endif
+
+// For the raw SCPI socket server:
+// Port SCPI_SOCKET_PORT + N goes to the instrument at GPIB address N, with 0 the gateway (or the default instrument).
+// Every port takes a listening socket, so only list the addresses you need, e.g. -D'SCPI_SOCKET_ADDRESSES=0,5' -DSCPI_SOCKET_NR_PORTS=2
+#define SCPI_SOCKET_PORT 5025
+#ifndef SCPI_SOCKET_ADDRESSES
+#define SCPI_SOCKET_ADDRESSES 0
+#define SCPI_SOCKET_NR_PORTS 1
+#endif
+
+// For the web server:
+// Number of browser connections served at the same time. Every connection takes a socket, on top of the listening socket.
+// Idle connections are closed when a new VXI-11 link finds no free socket.
+#define MAX_WEB_CLIENTS 2
+// Time in ms a connection is left alone after its last request, before it may be closed for a VXI-11 link
+#define WEB_MIN_IDLE 1000
+// Time in ms an idle connection is kept open for the next request (the page polls every 5 seconds)
+#define WEB_KEEPALIVE_TIMEOUT 6000
+// Reading the reply of an instrument moves at most this many bytes, or spends at most this many us, per pass of the loop
+#define WEB_READ_BYTES 64
+#define WEB_READ_TIME 2000
+// /stream: longest query, and shortest and default time in ms between two queries
+#define WEB_STREAM_QUERY_SIZE 64
+#define WEB_STREAM_MIN_PERIOD 100
+#define WEB_STREAM_PERIOD 1000
+// /fnd: the instruments on the bus are kept in a map, refreshed every this many ms: in the background, one address
+// per pass of the loop while nobody uses the bus and REN is not asserted, otherwise by the next /fnd
+#define BUS_MAP_REFRESH 60000
+// /metrics: number of GPIB addresses with their own byte counters, the others are counted together
+#define METRICS_ADDRESSES 6
+
+// For the mDNS responder:
+// define USE_MDNS to publish the VXI-11 server (and the HiSLIP, SCPI socket and web servers) via mDNS/DNS-SD.
+// It takes one UDP socket for good, so one VXI-11 connection less (see README.md).
+//#define USE_MDNS
+#if defined(USE_MDNS) && !defined(INTERFACE_VXI11)
+#error "USE_MDNS needs INTERFACE_VXI11"
+#endif
+
 // EEPROM use: 
-// Writing the 24AA256 is somehow broken, so we can also write via the GPIB configuration via AR488_GPIBconf_EXTEND
+// The IP address and the default instrument are stored in the GPIB configuration with AR488_GPIBconf_EXTEND,
+// otherwise in the 24AA256 (which also holds the MAC address)
 #define AR488_GPIBconf_EXTEND
@@ -0,0 +1,488 @@
+/*!
+  @file   hislip_server.cpp
+  @brief  Definition of the HiSLIP_Server class.
+
+  HiSLIP (IVI-6.1) replaces the RPC headers, the port mapper and the separate
+  abort/interrupt channels of VXI-11 by a 16 byte header on 2 connections to port 4880.
+
+  Example of connection string:
+
+    TCPIP::192.168.1.105::hislip0::INSTR      the gateway, or the default instrument (see the serial menu)
+    TCPIP::192.168.1.105::hislip5::INSTR      the instrument at GPIB address 5
+
+  The requests go to the same SCPI_handler as the VXI-11 requests, so both servers share the GPIB bus.
+
+  Only the synchronized mode is supported. The reply of the instrument is read after a message whose
+  last character (white space aside) is a '?', so binary data that happens to contain 0x3F does not
+  start a read. For instruments that do not use '?' queries, e.g. "F1R-2" on a HP 3478A, set the bit
+  of their GPIB address in HISLIP_READ_ALWAYS (config.h): their reply is read after every message.
+*/
+
+#include "hislip_server.h"
+#include "rpc_packets.h"
+
+// Use of shared memory zones:
+// The messages with data are received and sent through vxi_read_buffer: the servers run one after the other in the main loop.
+// The other messages are sent through vxi_send_buffer.
+static hislip_message_header *const hislip_data = (hislip_message_header *)vxi_read_buffer;     ///< header of a DATA or DATA_END message
+static uint8_t *const hislip_data_payload = vxi_read_buffer + sizeof(hislip_message_header);      ///< payload of a DATA or DATA_END message
+static hislip_message_header *const hislip_reply = (hislip_message_header *)vxi_send_buffer;      ///< header of the other messages
+
+static const uint32_t hislip_protocol_version = 0x0100;  // 1.0
+static const uint16_t hislip_vendor_id = ('A' << 8) | 'R';
+
+/**
+ * @brief Fill in a message header.
+ */
+static void fill_header(hislip_message_header *header, uint8_t type, uint8_t control, uint32_t parameter, uint32_t len)
+{
+    header->prologue[0] = 'H';
+    header->prologue[1] = 'S';
+    header->message_type = type;
+    header->control_code = control;
+    header->message_parameter = parameter;
+    header->payload_length_h = 0;
+    header->payload_length = len;
+}
+
+HiSLIP_Server::HiSLIP_Server(SCPI_handler_interface &scpi_handler)
+    : server(HISLIP_PORT), next_session_id(1), srq_signalled(false), scpi_handler(scpi_handler)
+{
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        locked[i] = false;
+    }
+}
+
+void HiSLIP_Server::begin()
+{
+    killClients();
+    server.begin();
+}
+
+int HiSLIP_Server::nr_connections(void)
+{
+    int count = 0;
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        if (sync_clients[i]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void HiSLIP_Server::killClients(void)
+{
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        close_session(i);
+    }
+    if (pending) {
+        pending.stop();
+    }
+}
+
+void HiSLIP_Server::close_session(int slot)
+{
+    if (sync_clients[slot]) {
+        sync_clients[slot].stop();
+        scpi_handler.release_control();
+    }
+    if (async_clients[slot]) {
+        async_clients[slot].stop();
+    }
+    locked[slot] = false;
+}
+
+/**
+ * @brief run the HiSLIP server loop.
+ *
+ * @return int the active number of sessions
+ */
+int HiSLIP_Server::loop()
+{
+    // This is a TCP server based on 'server.accept()', meaning I must handle the lifecycle of the clients
+    // It is blocking for input and output, like the VXI server
+
+    // a session ends when one of its channels goes away
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        if ((sync_clients[i] && !sync_clients[i].connected()) || (async_clients[i] && !async_clients[i].connected())) {
+#ifdef LOG_VXI_DETAILS
+            debugPort.print(F("Closing HiSLIP session "));
+            debugPort.println(session_ids[i]);
+#endif
+            close_session(i);
+        }
+    }
+
+    if (!pending) {
+        pending = server.accept();
+        pending_since = millis();
+    }
+    if (pending) {
+        if (pending.available() >= (int)sizeof(hislip_message_header)) {
+            accept_pending();
+        } else if (!pending.connected() || millis() - pending_since > HISLIP_INIT_TIMEOUT) {
+            pending.stop();
+        }
+    }
+
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        if (async_clients[i] && async_clients[i].available()) {
+            handle_async(i);
+        }
+        if (sync_clients[i] && async_clients[i] && sync_clients[i].available()) {
+            handle_sync(i);
+        }
+    }
+
+    check_srq();
+    return nr_connections();
+}
+
+/**
+ * @brief Read a message header.
+ *
+ * @return false if the header is not a HiSLIP header
+ */
+bool HiSLIP_Server::read_header(EthernetClient &client, uint8_t &type, uint8_t &control, uint32_t &parameter, uint32_t &len)
+{
+    hislip_message_header header = {{0, 0}, 0, 0, 0, 0, 0};
+    if (client.readBytes((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+        header.prologue[0] != 'H' || header.prologue[1] != 'S') {
+        return false;
+    }
+    type = header.message_type;
+    control = header.control_code;
+    parameter = header.message_parameter;
+    len = header.payload_length;
+    if ((uint32_t)header.payload_length_h != 0) {
+        len = 0xFFFFFFFF;  // we will never get that far
+    }
+    return true;
+}
+
+void HiSLIP_Server::send_message(EthernetClient &client, uint8_t type, uint8_t control, uint32_t parameter, const uint8_t *payload, uint32_t len)
+{
+    // only used for the short messages, see hislip_reply
+    fill_header(hislip_reply, type, control, parameter, len);
+    if (len > 0) {
+        memcpy(vxi_send_buffer + sizeof(hislip_message_header), payload, len);
+    }
+    client.write(vxi_send_buffer, sizeof(hislip_message_header) + len);
+}
+
+void HiSLIP_Server::skip_payload(EthernetClient &client, uint32_t len)
+{
+    while (len > 0) {
+        uint32_t n = min(len, (uint32_t)HISLIP_MAX_DATA_SIZE);
+        if (client.readBytes(hislip_data_payload, n) != n) {
+            return;  // timeout, the connection will be closed if it is broken
+        }
+        len -= n;
+    }
+}
+
+/**
+ * @brief Handle the first message on a new connection: INITIALIZE opens a session, ASYNC_INITIALIZE attaches to one.
+ */
+void HiSLIP_Server::accept_pending(void)
+{
+    uint8_t type, control;
+    uint32_t parameter, len;
+    EthernetClient client = pending;
+    pending = EthernetClient();
+
+    if (!read_header(client, type, control, parameter, len)) {
+        send_message(client, hislip::FATAL_ERROR, hislip::FATAL_BAD_HEADER, 0);
+        client.stop();
+        return;
+    }
+
+    if (type == hislip::INITIALIZE) {
+        int slot = -1;
+        for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+            if (!sync_clients[i]) {
+                slot = i;
+                break;
+            }
+        }
+        // the payload is the sub-address: hislipN or gpibN,A
+        char sub_address[16] = {0};
+        uint32_t n = min(len, (uint32_t)sizeof(sub_address) - 1);
+        client.readBytes((uint8_t *)sub_address, n);
+        skip_payload(client, len - n);
+
+        if (slot < 0 || !scpi_handler.claim_control()) {
+            send_message(client, hislip::FATAL_ERROR, hislip::FATAL_MAX_CLIENTS, 0);
+            client.stop();
+            return;
+        }
+        int address = 0;
+        char *cptr = strchr(sub_address, ',');
+        if (cptr) {
+            address = atoi(cptr + 1);
+        } else if (strncasecmp(sub_address, "hislip", 6) == 0) {
+            address = atoi(sub_address + 6);
+        }
+        if (address < 0 || address > 30) {
+            address = 0;
+        }
+
+        if (async_clients[slot]) {
+            async_clients[slot].stop();  // left over from a session that was not complete
+        }
+        sync_clients[slot] = client;
+        session_ids[slot] = next_session_id++;
+        addresses[slot] = address;
+        message_ids[slot] = 0xFFFFFF00;  // the initial message id
+        last_char[slot] = 0;
+        locked[slot] = false;
+#ifdef LOG_VXI_DETAILS
+        debugPort.print(F("HiSLIP session "));
+        debugPort.print(session_ids[slot]);
+        debugPort.print(F(" for "));
+        debugPort.print(sub_address);
+        debugPort.print(F(" -> gpib_address="));
+        debugPort.println(address);
+#endif
+        // control code 0: we prefer the synchronized mode
+        send_message(client, hislip::INITIALIZE_RESPONSE, 0, (hislip_protocol_version << 16) | session_ids[slot]);
+    } else if (type == hislip::ASYNC_INITIALIZE) {
+        skip_payload(client, len);
+        for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+            if (sync_clients[i] && !async_clients[i] && session_ids[i] == (uint16_t)parameter) {
+                async_clients[i] = client;
+                send_message(client, hislip::ASYNC_INITIALIZE_RESPONSE, 0, hislip_vendor_id);
+                return;
+            }
+        }
+        send_message(client, hislip::FATAL_ERROR, hislip::FATAL_INVALID_INIT, 0);
+        client.stop();
+    } else {
+        send_message(client, hislip::FATAL_ERROR, hislip::FATAL_INVALID_INIT, 0);
+        client.stop();
+    }
+}
+
+/**
+ * @brief Find the session holding a lock that covers the instrument of the session in this slot.
+ *
+ * A lock covers the sessions on the same GPIB address. A lock on hislip0 covers all sessions,
+ * and a lock on any instrument covers the hislip0 session.
+ *
+ * @return int the slot holding the lock, or -1 if there is none
+ */
+int HiSLIP_Server::lock_holder(int slot)
+{
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        if (i != slot && locked[i] && sync_clients[i] &&
+            (addresses[i] == addresses[slot] || addresses[i] == 0 || addresses[slot] == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Handle a message on the synchronous channel: data, trigger and the end of a device clear.
+ *
+ * Data and trigger of a session are refused with an ERROR message while another session holds a lock on its instrument.
+ */
+void HiSLIP_Server::handle_sync(int slot)
+{
+    uint8_t type, control;
+    uint32_t parameter, len;
+    EthernetClient &client = sync_clients[slot];
+
+    if (!read_header(client, type, control, parameter, len)) {
+        send_message(client, hislip::FATAL_ERROR, hislip::FATAL_BAD_HEADER, 0);
+        close_session(slot);
+        return;
+    }
+
+    if ((type == hislip::DATA || type == hislip::DATA_END || type == hislip::TRIGGER) && lock_holder(slot) >= 0) {
+#ifdef LOG_VXI_DETAILS
+        debugPort.print(F("HiSLIP session "));
+        debugPort.print(session_ids[slot]);
+        debugPort.println(F(" refused, the instrument is locked by another session"));
+#endif
+        message_ids[slot] = parameter;
+        skip_payload(client, len);
+        last_char[slot] = 0;
+        send_message(client, hislip::ERROR, hislip::ERROR_UNIDENTIFIED, 0);
+        return;
+    }
+
+    switch (type) {
+        case hislip::DATA:
+        case hislip::DATA_END:
+            message_ids[slot] = parameter;
+            // write the payload in parts of the buffer size, the handler knows to keep the device addressed
+            do {
+                uint32_t n = min(len, (uint32_t)HISLIP_MAX_DATA_SIZE);
+                if (client.readBytes(hislip_data_payload, n) != n) {
+                    close_session(slot);
+                    return;
+                }
+                len -= n;
+                for (uint32_t i = n; i > 0; i--) {
+                    if (!isspace(hislip_data_payload[i - 1])) {
+                        last_char[slot] = hislip_data_payload[i - 1];
+                        break;
+                    }
+                }
+                scpi_handler.write(addresses[slot], (const char *)hislip_data_payload, n, type == hislip::DATA_END && len == 0);
+            } while (len > 0);
+            if (type == hislip::DATA_END) {
+                if (last_char[slot] == '?' || ((HISLIP_READ_ALWAYS >> addresses[slot]) & 1)) {
+                    send_response(slot);
+                }
+                last_char[slot] = 0;
+            }
+            break;
+        case hislip::TRIGGER:
+            message_ids[slot] = parameter;
+            skip_payload(client, len);
+            scpi_handler.trigger(addresses[slot]);
+            break;
+        case hislip::DEVICE_CLEAR_COMPLETE:
+            skip_payload(client, len);
+            last_char[slot] = 0;
+            // control code 0: we stay in synchronized mode
+            send_message(client, hislip::DEVICE_CLEAR_ACKNOWLEDGE, 0, 0);
+            break;
+        default:
+            skip_payload(client, len);
+            send_message(client, hislip::ERROR, hislip::ERROR_UNRECOGNIZED_TYPE, 0);
+            break;
+    }
+}
+
+/**
+ * @brief Read the response from the instrument, and send it in DATA messages, closed by a DATA_END message.
+ */
+void HiSLIP_Server::send_response(int slot)
+{
+    SCPI_handler_read_stop_reasons rv;
+    do {
+        bufStream stream(hislip_data_payload, HISLIP_MAX_DATA_SIZE);
+        rv = scpi_handler.read(addresses[slot], stream, HISLIP_MAX_DATA_SIZE);
+        if (rv == SRS_TIMEOUT && stream.len() == 0) {
+            // like an instrument that does not answer: the client will time out
+            return;
+        }
+        fill_header(hislip_data, rv == SRS_MAXSIZE ? hislip::DATA : hislip::DATA_END, 0, message_ids[slot], stream.len());
+        sync_clients[slot].write(vxi_read_buffer, sizeof(hislip_message_header) + stream.len());
+#ifdef LOG_VXI_DETAILS
+        debugPort.print(F("HiSLIP session "));
+        debugPort.print(session_ids[slot]);
+        debugPort.print(F(" response, Data_Len="));
+        debugPort.print(stream.len());
+        debugPort.print(F("; Reason="));
+        debugPort.println(SCPI_handler_read_stop_reasons_to_string(rv));
+#endif
+    } while (rv == SRS_MAXSIZE);
+}
+
+/**
+ * @brief Handle a message on the asynchronous channel.
+ */
+void HiSLIP_Server::handle_async(int slot)
+{
+    uint8_t type, control;
+    uint32_t parameter, len;
+    EthernetClient &client = async_clients[slot];
+
+    if (!read_header(client, type, control, parameter, len)) {
+        send_message(client, hislip::FATAL_ERROR, hislip::FATAL_BAD_HEADER, 0);
+        close_session(slot);
+        return;
+    }
+    // none of the asynchronous messages needs its payload (lock string, maximum message size of the client)
+    skip_payload(client, len);
+
+    switch (type) {
+        case hislip::ASYNC_MAXIMUM_MESSAGE_SIZE: {
+            // 64 bit big endian. Longer messages are accepted too, they are written to the instrument in parts.
+            uint8_t size[8] = {0, 0, 0, 0, 0, 0, (uint8_t)(HISLIP_MAX_DATA_SIZE >> 8), (uint8_t)(HISLIP_MAX_DATA_SIZE & 0xFF)};
+            send_message(client, hislip::ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE, 0, 0, size, sizeof(size));
+            break;
+        }
+        case hislip::ASYNC_DEVICE_CLEAR:
+            scpi_handler.devclear(addresses[slot]);
+            // control code 0: we stay in synchronized mode
+            send_message(client, hislip::ASYNC_DEVICE_CLEAR_ACKNOWLEDGE, 0, 0);
+            break;
+        case hislip::ASYNC_STATUS_QUERY: {
+            uint8_t stb = 0;
+            scpi_handler.read_stb(addresses[slot], stb);
+            send_message(client, hislip::ASYNC_STATUS_RESPONSE, stb, 0);
+            break;
+        }
+        case hislip::ASYNC_REMOTE_LOCAL_CONTROL: {
+            static const uint8_t llo = 0x11;  // GC_LLO, universal local lockout
+            if (control == hislip::RL_DISABLE_REMOTE || control == hislip::RL_DISABLE_REMOTE_GTL) {
+                scpi_handler.bus_control(BC_REN, 0);
+            } else if (control == hislip::RL_ENABLE_REMOTE) {
+                scpi_handler.bus_control(BC_REN, 1);
+            } else if (control == hislip::RL_GTR || control == hislip::RL_GTR_LLO) {
+                scpi_handler.remote(addresses[slot]);
+            } else if (control == hislip::RL_GTL) {
+                scpi_handler.local(addresses[slot]);
+            }
+            if (control == hislip::RL_GTR_LLO || control == hislip::RL_LLO) {
+                scpi_handler.send_command(&llo, 1);
+            }
+            send_message(client, hislip::ASYNC_REMOTE_LOCAL_RESPONSE, 0, 0);
+            break;
+        }
+        case hislip::ASYNC_LOCK: {
+            // there is no waiting for the lock: the server is blocking, so no other session could release it meanwhile
+            uint8_t result = hislip::LOCK_SUCCESS;
+            if (control == 0) {
+                if (!locked[slot]) {
+                    result = hislip::LOCK_ERROR;
+                }
+                locked[slot] = false;
+            } else if (lock_holder(slot) >= 0) {
+                result = hislip::LOCK_FAILURE;
+            } else {
+                locked[slot] = true;
+            }
+            send_message(client, hislip::ASYNC_LOCK_RESPONSE, result, 0);
+            break;
+        }
+        case hislip::ASYNC_LOCK_INFO: {
+            uint32_t count = 0;
+            for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+                if (locked[i] && sync_clients[i]) {
+                    count++;
+                }
+            }
+            send_message(client, hislip::ASYNC_LOCK_INFO_RESPONSE, locked[slot] ? 1 : 0, count);
+            break;
+        }
+        default:
+            send_message(client, hislip::ERROR, hislip::ERROR_UNRECOGNIZED_TYPE, 0);
+            break;
+    }
+}
+
+/**
+ * @brief Signal a new SRQ on the bus to the sessions on the instruments, they can then read the status byte.
+ */
+void HiSLIP_Server::check_srq(void)
+{
+    if (scpi_handler.bus_status(BS_SRQ) != 1) {
+        srq_signalled = false;
+        return;
+    }
+    if (srq_signalled) {
+        return;
+    }
+    srq_signalled = true;
+    for (int i = 0; i < MAX_HISLIP_SESSIONS; i++) {
+        if (async_clients[i] && addresses[i] != 0) {
+            send_message(async_clients[i], hislip::ASYNC_SERVICE_REQUEST, 0, 0);
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+/*!
+  @file   hislip_server.h
+  @brief  Declares the HiSLIP_Server class, a HiSLIP (IVI-6.1) server next to the VXI-11 server.
+*/
+
+#include "utilities.h"
+#include <Ethernet.h>
+#include "config.h"
+#include "vxi_server.h"
+
+namespace hislip {
+
+/*!
+  @brief  HiSLIP message types (IVI-6.1 table 4).
+*/
+enum message_types {
+    INITIALIZE = 0,                          ///< Sync channel: open a session
+    INITIALIZE_RESPONSE = 1,                 ///< Reply to INITIALIZE, carries the session id
+    FATAL_ERROR = 2,                         ///< The connection will be closed
+    ERROR = 3,                               ///< Non fatal error
+    ASYNC_LOCK = 4,                          ///< Request (control code 1) or release (0) a lock
+    ASYNC_LOCK_RESPONSE = 5,                 ///< Reply to ASYNC_LOCK
+    DATA = 6,                                ///< Data, more will follow
+    DATA_END = 7,                            ///< Data, end of the message
+    DEVICE_CLEAR_COMPLETE = 8,               ///< Sync channel: the client finished its part of the device clear
+    DEVICE_CLEAR_ACKNOWLEDGE = 9,            ///< Reply to DEVICE_CLEAR_COMPLETE
+    ASYNC_REMOTE_LOCAL_CONTROL = 10,         ///< Remote/local control, see remote_local_codes
+    ASYNC_REMOTE_LOCAL_RESPONSE = 11,        ///< Reply to ASYNC_REMOTE_LOCAL_CONTROL
+    TRIGGER = 12,                            ///< Sync channel: trigger the device
+    INTERRUPTED = 13,                        ///< Overlapped mode only (not implemented)
+    ASYNC_INTERRUPTED = 14,                  ///< Overlapped mode only (not implemented)
+    ASYNC_MAXIMUM_MESSAGE_SIZE = 15,         ///< The client tells its maximum message size
+    ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE = 16, ///< Reply with the maximum message size of the server
+    ASYNC_INITIALIZE = 17,                   ///< Async channel: attach to the session of the sync channel
+    ASYNC_INITIALIZE_RESPONSE = 18,          ///< Reply to ASYNC_INITIALIZE, carries the vendor id
+    ASYNC_DEVICE_CLEAR = 19,                 ///< Start a device clear
+    ASYNC_SERVICE_REQUEST = 20,              ///< The server signals SRQ
+    ASYNC_STATUS_QUERY = 21,                 ///< Read the status byte
+    ASYNC_STATUS_RESPONSE = 22,              ///< Reply to ASYNC_STATUS_QUERY, the control code is the status byte
+    ASYNC_DEVICE_CLEAR_ACKNOWLEDGE = 23,     ///< Reply to ASYNC_DEVICE_CLEAR
+    ASYNC_LOCK_INFO = 24,                    ///< Ask for the lock state
+    ASYNC_LOCK_INFO_RESPONSE = 25            ///< Reply to ASYNC_LOCK_INFO
+};
+
+/*!
+  @brief  Control codes of FATAL_ERROR.
+*/
+enum fatal_errors {
+    FATAL_UNIDENTIFIED = 0,        ///< Unidentified error
+    FATAL_BAD_HEADER = 1,          ///< Poorly formed message header
+    FATAL_NO_SESSION = 2,          ///< Attempt to use a connection without both channels established
+    FATAL_INVALID_INIT = 3,        ///< Invalid initialization sequence
+    FATAL_MAX_CLIENTS = 4          ///< Server refused the connection due to the maximum number of clients
+};
+
+/*!
+  @brief  Control codes of ERROR.
+*/
+enum errors {
+    ERROR_UNIDENTIFIED = 0,        ///< Unidentified error
+    ERROR_UNRECOGNIZED_TYPE = 1,   ///< Unrecognized message type
+    ERROR_UNRECOGNIZED_CONTROL = 2 ///< Unrecognized control code
+};
+
+/*!
+  @brief  Control codes of ASYNC_REMOTE_LOCAL_CONTROL.
+*/
+enum remote_local_codes {
+    RL_DISABLE_REMOTE = 0,         ///< Release REN
+    RL_ENABLE_REMOTE = 1,          ///< Assert REN
+    RL_DISABLE_REMOTE_GTL = 2,     ///< Release REN and go to local
+    RL_GTR = 3,                    ///< Go to remote
+    RL_GTR_LLO = 4,                ///< Go to remote and local lockout
+    RL_LLO = 5,                    ///< Local lockout
+    RL_GTL = 6                     ///< Go to local
+};
+
+/*!
+  @brief  Control codes of ASYNC_LOCK_RESPONSE.
+*/
+enum lock_responses {
+    LOCK_FAILURE = 0,              ///< The lock was not granted
+    LOCK_SUCCESS = 1,              ///< The lock was granted or released
+    LOCK_ERROR = 3                 ///< Release of a lock that was not held
+};
+
+}; // namespace hislip
+
+/*!
+  @brief  The 16 byte header of every HiSLIP message.
+*/
+struct hislip_message_header {
+    uint8_t prologue[2];               ///< Always 'H', 'S'
+    uint8_t message_type;              ///< See hislip::message_types
+    uint8_t control_code;              ///< Meaning depends on the message type
+    big_endian_32_t message_parameter; ///< Meaning depends on the message type, e.g. the message id
+    big_endian_32_t payload_length_h;  ///< Upper 32 bits of the payload length (always 0 for us)
+    big_endian_32_t payload_length;    ///< Lower 32 bits of the payload length
+};
+
+static_assert(sizeof(hislip_message_header) == 16, "hislip_message_header must be 16 bytes");
+
+#define HISLIP_MAX_DATA_SIZE (VXI_READ_SIZE - sizeof(hislip_message_header)) ///< Data per message, the buffer is shared with the VXI server
+
+/*!
+  @brief  Listens for and responds to HiSLIP requests.
+
+  A HiSLIP session uses 2 connections to the same port: the synchronous channel carries the data
+  and the trigger, the asynchronous channel carries the device clear, status, lock and remote/local
+  messages. Only the synchronized mode is supported: a response is read from the instrument after
+  a DATA_END message ending with a '?', or after every message for the addresses in HISLIP_READ_ALWAYS.
+*/
+class HiSLIP_Server
+{
+  public:
+    HiSLIP_Server(SCPI_handler_interface &scpi_handler);
+
+    void begin();
+    int loop();
+    int nr_connections(void);
+    void killClients(void);
+
+  protected:
+    void accept_pending(void);
+    void close_session(int slot);
+    void handle_sync(int slot);
+    void handle_async(int slot);
+    void send_response(int slot);
+    void check_srq(void);
+    int lock_holder(int slot);
+    bool read_header(EthernetClient &tcp, uint8_t &type, uint8_t &control, uint32_t &parameter, uint32_t &len);
+    void send_message(EthernetClient &tcp, uint8_t type, uint8_t control, uint32_t parameter, const uint8_t *payload = NULL, uint32_t len = 0);
+    void skip_payload(EthernetClient &tcp, uint32_t len);
+
+    EthernetServer server;
+    EthernetClient pending;                          ///< New connection, until its first message tells if it is a sync or async channel
+    unsigned long pending_since;                     ///< When the pending connection was accepted
+    EthernetClient sync_clients[MAX_HISLIP_SESSIONS];
+    EthernetClient async_clients[MAX_HISLIP_SESSIONS];
+    uint16_t session_ids[MAX_HISLIP_SESSIONS];
+    uint8_t addresses[MAX_HISLIP_SESSIONS];          ///< GPIB address of the session, 0 is the gateway (or the default instrument)
+    uint32_t message_ids[MAX_HISLIP_SESSIONS];       ///< Message id of the last DATA or DATA_END, to return with the response
+    char last_char[MAX_HISLIP_SESSIONS];             ///< Last character that is not white space of the message being received
+    bool locked[MAX_HISLIP_SESSIONS];                ///< The session holds a lock, see lock_holder()
+    uint16_t next_session_id;
+    bool srq_signalled;                              ///< ASYNC_SERVICE_REQUEST has been sent for the present SRQ
+    SCPI_handler_interface &scpi_handler;
+};
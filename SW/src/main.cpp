@@ -60,6 +60,18 @@
 #include "rpc_bind_server.h"
 #include "vxi_server.h"
 #endif
+#ifdef INTERFACE_HISLIP
+#include "hislip_server.h"
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+#include "scpi_socket_server.h"
+#endif
+#ifdef USE_MDNS
+#include "mdns_server.h"
+#endif
+#ifdef USE_METRICS
+#include "metrics.h"
+#endif
 // The following file is needed for the gpib setup, even if you do not use prologix. 
 // This is done there because the code is not trivial and maintenance is easier this way, as upstream code mixes gpib and prologix.
 #include "prologix_server.h"
@@ -91,8 +103,8 @@ class SCPI_handler : public SCPI_handler_interface {
     SCPI_handler() {}
 
     bool addressDevice(uint8_t address, uint8_t dir, const char* context = "") {
-        if (gpibBus.cfg.paddr != address) {
-            // if the address is different, we need to address the device
+        if (gpibBus.cfg.paddr != address || gpibBus.haveAddressedDevice() != dir) {
+            // if the address or direction is different, we need to address the device
             gpibBus.cfg.paddr = address;
             gpibBus.cfg.saddr = 0xFF;  // secondary address is not used
             if (!gpibBus.haveAddressedDevice() || !gpibBus.isDeviceAddressedToListen()) {
@@ -152,18 +164,24 @@ class SCPI_handler : public SCPI_handler_interface {
         }
 
         bool had_eoi = gpibBus.cfg.eoi;
-        bool had_eos = gpibBus.cfg.eos;
-        if (!is_end) {
-            // if this is not the end of the command, so do not send eoi
-            gpibBus.cfg.eoi = 0;
-            gpibBus.cfg.eos = 3;  // do not append EOI at end of the command
-        }
-        gpibBus.sendData(data, len, is_end);
-        if (!is_end) {
+        uint8_t had_eos = gpibBus.cfg.eos;
+        // sendData() takes at most 255 bytes per call, only the last block of the command gets EOI and the terminator
+        do {
+            uint8_t n = len > 255 ? 255 : len;
+            bool is_last = is_end && n == len;
+            if (!is_last) {
+                // if this is not the end of the command, so do not send eoi
+                gpibBus.cfg.eoi = 0;
+                gpibBus.cfg.eos = 3;  // do not append EOI at end of the command
+            }
+            gpibBus.sendData(data, n, is_last);
             // restore the original settings
             gpibBus.cfg.eoi = had_eoi;
             gpibBus.cfg.eos = had_eos;
-        } else {
+            data += n;
+            len -= n;
+        } while (len > 0);
+        if (is_end) {
             gpibBus.unAddressDevice();
             gpibBus.cfg.paddr = 0xFF;  // mark as unaddressed
         }
@@ -171,7 +189,7 @@ class SCPI_handler : public SCPI_handler_interface {
         return SRS_NONE;
     }
 
-    SCPI_handler_read_stop_reasons read(int address, vxiBufStream &dataStream, size_t max_size, uint32_t io_timeout = 1200) override {
+    SCPI_handler_read_stop_reasons read(int address, Stream &dataStream, size_t max_size, uint32_t io_timeout = 1200) override {
 #ifdef DUMMY_DEVICE
         // Simulate a device response
         uint8_t data[] = "SCPI response";
@@ -229,10 +247,11 @@ class SCPI_handler : public SCPI_handler_interface {
 #endif
     }
 
-    uint8_t read_stb(int address, uint32_t io_timeout = 1200) override {
+    SCPI_handler_read_stop_reasons read_stb(int address, uint8_t &stb, uint32_t io_timeout = 1200) override {
 #ifdef DUMMY_DEVICE
         debugPort.println(F("SCPI read STB"));
-        return 0xAA; // dummy status byte
+        stb = 0xAA; // dummy status byte
+        return SRS_NONE;
 #else
         set_timeout(io_timeout);
 
@@ -240,13 +259,107 @@ class SCPI_handler : public SCPI_handler_interface {
             // maybe we need to address a device directly on the bus
             address = gpibBus.cfg.caddr;
         }
-        if (address != 0) {
-            // if NOT controller, return error
-            return 0xff;
-        } else {
+        if (address == 0) {
             // return status for controller
-            return gpibBus.cfg.stat;
+            stb = gpibBus.cfg.stat;
+            return SRS_NONE;
+        }
+        if (gpibBus.serialPoll(address, &stb)) { // ERR = true on error
+#ifdef LOG_VXI_DETAILS
+            debugPort.print(F("SCPI Handler read_stb: Failed to serial poll device at GPIB address "));
+            debugPort.println(address);
+#endif
+            gpibBus.setControls(CIDS);  // set idle state hoping to recover
+            gpibBus.cfg.paddr = 0xFF;  // mark as unaddressed
+            return SRS_TIMEOUT;
+        }
+        // the device is left addressed to talk with ATN asserted, so the next poll only needs the SPE/SPD bytes
+        gpibBus.cfg.paddr = address;
+        gpibBus.cfg.saddr = 0xFF;
+        return SRS_NONE;
+#endif
+    }
+
+    SCPI_handler_read_stop_reasons trigger(int address, uint32_t io_timeout = 1200) override {
+#ifdef DUMMY_DEVICE
+        debugPort.println(F("SCPI trigger"));
+        return SRS_NONE;
+#else
+        set_timeout(io_timeout);
+
+        if (address == 0) {
+            // maybe we need to address a device directly on the bus
+            address = gpibBus.cfg.caddr;
+        }
+        if (address != 0) {
+            // see trg_h(), but keep the device addressed to listen for the next write
+            if (!addressDevice(address, TOLISTEN, "trigger")) {
+                return SRS_TIMEOUT;
+            }
+        }
+        // on the interface link, GET goes to the devices that are currently addressed to listen
+        if (gpibBus.sendCmd(GC_GET)) {
+            gpibBus.setControls(CIDS);
+            return SRS_TIMEOUT;
+        }
+        // Set GPIB controls back to idle state
+        gpibBus.setControls(CIDS);
+        return SRS_NONE;
+#endif
+    }
+
+    SCPI_handler_read_stop_reasons remote(int address, uint32_t io_timeout = 1200) override {
+#ifdef DUMMY_DEVICE
+        debugPort.println(F("SCPI remote"));
+        return SRS_NONE;
+#else
+        set_timeout(io_timeout);
+
+        if (address == 0) {
+            // maybe we need to address a device directly on the bus
+            address = gpibBus.cfg.caddr;
+        }
+        // a device goes to remote when it is addressed to listen while REN is asserted
+        if (!gpibBus.isAsserted(REN_PIN)) {
+            gpibBus.assertSignal(REN_BIT);
+        }
+        if (address != 0) {
+            if (!addressDevice(address, TOLISTEN, "remote")) {
+                return SRS_TIMEOUT;
+            }
+            gpibBus.setControls(CIDS);
+        }
+        return SRS_NONE;
+#endif
+    }
+
+    SCPI_handler_read_stop_reasons local(int address, uint32_t io_timeout = 1200) override {
+#ifdef DUMMY_DEVICE
+        debugPort.println(F("SCPI local"));
+        return SRS_NONE;
+#else
+        set_timeout(io_timeout);
+
+        if (address == 0) {
+            // maybe we need to address a device directly on the bus
+            address = gpibBus.cfg.caddr;
+        }
+        if (address == 0) {
+            // on the interface link, releasing REN returns all devices to local
+            gpibBus.clearSignal(REN_BIT);
+            return SRS_NONE;
+        }
+        // see loc_h(), but keep the device addressed to listen for the next write
+        if (!addressDevice(address, TOLISTEN, "local")) {
+            return SRS_TIMEOUT;
+        }
+        if (gpibBus.sendCmd(GC_GTL)) {
+            gpibBus.setControls(CIDS);
+            return SRS_TIMEOUT;
         }
+        // Set GPIB controls back to idle state
+        gpibBus.setControls(CIDS);
+        return SRS_NONE;
 #endif
     }
 
@@ -301,6 +414,108 @@ class SCPI_handler : public SCPI_handler_interface {
 #endif
     }
 
+    SCPI_handler_read_stop_reasons send_command(const uint8_t *data, size_t len, uint32_t io_timeout = 1200) override {
+#ifdef DUMMY_DEVICE
+        debugPort.print(F("SCPI send command: "));
+        printHexArray((uint8_t *)data, len);
+        return SRS_NONE;
+#else
+        set_timeout(io_timeout);
+
+        SCPI_handler_read_stop_reasons rv = SRS_NONE;
+        for (size_t i = 0; i < len; i++) {
+            if (gpibBus.sendCmd(data[i])) { // ERR = true on error
+                rv = SRS_TIMEOUT;
+                break;
+            }
+        }
+        // I do not know what the commands addressed, so the next read or write must address again
+        gpibBus.cfg.paddr = 0xFF;  // mark as unaddressed
+        // release ATN, so the bus is not blocked for the other links
+        gpibBus.setControls(CIDS);
+        return rv;
+#endif
+    }
+
+    int bus_status(SCPI_handler_bus_status what) override {
+#ifdef DUMMY_DEVICE
+        debugPort.println(F("SCPI bus status"));
+        return 0;
+#else
+        switch (what) {
+            case BS_REMOTE:
+                return gpibBus.isAsserted(REN_PIN) ? 1 : 0;
+            case BS_SRQ:
+                return gpibBus.isAsserted(SRQ_PIN) ? 1 : 0;
+            case BS_NDAC:
+                return gpibBus.isAsserted(NDAC_PIN) ? 1 : 0;
+            case BS_SYSTEM_CONTROLLER:
+            case BS_CONTROLLER_IN_CHARGE:
+                return gpibBus.isController() ? 1 : 0;
+            case BS_TALKER:
+                return (gpibBus.cstate == CTAS) ? 1 : 0;
+            case BS_LISTENER:
+                return (gpibBus.cstate == CLAS) ? 1 : 0;
+            case BS_BUS_ADDRESS:
+                return 0;  // the gateway is always at address 0, cfg.caddr is the default instrument
+            default:
+                return -1;
+        }
+#endif
+    }
+
+    SCPI_handler_read_stop_reasons bus_control(SCPI_handler_bus_control what, uint32_t value, uint32_t io_timeout = 1200) override {
+#ifdef DUMMY_DEVICE
+        debugPort.print(F("SCPI bus control "));
+        debugPort.print((int)what);
+        debugPort.print(F(": "));
+        debugPort.println(value);
+        return SRS_NONE;
+#else
+        set_timeout(io_timeout);
+
+        switch (what) {
+            case BC_ATN:
+                if (value) {
+                    gpibBus.assertSignal(ATN_BIT);
+                } else {
+                    gpibBus.clearSignal(ATN_BIT);
+                }
+                break;
+            case BC_REN:
+                if (value) {
+                    gpibBus.assertSignal(REN_BIT);
+                } else {
+                    gpibBus.clearSignal(REN_BIT);
+                }
+                break;
+            case BC_IFC:
+                gpibBus.sendIFC();
+                gpibBus.setControls(CIDS);
+                break;
+            case BC_PASS_CONTROL:
+                // see tct_h()
+                if (gpibBus.sendTCT(value)) {
+                    gpibBus.setControls(CIDS);
+                    gpibBus.cfg.paddr = 0xFF;  // mark as unaddressed
+                    return SRS_TIMEOUT;
+                }
+                gpibBus.startDeviceMode();
+                break;
+            case BC_BUS_ADDRESS:
+                // the gateway is always at address 0, cfg.caddr is the default instrument
+                if (value != 0) {
+                    return SRS_ERROR;
+                }
+                break;
+            default:
+                return SRS_ERROR;
+        }
+        gpibBus.cfg.paddr = 0xFF;  // mark as unaddressed
+        return SRS_NONE;
+#endif
+    }
+
     bool claim_control() override {
         // not needed for the GPIB bus, is done differently
         return true;
@@ -318,6 +533,15 @@ class SCPI_handler : public SCPI_handler_interface {
 static SCPI_handler scpi_handler;                    ///< The bridge from the vxi server to the SCPI command handler
 VXI_Server vxi_server(scpi_handler);          ///< The vxi server
 RPC_Bind_Server rpc_bind_server(vxi_server);  ///< The RPC_Bind_Server for the vxi server
+#ifdef INTERFACE_HISLIP
+HiSLIP_Server hislip_server(scpi_handler);    ///< The HiSLIP server, on the same SCPI handler as the vxi server
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+SCPI_Socket_Server scpi_socket_server(scpi_handler);  ///< The raw SCPI socket server, on the same SCPI handler as the vxi server
+#endif
+#ifdef USE_MDNS
+MDNS_Server mdns_server;                      ///< Publishes the servers via mDNS
+#endif
 
 #pragma endregion
 
@@ -333,6 +557,10 @@ RPC_Bind_Server rpc_bind_server(vxi_server);  ///< The RPC_Bind_Server for the v
  * It also sets up the EEPROM and GPIB bus configuration. The function tries to wait for DHCP to assign an IP address.
  */
 void setup() {
+#ifdef USE_METRICS
+    // first, so the stack has not been used yet
+    metrics.begin();
+#endif
     setup_serial_ui_and_led(F(DEVICE_NAME));
 
     // Disable the watchdog (needed to prevent WDT reset loop)
@@ -384,15 +612,26 @@ void setup() {
     setup_ipaddress_surveillance_and_show_address();
     // for now, just ignore if we have a good address via FHCP
 
-    // This would be the place to add mdns, but none of the main mdns libraries support the present ethernet library
 #ifdef INTERFACE_VXI11
-    debugPort.println(F("Starting VXI-11 TCP RPC server on port " STR(VXI11_PORT) "..."));
-    vxi_server.begin(VXI11_PORT);
+    debugPort.println(F("Starting VXI-11 TCP RPC server on ports " STR(VXI11_PORT_START) "-" STR(VXI11_PORT_END) "..."));
+    vxi_server.begin(VXI11_PORT_START, VXI11_PORT_END);
 
     debugPort.println(F("Starting VXI-11 port mappers on TCP and UDP on port 111..."));
     rpc_bind_server.begin();
     debugPort.println(F("VXI-11 servers started"));
 #endif
+#ifdef INTERFACE_HISLIP
+    debugPort.println(F("Starting HiSLIP server on port " STR(HISLIP_PORT) "..."));
+    hislip_server.begin();
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+    debugPort.println(F("Starting SCPI socket server from port " STR(SCPI_SOCKET_PORT) "..."));
+    scpi_socket_server.begin();
+#endif
+#ifdef USE_MDNS
+    debugPort.println(F("Starting mDNS responder..."));
+    mdns_server.begin(macAddress);
+#endif
 
 
 #ifdef INTERFACE_PROLOGIX
@@ -412,10 +651,24 @@ void setup() {
 void loop() {
     int nr_connections = 0;
 
+#ifdef USE_METRICS
+    metrics.loopStart();
+#endif
+
 #ifdef INTERFACE_VXI11
     rpc_bind_server.loop();
     nr_connections += vxi_server.loop();
 #endif
+#ifdef INTERFACE_HISLIP
+    // the servers take turns, so they never use the GPIB bus at the same time
+    nr_connections += hislip_server.loop();
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+    nr_connections += scpi_socket_server.loop();
+#endif
+#ifdef USE_MDNS
+    mdns_server.loop();
+#endif
 #ifdef INTERFACE_PROLOGIX    
     nr_connections += loop_prologix();
 #endif
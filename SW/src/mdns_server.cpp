@@ -0,0 +1,355 @@
+/*!
+  @file   mdns_server.cpp
+  @brief  Definition of the MDNS_Server class.
+
+  None of the usual mDNS libraries support the Ethernet library of this board, so this is a
+  minimal responder: it does not probe for conflicts, and it answers every question about
+  its host name or its services with the same complete answer.
+
+  Test it with test_tools/testMDNS.py, or with e.g. "avahi-browse -rt _vxi-11._tcp".
+*/
+
+#include "mdns_server.h"
+#include "rpc_enums.h"
+
+// The response template.
+//
+// Byte 0xFF is not used anywhere else in the template, it marks the MAC digits in the names.
+// Byte 0xFE is not used anywhere else either, it marks the TTLs (their first byte is always 0).
+// Byte 0xC0 only starts a pointer, and byte 0x80 only sets the cache-flush bit of a class.
+// The IP address of the A record is at a fixed offset, as the A record comes first.
+// The other names point to the host name ("\xc0\x0c") or to its "local" label ("\xc0\x1f"),
+// both at fixed offsets as well, unless a question is echoed in front of them.
+
+#define MDNS_ID "\xff\xff\xff\xff"                          // replaced by the last 2 bytes of the MAC address in hex
+#define MDNS_TTL_SHARED "\xfe\x00\x11\x94"                  // 4500 s for the PTR records
+#define MDNS_TTL_UNIQUE "\xfe\x00\x00\x78"                  // 120 s for the records of this host only
+#define MDNS_HEADER "\x00\x00" "\x84\x00" "\x00\x00" "\x00\x00" "\x00\x00" "\x00\x00"  // id, response + authoritative, counts (ANCOUNT is filled in)
+#define MDNS_HOST_NAME "\x12" MDNS_HOST_PREFIX MDNS_ID "\x05" "local" "\x00"  // at offset 12
+#define MDNS_HOST "\xc0\x0c"                                // pointer to the host name
+#define MDNS_LOCAL "\xc0\x1f"                               // pointer to "local"
+#define MDNS_INSTANCE "\x12" "Ethernet2GPIB-" MDNS_ID       // the instance name of every service
+
+// A record, the IP address is filled in
+#define MDNS_A_RECORD MDNS_HOST_NAME "\x00\x01" "\x80\x01" MDNS_TTL_UNIQUE "\x00\x04" "\x00\x00\x00\x00"
+
+// DNS-SD enumeration PTR, PTR, SRV and TXT records of a service:
+// type: the service label with its length, enum_size and ptr_size: the size of the PTR rdatas, port: big endian
+#define MDNS_SERVICE(type, enum_size, ptr_size, port) \
+    "\x09" "_services" "\x07" "_dns-sd" "\x04" "_udp" MDNS_LOCAL "\x00\x0c" "\x00\x01" MDNS_TTL_SHARED "\x00" enum_size \
+        type "\x04" "_tcp" MDNS_LOCAL \
+    type "\x04" "_tcp" MDNS_LOCAL "\x00\x0c" "\x00\x01" MDNS_TTL_SHARED "\x00" ptr_size \
+        MDNS_INSTANCE type "\x04" "_tcp" MDNS_LOCAL \
+    MDNS_INSTANCE type "\x04" "_tcp" MDNS_LOCAL "\x00\x21" "\x80\x01" MDNS_TTL_UNIQUE "\x00\x08" \
+        "\x00\x00" "\x00\x00" port MDNS_HOST \
+    MDNS_INSTANCE type "\x04" "_tcp" MDNS_LOCAL "\x00\x10" "\x80\x01" MDNS_TTL_UNIQUE "\x00\x0a" \
+        "\x09" "txtvers=1"
+
+#define MDNS_VXI11 "\x07" "_vxi-11"
+#define MDNS_LXI "\x04" "_lxi"
+#define MDNS_SCPI_RAW "\x09" "_scpi-raw"
+#define MDNS_HISLIP "\x07" "_hislip"
+
+static_assert(sizeof(MDNS_VXI11 "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x0f, "wrong enumeration PTR size for _vxi-11");
+static_assert(sizeof(MDNS_INSTANCE MDNS_VXI11 "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x22, "wrong PTR size for _vxi-11");
+static_assert(rpc::BIND_PORT == 111, "update the port of the _vxi-11 SRV record");
+#define MDNS_SERVICE_VXI11 MDNS_SERVICE(MDNS_VXI11, "\x0f", "\x22", "\x00\x6f")
+
+#ifdef USE_WEBSERVER
+static_assert(sizeof(MDNS_LXI "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x0c, "wrong enumeration PTR size for _lxi");
+static_assert(sizeof(MDNS_INSTANCE MDNS_LXI "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x1f, "wrong PTR size for _lxi");
+#define MDNS_SERVICE_LXI MDNS_SERVICE(MDNS_LXI, "\x0c", "\x1f", "\x00\x50")
+#define MDNS_NR_LXI 1
+#else
+#define MDNS_SERVICE_LXI
+#define MDNS_NR_LXI 0
+#endif
+
+#ifdef INTERFACE_SCPI_SOCKET
+static_assert(sizeof(MDNS_SCPI_RAW "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x11, "wrong enumeration PTR size for _scpi-raw");
+static_assert(sizeof(MDNS_INSTANCE MDNS_SCPI_RAW "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x24, "wrong PTR size for _scpi-raw");
+static_assert(SCPI_SOCKET_PORT == 5025, "update the port of the _scpi-raw SRV record");
+#define MDNS_SERVICE_SCPI_RAW MDNS_SERVICE(MDNS_SCPI_RAW, "\x11", "\x24", "\x13\xa1")
+#define MDNS_NR_SCPI_RAW 1
+#else
+#define MDNS_SERVICE_SCPI_RAW
+#define MDNS_NR_SCPI_RAW 0
+#endif
+
+#ifdef INTERFACE_HISLIP
+static_assert(sizeof(MDNS_HISLIP "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x0f, "wrong enumeration PTR size for _hislip");
+static_assert(sizeof(MDNS_INSTANCE MDNS_HISLIP "\x04" "_tcp" MDNS_LOCAL) - 1 == 0x22, "wrong PTR size for _hislip");
+static_assert(HISLIP_PORT == 4880, "update the port of the _hislip SRV record");
+#define MDNS_SERVICE_HISLIP MDNS_SERVICE(MDNS_HISLIP, "\x0f", "\x22", "\x13\x10")
+#define MDNS_NR_HISLIP 1
+#else
+#define MDNS_SERVICE_HISLIP
+#define MDNS_NR_HISLIP 0
+#endif
+
+#define MDNS_NR_ANSWERS (1 + 4 * (1 + MDNS_NR_LXI + MDNS_NR_SCPI_RAW + MDNS_NR_HISLIP))
+#define MDNS_IP_OFFSET (sizeof(MDNS_HEADER MDNS_HOST_NAME "\x00\x01" "\x80\x01" MDNS_TTL_UNIQUE "\x00\x04") - 1)
+#define MDNS_QDCOUNT_OFFSET 5
+#define MDNS_ANCOUNT_OFFSET 7
+#define MDNS_ID_MARK 0xFF
+#define MDNS_TTL_MARK 0xFE
+#define MDNS_POINTER 0xC0
+#define MDNS_CACHE_FLUSH 0x80
+#define MDNS_LEGACY_TTL 10                 // RFC 6762 section 6.7: at most 10 s in legacy unicast responses
+
+static_assert(sizeof(MDNS_HEADER) - 1 == 12, "wrong mDNS header size");
+static_assert(sizeof(MDNS_HEADER "\x12" MDNS_HOST_PREFIX MDNS_ID) - 1 == 0x1f, "the pointer to \"local\" is wrong");
+
+static const uint8_t mdns_response[] PROGMEM =
+    MDNS_HEADER MDNS_A_RECORD MDNS_SERVICE_VXI11 MDNS_SERVICE_LXI MDNS_SERVICE_SCPI_RAW MDNS_SERVICE_HISLIP;
+
+// The names we answer for, next to the host name: the service types, and so their instances, and the DNS-SD enumeration.
+static const char mdns_names[] PROGMEM =
+    "_services._dns-sd._udp.local\0"
+    "_vxi-11._tcp.local\0"
+#ifdef USE_WEBSERVER
+    "_lxi._tcp.local\0"
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+    "_scpi-raw._tcp.local\0"
+#endif
+#ifdef INTERFACE_HISLIP
+    "_hislip._tcp.local\0"
+#endif
+    ;
+
+/**
+ * @brief Join the mDNS multicast group and announce the services.
+ *
+ * @param mac the MAC address, its last 2 bytes make the names unique
+ */
+void MDNS_Server::begin(const uint8_t *mac)
+{
+    static const char hex[] = "0123456789abcdef";
+    id[0] = hex[mac[4] >> 4];
+    id[1] = hex[mac[4] & 0x0F];
+    id[2] = hex[mac[5] >> 4];
+    id[3] = hex[mac[5] & 0x0F];
+    id[4] = 0;
+    strcpy_P(hostname, PSTR(MDNS_HOST_PREFIX));
+    strcat(hostname, id);
+    strcat_P(hostname, PSTR(".local"));
+
+    udp.beginMulticast(IPAddress(224, 0, 0, 251), MDNS_PORT);
+    announce();
+}
+
+/**
+ * @brief Send the records unsolicited, e.g. at startup or when the IP address changed.
+ */
+void MDNS_Server::announce(void)
+{
+    send_response(IPAddress(224, 0, 0, 251), MDNS_PORT, 0);
+}
+
+/**
+ * @brief Call this at least once per main loop to answer the queries.
+ *
+ * Queries from port 5353 are answered on the multicast group. Queries from any other port come
+ * from a simple resolver (legacy unicast, RFC 6762 section 6.7), and are answered directly,
+ * with the id and the matching question of the query.
+ */
+void MDNS_Server::loop()
+{
+    if (udp.parsePacket() <= 0) {
+        return;
+    }
+    uint8_t packet[MDNS_MAX_QUERY_SIZE];
+    int len = udp.read(packet, sizeof(packet));
+    if (len < 12 || (packet[2] & 0x80)) {
+        // too short, or a response of another host
+        return;
+    }
+    int nr_questions = (packet[4] << 8) | packet[5];
+    int pos = 12;
+    char name[MDNS_MAX_NAME_SIZE];
+    bool match = false;
+    for (int i = 0; i < nr_questions && !match; i++) {
+        pos = read_name(packet, len, pos, name, sizeof(name));
+        if (pos == 0 || pos + 4 > len) {
+            break;
+        }
+        pos += 4;  // type and class: we always give all records
+        match = is_ours(name);
+    }
+    if (!match) {
+        return;
+    }
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("mDNS query for "));
+    debugPort.print(name);
+    debugPort.print(F(" from "));
+    debugPort.println(udp.remoteIP());
+#endif
+    if (udp.remotePort() == MDNS_PORT) {
+        announce();
+    } else {
+        // echo the question uncompressed, its pointers would point into the query
+        uint8_t question[MDNS_MAX_NAME_SIZE + 5];
+        uint8_t size = write_name(name, question);
+        memcpy(question + size, packet + pos - 4, 4);
+        question[size + 2] &= 0x7F;  // clear the unicast-response bit of the class
+        send_response(udp.remoteIP(), udp.remotePort(), (packet[0] << 8) | packet[1], question, size + 4);
+    }
+}
+
+/**
+ * @brief Check if a name is the host name, a service type, a service instance or the DNS-SD enumeration.
+ *
+ * @param name the name in lower case with dots, as read by read_name()
+ * @return true if we have records for it
+ */
+bool MDNS_Server::is_ours(const char *name)
+{
+    if (strcmp(name, hostname) == 0) {
+        return true;
+    }
+    size_t len = strlen(name);
+    for (const char *suffix = mdns_names; pgm_read_byte(suffix); suffix += strlen_P(suffix) + 1) {
+        size_t suffix_len = strlen_P(suffix);
+        if (len >= suffix_len && strcmp_P(name + len - suffix_len, suffix) == 0 &&
+            (len == suffix_len || name[len - suffix_len - 1] == '.')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read a name of a DNS packet as dotted, lower case text.
+ *
+ * @param packet the DNS packet
+ * @param len the size of the packet
+ * @param pos the offset of the name in the packet
+ * @param name receives the name
+ * @param size the size of name
+ * @return the offset after the name, or 0 if it is malformed or too long
+ */
+int MDNS_Server::read_name(const uint8_t *packet, int len, int pos, char *name, int size)
+{
+    int next = 0;   // offset after the name, once a pointer was followed
+    int n = 0;
+    int jumps = 0;
+    while (pos < len) {
+        uint8_t label = packet[pos];
+        if (label == 0) {
+            name[n] = 0;
+            return next ? next : pos + 1;
+        }
+        if ((label & 0xC0) == 0xC0) {
+            if (pos + 1 >= len || ++jumps > 4) {
+                return 0;
+            }
+            if (!next) {
+                next = pos + 2;
+            }
+            pos = ((label & 0x3F) << 8) | packet[pos + 1];
+            continue;
+        }
+        if ((label & 0xC0) || pos + 1 + label > len || n + label + 1 >= size) {
+            return 0;
+        }
+        if (n) {
+            name[n++] = '.';
+        }
+        for (int i = 1; i <= label; i++) {
+            name[n++] = tolower(packet[pos + i]);
+        }
+        pos += label + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write a name as read by read_name() as DNS labels, without compression.
+ *
+ * @param name the dotted name, at most MDNS_MAX_NAME_SIZE - 1 characters
+ * @param out receives the labels, MDNS_MAX_NAME_SIZE + 1 bytes at most
+ * @return the number of bytes written
+ */
+uint8_t MDNS_Server::write_name(const char *name, uint8_t *out)
+{
+    uint8_t n = 0;
+    while (*name) {
+        const char *dot = strchr(name, '.');
+        uint8_t label = dot ? dot - name : strlen(name);
+        out[n++] = label;
+        memcpy(out + n, name, label);
+        n += label;
+        name += dot ? label + 1 : label;
+    }
+    out[n++] = 0;
+    return n;
+}
+
+/**
+ * @brief Send the response template with the MAC digits, the IP address and the id filled in.
+ *
+ * @param ip destination address
+ * @param port destination port
+ * @param query_id id of the query, 0 for multicast responses
+ * @param question question to echo in a legacy unicast response, NULL for multicast responses.
+ *        A legacy unicast response also has no cache-flush bits and TTLs of MDNS_LEGACY_TTL.
+ * @param question_size size of question
+ */
+void MDNS_Server::send_response(IPAddress ip, uint16_t port, uint16_t query_id, const uint8_t *question,
+                                uint8_t question_size)
+{
+    IPAddress local_ip = Ethernet.localIP();
+    uint8_t block[32];
+    uint8_t n = 0;
+    uint8_t digit = 0;
+    uint8_t ttl = 0;        // bytes of a TTL still to replace
+    bool pointer = false;   // the previous byte started a pointer
+
+    udp.beginPacket(ip, port);
+    for (size_t i = 0; i < sizeof(mdns_response) - 1; i++) {
+        uint8_t b = pgm_read_byte(&mdns_response[i]);
+        if (i < 2) {
+            b = (i == 0) ? (query_id >> 8) : (query_id & 0xFF);
+        } else if (i == MDNS_QDCOUNT_OFFSET) {
+            b = question ? 1 : 0;
+        } else if (i == MDNS_ANCOUNT_OFFSET) {
+            b = MDNS_NR_ANSWERS;
+        } else if (i >= MDNS_IP_OFFSET && i < MDNS_IP_OFFSET + 4) {
+            b = local_ip[i - MDNS_IP_OFFSET];
+        } else if (b == MDNS_ID_MARK) {
+            b = id[digit];
+            digit = (digit + 1) & 3;
+        } else if (pointer) {
+            b += question_size;  // the names moved behind the question
+            pointer = false;
+        } else if (b == MDNS_POINTER) {
+            pointer = true;
+        } else if (b == MDNS_TTL_MARK) {
+            ttl = 4;
+        } else if (b == MDNS_CACHE_FLUSH && question) {
+            b = 0;
+        }
+        if (ttl) {
+            ttl--;
+            if (question) {
+                b = ttl ? 0 : MDNS_LEGACY_TTL;
+            } else if (ttl == 3) {
+                b = 0;  // the mark
+            }
+        }
+        block[n++] = b;
+        if (n == sizeof(block) || (i == sizeof(MDNS_HEADER) - 2 && question)) {
+            udp.write(block, n);
+            n = 0;
+            if (i == sizeof(MDNS_HEADER) - 2) {
+                udp.write(question, question_size);
+            }
+        }
+    }
+    if (n) {
+        udp.write(block, n);
+    }
+    udp.endPacket();
+}
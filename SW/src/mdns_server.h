@@ -0,0 +1,45 @@
+#pragma once
+
+/*!
+  @file   mdns_server.h
+  @brief  Declares the MDNS_Server class, a minimal mDNS/DNS-SD responder for the VXI-11 server.
+*/
+
+#include "utilities.h"
+#include <Ethernet.h>
+#include "config.h"
+
+#define MDNS_PORT 5353                     ///< mDNS port
+#define MDNS_MAX_QUERY_SIZE 128            ///< Longer queries are truncated, the questions that do not fit are ignored
+#define MDNS_MAX_NAME_SIZE 64              ///< Longer names in a question never match
+#define MDNS_HOST_PREFIX "ethernet2gpib-"  ///< The host name is this prefix followed by the last 2 bytes of the MAC address in hex
+
+/*!
+  @brief  Answers mDNS queries for the host name and the services of the adapter.
+
+  The adapter is published as MDNS_HOST_PREFIX "XXXX.local" with one instance
+  "Ethernet2GPIB-XXXX" of every service it offers (_vxi-11, _lxi, _scpi-raw, _hislip),
+  XXXX being the last 2 bytes of the MAC address.
+
+  The answer is always the same: the A record of the host followed by the DNS-SD enumeration,
+  PTR, SRV and TXT records of every service. It is kept as a precomputed template in PROGMEM, only the
+  MAC digits and the IP address are filled in while sending it.
+*/
+class MDNS_Server
+{
+  public:
+    void begin(const uint8_t *mac);
+    void loop();
+    void announce(void);
+
+  protected:
+    void send_response(IPAddress ip, uint16_t port, uint16_t query_id, const uint8_t *question = NULL,
+                       uint8_t question_size = 0);
+    bool is_ours(const char *name);
+    static int read_name(const uint8_t *packet, int len, int pos, char *name, int size);
+    static uint8_t write_name(const char *name, uint8_t *out);
+
+    EthernetUDP udp;                                          ///< Multicast socket on 224.0.0.251:5353
+    char id[5];                                               ///< Last 2 bytes of the MAC address in hex
+    char hostname[sizeof(MDNS_HOST_PREFIX) + 4 + 6];          ///< Host name, e.g. "ethernet2gpib-1a2b.local"
+};
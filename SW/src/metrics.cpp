@@ -0,0 +1,324 @@
+#include "config.h"
+
+#ifdef USE_METRICS
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <Ethernet.h>
+#include <utility/w5100.h>
+#include "metrics.h"
+
+Metrics metrics;
+
+// Label of every counter in Metrics::rpcs, NULL if the procedure does not exist
+static const char rpc10[] PROGMEM = "create_link";
+static const char rpc11[] PROGMEM = "device_write";
+static const char rpc12[] PROGMEM = "device_read";
+static const char rpc13[] PROGMEM = "device_readstb";
+static const char rpc14[] PROGMEM = "device_trigger";
+static const char rpc15[] PROGMEM = "device_clear";
+static const char rpc16[] PROGMEM = "device_remote";
+static const char rpc17[] PROGMEM = "device_local";
+static const char rpc18[] PROGMEM = "device_lock";
+static const char rpc19[] PROGMEM = "device_unlock";
+static const char rpc22[] PROGMEM = "device_docmd";
+static const char rpc23[] PROGMEM = "destroy_link";
+static const char rpc25[] PROGMEM = "create_intr_chan";
+static const char *const rpcNames[METRICS_NR_RPCS] PROGMEM = {
+    rpc10, rpc11, rpc12, rpc13, rpc14, rpc15, rpc16, rpc17, rpc18, rpc19, NULL, NULL, rpc22, rpc23, NULL, rpc25
+};
+
+// Label of every counter in Metrics::readStates, in the order of receiveState
+static const char read0[] PROGMEM = "none";
+static const char read1[] PROGMEM = "break";
+static const char read2[] PROGMEM = "atn";
+static const char read3[] PROGMEM = "ifc";
+static const char read4[] PROGMEM = "eoi";
+static const char read5[] PROGMEM = "endchar";
+static const char read6[] PROGMEM = "endl";
+static const char read7[] PROGMEM = "limit";
+static const char read8[] PROGMEM = "error";
+static const char *const readNames[METRICS_NR_READ_STATES] PROGMEM = {
+    read0, read1, read2, read3, read4, read5, read6, read7, read8
+};
+
+/*!
+  @brief  Writes metric families in the Prometheus text format, or as one JSON object.
+
+  In JSON, every family is a member named after the metric: a number, or an object
+  with a member per label value.
+*/
+class MetricsWriter
+{
+  public:
+    MetricsWriter(Print &p, bool json) : p(p), json(json) {}
+
+    /*!
+      @brief  Start a metric family.
+
+      @param  name     The name of the metric
+      @param  counter  Counter, or gauge
+      @param  label    The name of the label, NULL if the metric has no labels
+    */
+    void family(const __FlashStringHelper *name, bool counter, const __FlashStringHelper *label = NULL) {
+        endFamily();
+        this->name = name;
+        this->label = label;
+        first = true;
+        if (json) {
+            p.print(started ? F(",\"") : F("{\""));
+            p.print(name);
+            p.print(label ? F("\":{") : F("\":"));
+        } else {
+            p.print(F("# TYPE "));
+            p.print(name);
+            p.print(counter ? F(" counter\n") : F(" gauge\n"));
+        }
+        started = true;
+    }
+
+    /*!
+      @brief  Write the value of a metric without labels.
+    */
+    void value(uint32_t v) {
+        if (!json) {
+            p.print(name);
+            p.print(' ');
+        }
+        p.print(v);
+        if (!json) {
+            p.print('\n');
+        }
+    }
+
+    /*!
+      @brief  Write a value of the family, with a label from PROGMEM.
+    */
+    void value(const __FlashStringHelper *labelValue, uint32_t v) {
+        startLabel();
+        p.print(labelValue);
+        endLabel(v);
+    }
+
+    /*!
+      @brief  Write a value of the family, with a number as label.
+    */
+    void value(uint8_t labelValue, uint32_t v) {
+        startLabel();
+        p.print(labelValue);
+        endLabel(v);
+    }
+
+    /*!
+      @brief  End the output.
+    */
+    void end(void) {
+        endFamily();
+        if (json) {
+            p.print(started ? F("}") : F("{}"));
+        }
+    }
+
+  private:
+    void startLabel(void) {
+        if (json) {
+            p.print(first ? F("\"") : F(",\""));
+        } else {
+            p.print(name);
+            p.print('{');
+            p.print(label);
+            p.print(F("=\""));
+        }
+        first = false;
+    }
+
+    void endLabel(uint32_t v) {
+        p.print(json ? F("\":") : F("\"} "));
+        p.print(v);
+        if (!json) {
+            p.print('\n');
+        }
+    }
+
+    void endFamily(void) {
+        if (json && started && label) {
+            p.print('}');
+        }
+        label = NULL;
+    }
+
+    Print &p;
+    bool json;
+    bool started = false;                       ///< A family was written
+    bool first = true;                          ///< No value of the current family was written yet
+    const __FlashStringHelper *name = NULL;
+    const __FlashStringHelper *label = NULL;
+};
+
+/*!
+  @brief  Initialize the counters, and fill the free RAM with METRICS_PAINT.
+
+  To be called first in setup(): the stack never went deeper yet, so all RAM between
+  the heap and the stack is still free. Every byte the stack ever uses overwrites the paint.
+*/
+void Metrics::begin(void)
+{
+    extern int __heap_start, *__brkval;
+    uint8_t here;
+    uint8_t *p = __brkval == 0 ? (uint8_t *)&__heap_start : (uint8_t *)__brkval;
+    uint8_t *end = &here - 64;  // leave the frame of this function and of its caller alone
+
+    while (p < end) {
+        *p++ = METRICS_PAINT;
+    }
+    memset(addresses, METRICS_NO_ADDRESS, sizeof(addresses));
+}
+
+/*!
+  @brief  Measure the time of the previous pass of the main loop. To be called at the start of loop().
+*/
+void Metrics::loopStart(void)
+{
+    unsigned long now = micros();
+    if (loops > 0 && now - lastLoop > loopMax) {
+        loopMax = now - lastLoop;
+    }
+    lastLoop = now;
+    loops++;
+}
+
+/*!
+  @brief  Count the bytes moved on the GPIB bus.
+
+  @param  address  The primary address of the instrument, addresses above 30 are counted as "other"
+  @param  in       Bytes read from the instrument
+  @param  out      Bytes written to the instrument
+*/
+void Metrics::countBytes(uint8_t address, size_t in, size_t out)
+{
+    uint8_t i = 0;
+    if (address > 30) {
+        i = METRICS_ADDRESSES;
+    }
+    for (; i < METRICS_ADDRESSES; i++) {
+        if (addresses[i] == address) {
+            break;
+        }
+        if (addresses[i] == METRICS_NO_ADDRESS) {
+            addresses[i] = address;
+            break;
+        }
+    }
+    bytesIn[i] += in;
+    bytesOut[i] += out;
+}
+
+/*!
+  @brief  Count the bytes of a read, and how it ended.
+
+  @param  address  The primary address of the instrument
+  @param  in       Bytes read
+  @param  state    Why the read stopped, RECEIVE_INIT if it goes on
+*/
+void Metrics::countRead(uint8_t address, size_t in, enum receiveState state)
+{
+    if (in > 0) {
+        countBytes(address, in, 0);
+    }
+    if (state != RECEIVE_INIT && state < METRICS_NR_READ_STATES) {
+        readStates[state]++;
+    }
+}
+
+/*!
+  @brief  Read the gauges: the sockets of the W5500 and the low-water mark of the free RAM.
+*/
+void Metrics::snapshot(void)
+{
+    socketsListen = 0;
+    socketsConnected = 0;
+    socketsClosing = 0;
+    SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+        uint8_t status = W5100.readSnSR(s);
+        if (status == SnSR::LISTEN) {
+            socketsListen++;
+        } else if (status == SnSR::ESTABLISHED || status == SnSR::UDP) {
+            socketsConnected++;
+        } else if (status != SnSR::CLOSED) {
+            socketsClosing++;
+        }
+    }
+    SPI.endTransaction();
+
+    // The paint that is left above the heap is RAM that was never used
+    extern int __heap_start, *__brkval;
+    uint8_t here;
+    uint8_t *p = __brkval == 0 ? (uint8_t *)&__heap_start : (uint8_t *)__brkval;
+    ramLow = 0;
+    while (p < &here && *p == METRICS_PAINT) {
+        p++;
+        ramLow++;
+    }
+}
+
+/*!
+  @brief  Write all metrics, with the gauges of the last snapshot().
+
+  @param  p     Where to write to
+  @param  json  JSON, otherwise the Prometheus text format
+*/
+void Metrics::print(Print &p, bool json)
+{
+    MetricsWriter w(p, json);
+
+    w.family(F("e2g_vxi_rpc_total"), true, F("procedure"));
+    for (uint8_t i = 0; i < METRICS_NR_RPCS; i++) {
+        const char *name = (const char *)pgm_read_ptr(&rpcNames[i]);
+        if (name) {
+            w.value((const __FlashStringHelper *)name, rpcs[i]);
+        }
+    }
+    w.value(F("other"), otherRpcs);
+
+    w.family(F("e2g_portmap_requests_total"), true, F("protocol"));
+    w.value(F("udp"), portmaps[0]);
+    w.value(F("tcp"), portmaps[1]);
+
+    w.family(F("e2g_gpib_bytes_in_total"), true, F("address"));
+    for (uint8_t i = 0; i < METRICS_ADDRESSES && addresses[i] != METRICS_NO_ADDRESS; i++) {
+        w.value(addresses[i], bytesIn[i]);
+    }
+    w.value(F("other"), bytesIn[METRICS_ADDRESSES]);
+
+    w.family(F("e2g_gpib_bytes_out_total"), true, F("address"));
+    for (uint8_t i = 0; i < METRICS_ADDRESSES && addresses[i] != METRICS_NO_ADDRESS; i++) {
+        w.value(addresses[i], bytesOut[i]);
+    }
+    w.value(F("other"), bytesOut[METRICS_ADDRESSES]);
+
+    w.family(F("e2g_gpib_reads_total"), true, F("stop"));
+    for (uint8_t i = 0; i < METRICS_NR_READ_STATES; i++) {
+        w.value((const __FlashStringHelper *)pgm_read_ptr(&readNames[i]), readStates[i]);
+    }
+
+    w.family(F("e2g_gpib_handshake_timeouts_total"), true);
+    w.value(handshakeTimeouts);
+
+    w.family(F("e2g_sockets"), false, F("state"));
+    w.value(F("listen"), socketsListen);
+    w.value(F("connected"), socketsConnected);
+    w.value(F("closing"), socketsClosing);
+    w.value(F("free"), MAX_SOCK_NUM - socketsListen - socketsConnected - socketsClosing);
+
+    w.family(F("e2g_free_ram_min_bytes"), false);
+    w.value(ramLow);
+
+    w.family(F("e2g_loops_total"), true);
+    w.value(loops);
+
+    w.family(F("e2g_loop_max_us"), false);
+    w.value(loopMax);
+
+    w.end();
+}
+#endif
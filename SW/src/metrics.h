@@ -0,0 +1,87 @@
+#pragma once
+
+/*!
+  @file   metrics.h
+  @brief  Declares the Metrics class, the counters of the gateway served by the web server on /metrics.
+*/
+
+#include <Arduino.h>
+#include "config.h"
+#include "AR488_GPIBbus.h"
+
+#define METRICS_FIRST_RPC 10   ///< First counted VXI-11 procedure: VXI_11_CREATE_LINK
+#define METRICS_NR_RPCS 16     ///< Counted VXI-11 procedures: VXI_11_CREATE_LINK (10) .. VXI_11_CREATE_INT_CHAN (25)
+#define METRICS_NR_READ_STATES (RECEIVE_ERR + 1)  ///< One counter for every receiveState
+#define METRICS_NO_ADDRESS 0xFF  ///< Free entry of the address table
+#define METRICS_PAINT 0xA5     ///< Free RAM is filled with this at boot, to find its low-water mark
+
+/*!
+  @brief  Fixed size counters of the hot paths, and the gauges of the gateway.
+
+  Counting is an increment or a short search in a small table, so the hooks in the servers and in
+  GPIBbus cost next to nothing. print() writes all values in the Prometheus text format or in JSON,
+  without any buffer of its own.
+
+  The GPIB bytes are counted per address, for the first METRICS_ADDRESSES addresses that are used;
+  the other addresses share the last entry ("other").
+*/
+class Metrics
+{
+  public:
+    void begin(void);
+    void loopStart(void);
+
+    /*!
+      @brief  Count a VXI-11 call.
+
+      @param  procedure  The procedure of the call, see rpc::procedures
+    */
+    void countRpc(uint32_t procedure) {
+        uint32_t i = procedure - METRICS_FIRST_RPC;
+        if (i < METRICS_NR_RPCS) {
+            rpcs[i]++;
+        } else {
+            otherRpcs++;
+        }
+    }
+
+    /*!
+      @brief  Count a port mapper request.
+
+      @param  onUDP  The request came in on UDP, otherwise on TCP
+    */
+    void countPortmap(bool onUDP) { portmaps[onUDP ? 0 : 1]++; }
+
+    /*!
+      @brief  Count a handshake that timed out on the GPIB bus.
+    */
+    void countHandshakeTimeout(void) { handshakeTimeouts++; }
+
+    void countBytes(uint8_t address, size_t in, size_t out);
+    void countRead(uint8_t address, size_t in, enum receiveState state);
+
+    void snapshot(void);
+    void print(Print &p, bool json);
+    void resetLoopMax(void) { loopMax = 0; }
+
+  protected:
+    uint32_t rpcs[METRICS_NR_RPCS];                    ///< VXI-11 calls per procedure
+    uint32_t otherRpcs;                                ///< VXI-11 calls of other procedures
+    uint32_t portmaps[2];                              ///< Port mapper requests on UDP and on TCP
+    uint32_t handshakeTimeouts;                        ///< Handshakes that timed out, reading or writing
+    uint32_t readStates[METRICS_NR_READ_STATES];       ///< Reads per stop reason
+    uint8_t addresses[METRICS_ADDRESSES + 1];          ///< GPIB address of every entry of bytesIn and bytesOut
+    uint32_t bytesIn[METRICS_ADDRESSES + 1];           ///< Bytes read from the GPIB bus per address
+    uint32_t bytesOut[METRICS_ADDRESSES + 1];          ///< Bytes written to the GPIB bus per address
+    uint32_t loops;                                    ///< Passes of the main loop
+    unsigned long loopMax;                             ///< Longest pass of the main loop in us, since boot or resetLoopMax()
+    unsigned long lastLoop;                            ///< micros() at the start of the current pass
+
+    // Gauges, read by snapshot(), so both passes of print() show the same values
+    uint8_t socketsListen;                             ///< Sockets waiting for a connection
+    uint8_t socketsConnected;                          ///< Sockets with a connection, including UDP sockets
+    uint8_t socketsClosing;                            ///< Sockets in any other state than closed
+    size_t ramLow;                                     ///< Smallest free RAM since boot
+};
+
+extern Metrics metrics;
@@ -0,0 +1,118 @@
+#pragma once
+
+/*!
+  @file   prologix_commands.h
+  @brief  Perfect hash table of the Prologix ++ commands, in PROGMEM.
+
+  GENERATED by tools/gen_prologix_commands.py, do not edit: change the script and rebuild.
+  Included by prologix_server.cpp after the prototypes of the handlers.
+*/
+
+#define PROLOGIX_CMD_SLOTS 128  ///< Size of cmdSlots[], a power of 2
+#define PROLOGIX_CMD_SEED 144  ///< Start value of prologixHash()
+#define PROLOGIX_CMD_MULTIPLIER 11  ///< Multiplier of prologixHash()
+
+static const char cmdToken0[] PROGMEM = "addr";
+static const char cmdToken1[] PROGMEM = "allspoll";
+static const char cmdToken2[] PROGMEM = "auto";
+static const char cmdToken3[] PROGMEM = "clr";
+static const char cmdToken4[] PROGMEM = "dcl";
+static const char cmdToken5[] PROGMEM = "default";
+static const char cmdToken6[] PROGMEM = "eoi";
+static const char cmdToken7[] PROGMEM = "eor";
+static const char cmdToken8[] PROGMEM = "eos";
+static const char cmdToken9[] PROGMEM = "eot_char";
+static const char cmdToken10[] PROGMEM = "eot_enable";
+static const char cmdToken11[] PROGMEM = "flags";
+static const char cmdToken12[] PROGMEM = "fndl";
+static const char cmdToken13[] PROGMEM = "help";
+static const char cmdToken14[] PROGMEM = "ifc";
+static const char cmdToken15[] PROGMEM = "id";
+static const char cmdToken16[] PROGMEM = "idn";
+static const char cmdToken17[] PROGMEM = "llo";
+static const char cmdToken18[] PROGMEM = "loc";
+static const char cmdToken19[] PROGMEM = "lon";
+static const char cmdToken20[] PROGMEM = "macro";
+static const char cmdToken21[] PROGMEM = "mode";
+static const char cmdToken22[] PROGMEM = "ppoll";
+static const char cmdToken23[] PROGMEM = "prom";
+static const char cmdToken24[] PROGMEM = "read";
+static const char cmdToken25[] PROGMEM = "read_tmo_ms";
+static const char cmdToken26[] PROGMEM = "ren";
+static const char cmdToken27[] PROGMEM = "repeat";
+static const char cmdToken28[] PROGMEM = "rst";
+static const char cmdToken29[] PROGMEM = "trg";
+static const char cmdToken30[] PROGMEM = "savecfg";
+static const char cmdToken31[] PROGMEM = "send";
+static const char cmdToken32[] PROGMEM = "setvstr";
+static const char cmdToken33[] PROGMEM = "spoll";
+static const char cmdToken34[] PROGMEM = "srq";
+static const char cmdToken35[] PROGMEM = "srqauto";
+static const char cmdToken36[] PROGMEM = "status";
+static const char cmdToken37[] PROGMEM = "tct";
+static const char cmdToken38[] PROGMEM = "ton";
+static const char cmdToken39[] PROGMEM = "unl";
+static const char cmdToken40[] PROGMEM = "unt";
+static const char cmdToken41[] PROGMEM = "ver";
+static const char cmdToken42[] PROGMEM = "verbose";
+static const char cmdToken43[] PROGMEM = "xdiag";
+
+/***** Commands, format: token, mode, handler *****/
+static const cmdRec cmdHidx[] PROGMEM = {
+  { cmdToken0, 3, (cmdHandler) addr_h },
+  { cmdToken1, 2, (cmdHandler) aspoll_h },
+  { cmdToken2, 2, (cmdHandler) amode_h },
+  { cmdToken3, 2, (cmdHandler) clr_h },
+  { cmdToken4, 2, (cmdHandler) dcl_h },
+  { cmdToken5, 3, (cmdHandler) default_h },
+  { cmdToken6, 3, (cmdHandler) eoi_h },
+  { cmdToken7, 3, (cmdHandler) eor_h },
+  { cmdToken8, 3, (cmdHandler) eos_h },
+  { cmdToken9, 3, (cmdHandler) eot_char_h },
+  { cmdToken10, 3, (cmdHandler) eot_en_h },
+  { cmdToken11, 2, (cmdHandler) hflags_h },
+  { cmdToken12, 2, (cmdHandler) fndl_h },
+  { cmdToken13, 3, (cmdHandler) help_h },
+  { cmdToken14, 2, (cmdHandler) ifc_h },
+  { cmdToken15, 3, (cmdHandler) id_h },
+  { cmdToken16, 3, (cmdHandler) idn_h },
+  { cmdToken17, 2, (cmdHandler) llo_h },
+  { cmdToken18, 2, (cmdHandler) loc_h },
+  { cmdToken19, 1, (cmdHandler) lon_h },
+  { cmdToken20, 2, (cmdHandler) macro_h },
+  { cmdToken21, 3, (cmdHandler) cmode_h },
+  { cmdToken22, 2, (cmdHandler) ppoll_h },
+  { cmdToken23, 1, (cmdHandler) prom_h },
+  { cmdToken24, 2, (cmdHandler) read_h },
+  { cmdToken25, 2, (cmdHandler) rtmo_h },
+  { cmdToken26, 2, (cmdHandler) ren_h },
+  { cmdToken27, 2, (cmdHandler) repeat_h },
+  { cmdToken28, 3, (cmdHandler) rst_h },
+  { cmdToken29, 2, (cmdHandler) trg_h },
+  { cmdToken30, 3, (cmdHandler) save_h },
+  { cmdToken31, 2, (cmdHandler) send_h },
+  { cmdToken32, 3, (cmdHandler) setvstr_h },
+  { cmdToken33, 2, (cmdHandler) spoll_h },
+  { cmdToken34, 2, (cmdHandler) srq_h },
+  { cmdToken35, 2, (cmdHandler) srqa_h },
+  { cmdToken36, 1, (cmdHandler) stat_h },
+  { cmdToken37, 2, (cmdHandler) tct_h },
+  { cmdToken38, 1, (cmdHandler) ton_h },
+  { cmdToken39, 2, (cmdHandler) unlisten_h },
+  { cmdToken40, 2, (cmdHandler) untalk_h },
+  { cmdToken41, 3, (cmdHandler) ver_h },
+  { cmdToken42, 3, (cmdHandler) verb_h },
+  { cmdToken43, 3, (cmdHandler) xdiag_h }
+};
+
+/***** Index in cmdHidx[] of the command with this hash, 0xFF if none *****/
+static const uint8_t cmdSlots[PROLOGIX_CMD_SLOTS] PROGMEM = {
+  0xFF, 0x04, 0x28, 0xFF, 0x08, 0x07, 0xFF, 0xFF, 0xFF, 0xFF, 0x27, 0xFF, 0x23, 0xFF, 0xFF, 0x01,
+  0xFF, 0x25, 0xFF, 0x16, 0xFF, 0xFF, 0x29, 0xFF, 0xFF, 0xFF, 0x21, 0xFF, 0xFF, 0xFF, 0xFF, 0x26,
+  0xFF, 0xFF, 0x18, 0xFF, 0xFF, 0xFF, 0x20, 0xFF, 0x10, 0xFF, 0xFF, 0x2B, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x03, 0x00, 0xFF, 0xFF, 0x0E, 0xFF, 0xFF, 0xFF, 0xFF, 0x06, 0x1E, 0xFF, 0xFF, 0xFF, 0x0F,
+  0x12, 0x2A, 0xFF, 0xFF, 0xFF, 0xFF, 0x05, 0xFF, 0xFF, 0xFF, 0x22, 0x13, 0xFF, 0x09, 0xFF, 0xFF,
+  0x1C, 0xFF, 0xFF, 0xFF, 0xFF, 0x19, 0xFF, 0x24, 0x17, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x1B,
+  0xFF, 0xFF, 0x1F, 0xFF, 0x0D, 0x14, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x11, 0xFF, 0xFF, 0x0C, 0xFF,
+  0x1A, 0xFF, 0xFF, 0xFF, 0x15, 0xFF, 0xFF, 0xFF, 0xFF, 0x1D, 0x0A, 0x02, 0xFF, 0xFF, 0xFF, 0x0B
+};
@@ -12,6 +12,8 @@
 #include "AR488_GPIBbus.h"
 #include "AR488_ComPorts.h"
 #include "AR488_Eeprom.h"
+#include "utilities.h"   // >>> CHANGED FROM AR488 UPSTREAM >>> for bufStream
+#include "24AA256UID.h"  // >>> CHANGED FROM AR488 UPSTREAM >>> macros stored in the EEPROM
 
 
 /***** FWVER "AR488 GPIB controller, ver. 0.53.39, 29/01/2026" *****/
@@ -22,6 +24,7 @@
 //      * individualise the setup of the gpib bus (see `setup_gpibBusConfig`)
 //      * added loads of forward declarations, to be compatible with platformio and other compilers
 //      * added a small helper function `prologix_nr_connections()`
+//      * several clients at the same time, each with its own parser state and ++ settings in a `prologixSession`
 //      * some manipulations around the help texts, as it doesn't fit in the AT4809 in some cases
 //
 // All changed sections are marked with ">>> CHANGED FROM AR488 UPSTREAM >>>" comments.
@@ -143,8 +146,7 @@ const char * const macros[] PROGMEM = {
  */
 // Serial input parsing buffer
 static const uint8_t PBSIZE = 128;
-char pBuf[PBSIZE];
-uint8_t pbPtr = 0;
+// >>> CHANGED FROM AR488 UPSTREAM >>> pBuf and pbPtr moved to prologixSession
 
 /***** ^^^^^^^^^^^^^^^^^^^ *****/
 /***** SERIAL PARSE BUFFER *****/
@@ -233,7 +235,7 @@ static const char cmdHelpPrologix[] PROGMEM = {
   "loc:\t\tEnable front panel operation on instrument\n"
   "lon:\t\tPut controller in listen-only mode (listen to all traffic)\n"
   "mode:\t\tSet the interface mode (1=controller/0=device)\n"
-  "read:\t\tRead data from instrument; e.g. currently addressed > ++read; read from addr > ++read @22\n"
+  "read:\t\tRead data from instrument; e.g. currently addressed > ++read; read from addr > ++read @22; binary frames > ++read bin\n"
   "read_tmo_ms:\tRead timeout specified between 1 - 3000 milliseconds\n"
   "rst:\t\tReset the controller\n"
   "savecfg:\tSave configration\n"
@@ -256,11 +258,11 @@ static const char cmdHelpExtended[] PROGMEM = {
   "id serial:\tShow/Set the serial number of the interface\n"
   "id verstr:\tShow/Set the version string sent in reply to ++ver e.g. \"GPIB-USB\"). Max 47 chars, excess truncated.\n"
   "idn:\t\tEnable/Disable reply to *idn? (disabled by default)\n"
-  "macro:\t\tRun a macro (if macro support is compiled)\n"
+  "macro:\t\tRun a macro (if macro support is compiled); e.g. ++macro 1; ++macro set 1 *RST; ++macro add 1 ++auto 1; ++macro show 1\n"
   "fndl:\t\tFind listners\n"
   "ppoll:\t\tConduct a parallel poll\n"
   "ren:\t\tAssert or Unassert the REN signal\n"
-  "repeat:\tRepeat a given command and return result\n"
+  "repeat:\tSend a command at a fixed period and buffer the replies; e.g. ++repeat 100 1000 READ?; ++repeat read; ++repeat stop\n"
   "send:\t\tSend to GPIB address; e.g. ++send 22,*idn?\n"
   "setvstr:\tDEPRECATED - see id verstr\n"
   "srqauto:\tAutomatically conduct serial poll when SRQ is asserted\n"
@@ -303,34 +305,108 @@ GPIBbus gpibBus;
 // GPIB control state
 //uint8_t cstate = 0;
 
-// Verbose mode
-bool isVerb = false;
+// >>> CHANGED FROM AR488 UPSTREAM >>>
+// The parser state and the ++ settings of every client are kept in a prologixSession, so
+// several clients can use the Prologix server at the same time. The ++ settings are copied
+// into gpibBus.cfg while the session is active.
+struct prologixSettings {
+  uint8_t paddr;
+  uint8_t saddr;
+  uint8_t amode;
+  bool eoi;
+  uint8_t eos;
+  uint8_t eor;
+  bool eot_en;
+  char eot_ch;
+  uint16_t rtmo;
+};
+
+struct prologixSession {
+  bool connected;             // A client is connected to this session
+  // Serial input parsing buffer
+  char pBuf[PBSIZE];
+  uint8_t pbPtr;
+  // Received, not yet parsed input
+  char rxBuf[PROLOGIX_RX_SIZE];
+  uint8_t rxPos;
+  uint8_t rxLen;
+  // Verbose mode
+  bool isVerb;
+  // CR/LF terminated line ready to process
+  uint8_t lnRdy;
+  // GPIB data receive flags
+  bool autoRead;              // Auto reading (auto mode 3) GPIB data in progress
+  bool autoReading;           // Auto mode 3: the device is addressed and a message is being read
+  unsigned long autoReadTime; // Auto mode 3: millis() the reading started or the last byte was received
+  uint8_t lastBytes[3];       // Auto mode 3: last bytes received, for the terminator detection
+  uint8_t tonPos;             // Talk only mode 2: next byte of the parse buffer to send
+  bool readWithEoi;           // Read eoi requested
+  bool readWithEndByte;       // Read with specified terminator character
+  bool isQuery;               // Direct instrument command is a query
+  uint8_t endByte;            // Termination character
+  // Escaped character flag
+  bool isEsc;                 // Charcter escaped
+  bool isPlusEscaped;         // Plus escaped
+  // Data send mode flags
+  bool dataBufferFull;        // Flag when parse buffer is full
+  // Send response to *idn?
+  bool sendIdn;
+  // ++ settings of the client: addr, auto, eoi, eos, eor, eot_enable, eot_char, read_tmo_ms
+  prologixSettings settings;
+};
 
-// CR/LF terminated line ready to process
-uint8_t lnRdy = 0;      
+prologixSettings defaultSettings;          // The settings of a new client, as loaded at startup
+prologixSession sessions[PROLOGIX_MAX_CLIENTS];
+prologixSession *session = &sessions[0];   // The session being served
+int8_t busOwner = -1;                      // The session in the middle of a transaction on the GPIB bus, -1 if none
 
 // GPIB data receive flags
-bool autoRead = false;              // Auto reading (auto mode 3) GPIB data in progress
-bool readWithEoi = false;           // Read eoi requested
-bool readWithEndByte = false;       // Read with specified terminator character
-bool isQuery = false;               // Direct instrument command is a query
-// uint8_t tranBrk = 0;                // Transmission break on 1=++, 2=EOI, 3=ATN 4=UNL
-uint8_t endByte = 0;                // Termination character
 bool isProm = false;                // Promiscuous mode flag
 bool isSpoll = false;               // Serial poll flag
 
-// Escaped character flag
-bool isEsc = false;           // Charcter escaped
-bool isPlusEscaped = false;   // Plus escaped
-
 // Read only mode flag
 bool isRO = false;
 
 // Talk only mode flag
 uint8_t isTO = 0;
 
-// Data send mode flags
-bool dataBufferFull = false;    // Flag when parse buffer is full
+// >>> CHANGED FROM AR488 UPSTREAM >>> lonMode() and tonMode() run in steps
+// The bus controls were set by lonMode() or tonMode()
+bool isStreaming = false;
+// The session that enabled listen only or talk only mode: it gets the data, or sends it
+uint8_t streamSession = 0;
+
+// >>> CHANGED FROM AR488 UPSTREAM >>> timed acquisition for ++repeat
+enum acqStates : uint8_t {
+  ACQ_IDLE,                                // Not running
+  ACQ_WAIT,                                // Waiting for the deadline of the next sample
+  ACQ_READ                                 // Reading the reply of a sample
+};
+
+#define ACQ_BUS_OWNER PROLOGIX_MAX_CLIENTS // busOwner while the acquisition reads a reply
+
+struct acquisition {
+  uint8_t state;                           // See acqStates
+  prologixSettings settings;               // ++ settings of the client that started it
+  char query[PROLOGIX_ACQ_QUERY_SIZE];     // Command sent for every sample
+  uint16_t count;                          // Number of samples, 0 = until ++repeat stop
+  uint16_t taken;                          // Number of samples taken
+  uint32_t period;                         // In us
+  uint32_t start;                          // micros() at the start
+  uint32_t next;                           // micros() deadline of the next sample
+  uint32_t sent;                           // micros() the command of the present sample was sent
+  uint32_t startMs;                        // millis() at the start, for the time stamps (micros() wraps after 71 minutes)
+  uint32_t stamp;                          // ms since the start the command of the present sample was sent
+  uint16_t dropped;                        // Samples dropped from the full buffer before they were read
+  uint16_t late;                           // Deadlines skipped
+  uint8_t lastBytes[3];                    // For the terminator detection of receiveDataPart()
+  uint8_t reply[PROLOGIX_ACQ_REPLY_SIZE];  // Reply of the present sample
+  uint8_t replyLen;
+  uint8_t ring[PROLOGIX_ACQ_BUFFER_SIZE];  // Samples not read yet, see acqStore()
+  uint16_t head;
+  uint16_t tail;
+  uint16_t used;
+} acq;
 
 // SRQ auto mode
 bool isSrqa = false;
@@ -338,9 +414,6 @@ bool isSrqa = false;
 // Whether to run Macro 0 (macros must be enabled)
 uint8_t runMacro = 0;
 
-// Send response to *idn?
-bool sendIdn = false;
-
 /***** ^^^^^^^^^^^^^^^^^^^^^^^^ *****/
 /***** COMMON VARIABLES SECTION *****/
 /************************************/
@@ -359,6 +432,11 @@ bool sendIdn = false;
 
 void tonMode();
 void lonMode();
+void autoReadStep();
+void acqStep();
+void acqRead(uint16_t max);
+void acqStatus();
+size_t streamRoom();
 void attnRequired();
 bool isIdnQuery(char* buffr);
 bool isCmd(char* buffr);
@@ -367,6 +445,9 @@ void errorMsg(uint8_t err);
 void addPbuf(char c);
 void flushPbuf();
 uint8_t parseInput(char c);
+uint8_t checkPbufFull(uint8_t r);
+bool inputAvailable();
+int inputRead();
 void initDevice();
 void initController();
 void execGpibCmd(uint8_t gpibcmd);
@@ -401,6 +482,7 @@ void eot_char_h(char* params);
 void amode_h(char* params);
 void ver_h(char* params);
 void read_h(char* params);
+void readBinary();
 void clr_h();
 void llo_h(char* params);
 void loc_h(char* params);
@@ -436,6 +518,12 @@ void send_h(char* params);
 void unlisten_h();
 void untalk_h();
 void execCmd(char *buffr, uint8_t dsize);
+void loadSettings(const prologixSettings &settings);
+void storeSettings(prologixSettings &settings);
+void startSession(uint8_t idx);
+void selectSession(uint8_t idx);
+void loopSession();
+void processLine();
 void sendToInstrument(char *buffr, uint8_t dsize);
 void getCmd(char *buffr);
 
@@ -578,8 +666,11 @@ void setup_gpibBusConfig() {
  */
 void setup_prologix(void) {
 
-  // Initialise parse buffer
-  flushPbuf();
+  // Initialise the sessions with the configured settings
+  storeSettings(defaultSettings);
+  for (uint8_t i = 0; i < PROLOGIX_MAX_CLIENTS; i++) {
+    startSession(i);
+  }
 
   // Initialise dataport, serial or ethernet as defined
   startDataPort(0); // Using EthernetStream, so baud rate is ignored
@@ -587,18 +678,113 @@ void setup_prologix(void) {
 /****** End of Arduino standard SETUP procedure *****/
 
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> new session functions
+/**
+ * @brief Copy the ++ settings of a session into the GPIB bus configuration
+ */
+void loadSettings(const prologixSettings &settings) {
+  gpibBus.cfg.paddr = settings.paddr;
+  gpibBus.cfg.saddr = settings.saddr;
+  gpibBus.cfg.amode = settings.amode;
+  gpibBus.cfg.eoi = settings.eoi;
+  gpibBus.cfg.eos = settings.eos;
+  gpibBus.cfg.eor = settings.eor;
+  gpibBus.cfg.eot_en = settings.eot_en;
+  gpibBus.cfg.eot_ch = settings.eot_ch;
+  gpibBus.cfg.rtmo = settings.rtmo;
+}
+
+/**
+ * @brief Copy the ++ settings from the GPIB bus configuration into a session
+ */
+void storeSettings(prologixSettings &settings) {
+  settings.paddr = gpibBus.cfg.paddr;
+  settings.saddr = gpibBus.cfg.saddr;
+  settings.amode = gpibBus.cfg.amode;
+  settings.eoi = gpibBus.cfg.eoi;
+  settings.eos = gpibBus.cfg.eos;
+  settings.eor = gpibBus.cfg.eor;
+  settings.eot_en = gpibBus.cfg.eot_en;
+  settings.eot_ch = gpibBus.cfg.eot_ch;
+  settings.rtmo = gpibBus.cfg.rtmo;
+}
+
+/**
+ * @brief Reset the parser state of a session and give it the default settings
+ */
+void startSession(uint8_t idx) {
+  prologixSession &s = sessions[idx];
+  memset(&s, 0, sizeof(s));
+  s.settings = defaultSettings;
+  if (busOwner == idx) busOwner = -1;
+}
+
+/**
+ * @brief Make a session the active one: the parser state, the ++ settings and the client
+ */
+void selectSession(uint8_t idx) {
+  dataPort.select(idx);
+  session = &sessions[idx];
+  loadSettings(session->settings);
+}
+
 /***** ARDUINO MAIN LOOP *****/
 // >>> CHANGED FROM AR488 UPSTREAM >>>: 
 // * renamed loop() -> loop_prologix
 // * added maintainDataPort() and added a return value;
+// * serves every connected client in turn, via loopSession()
 /**
  * @brief run the main loop for the prologix server
  * 
- * @return int the number of active clients (can only be 0 or 1)
+ * Every client has its own session. A session that is in the middle of a transaction
+ * on the GPIB bus (a line waiting to be executed, or data sent in several parts) holds
+ * the bus: the other sessions wait until it is done.
+ * Without any client, session 0 keeps running, for the device mode and the macros.
+ * Listen only and talk only mode run once per pass, for the session that enabled them.
+ * 
+ * @return int the number of active clients
  */
 int loop_prologix(void) {
-  int nrclients = maintainDataPort();
+  int nrclients = maintainDataPort(busOwner);
+  bool served = false;
+
+  acqStep();
+
+  for (uint8_t i = 0; i < PROLOGIX_MAX_CLIENTS; i++) {
+    bool connected = dataPort.connected(i);
+    if (connected != sessions[i].connected) {
+      // A client came or went
+      startSession(i);
+      sessions[i].connected = connected;
+    }
+    if (!sessions[i].connected || (busOwner >= 0 && busOwner != i)) continue;
+    selectSession(i);
+    loopSession();
+    storeSettings(session->settings);
+    busOwner = (session->lnRdy || session->dataBufferFull || session->autoReading) ? i : -1;
+    served = true;
+  }
+  if (!served && busOwner < 0) {
+    selectSession(0);
+    loopSession();
+    storeSettings(session->settings);
+  }
+  if (!gpibBus.isController() && (isTO > 0 || isRO)) {
+    selectSession(streamSession);
+    if (isTO > 0) {
+      tonMode();
+    } else {
+      lonMode();
+    }
+    storeSettings(session->settings);
+  }
+  return nrclients;
+}
 
+/**
+ * @brief run the main loop for the active session
+ */
+void loopSession() {
   bool errFlg = false; 
 
 /*** Macros ***/
@@ -625,51 +811,20 @@ int loop_prologix(void) {
  * lnRdy=2: send data to Gpib
  */
 
-/*
-if (lnRdy>0){
-  dataPort.print(F("lnRdy1: "));
-  dataPort.println(lnRdy);
-}
-*/
-
-  // lnRdy=1: received a command so execute it...
-  if (lnRdy == 1) {
-    if (autoRead) {
-      // Issuing any command stops autoread mode
-      autoRead = false;
-      gpibBus.unAddressDevice();
-    }
-    execCmd(pBuf, pbPtr);
-  }
+// >>> CHANGED FROM AR488 UPSTREAM >>> moved to processLine()
+  // Execute the line left from the previous pass, if any
+  processLine();
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
   // Controller mode:
   if (gpibBus.isController()) {
-    // lnRdy=2: received data - send it to the instrument...
-    if (lnRdy == 2) {
-
-      sendToInstrument(pBuf, pbPtr);
- 
-      // Auto-read data from GPIB bus following a command or query
-      if ( (gpibBus.cfg.amode == 1) || ((gpibBus.cfg.amode == 2) && isQuery) ) {
-        gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOTALK);
-        errFlg = gpibBus.receiveData(dataPort, gpibBus.cfg.eoi, false, 0);
-        if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
-        if (isQuery) isQuery = false;
-        gpibBus.unAddressDevice();
-      }
-
-    }
-
     // Continuous auto-receive data from GPIB bus
-    if ((gpibBus.cfg.amode==3) && autoRead) {
+    if ((gpibBus.cfg.amode==3) && session->autoRead) {
       // Nothing is waiting on the serial input so read data from GPIB
-      if (lnRdy==0) {
-//        if (gpibBus.haveAddressedDevice() == TONONE) gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOTALK);
-        // Auto 3 needs to address and unadress between each reading
-        gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOTALK);
-        errFlg = gpibBus.receiveData(dataPort, readWithEoi, readWithEndByte, endByte);
-        gpibBus.unAddressDevice();
-        if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
+      if (session->lnRdy==0) {
+// >>> CHANGED FROM AR488 UPSTREAM >>> reads what the instrument has ready and returns, see autoReadStep()
+        autoReadStep();
+// <<< CHANGED FROM AR488 UPSTREAM <<<
       }
     }
 
@@ -679,7 +834,7 @@ if (lnRdy>0){
     }
 
     // Did we get an error during read?
-    if (errFlg && isVerb) {
+    if (errFlg && session->isVerb) {
       dataPort.println(F("Error while receiving data."));
       errFlg = false;
     }
@@ -687,11 +842,19 @@ if (lnRdy>0){
 
   // Device mode:
   if (gpibBus.isController()==false) {
-    if (isTO>0) {
+// >>> CHANGED FROM AR488 UPSTREAM >>> tonMode() and lonMode() run in loop_prologix(), once per pass
+    if (isTO>0 || isRO) {
 //      if (lnRdy == 2) sendToInstrument(pBuf, pbPtr);
-      tonMode();
-    }else if (isRO) {
-      lonMode();
+      // Moved from lonMode(): can't send in LON mode, nor the data of another client in TON mode, so just clear the buffer
+      if (session->lnRdy == 2 && (isRO || session != &sessions[streamSession])) {
+        flushPbuf();
+        session->lnRdy = 0;
+      }
+// >>> CHANGED FROM AR488 UPSTREAM >>> talk only or listen only mode ended: set bus to idle
+    }else if (isStreaming) {
+      gpibBus.setControls(DIDS);
+      isStreaming = false;
+// <<< CHANGED FROM AR488 UPSTREAM <<<
     }else if (gpibBus.isAsserted(ATN_PIN)) {
       attnRequired();
     }else if (gpibBus.isDeviceAddressedToListen()) {
@@ -701,35 +864,95 @@ if (lnRdy>0){
 
     // Can't send in LON mode so just clear the buffer
     if (isProm) {
-      if (lnRdy == 2) flushPbuf();
+      if (session->lnRdy == 2) flushPbuf();
     }
   }
 
   // Reset line ready flag
 //  lnRdy = 0;
 
-  // IDN query ?
-  if (sendIdn) {
-    if (gpibBus.cfg.idn==1) dataPort.println(gpibBus.cfg.sname);
-    if (gpibBus.cfg.idn==2) {dataPort.print(gpibBus.cfg.sname);dataPort.print("-");dataPort.println(gpibBus.cfg.serial);}
-    sendIdn = false;
+// >>> CHANGED FROM AR488 UPSTREAM >>> execute all the complete lines that were received, within a time budget
+  // If charaters waiting in the input buffer then parse and execute them line by line.
+  // Lines left when PROLOGIX_LINE_BUDGET has passed wait for the next pass.
+  unsigned long start = millis();
+  // (talk only mode 1 sends the input of its client to the bus as it is, without looking for commands)
+  while (!(isTO == 1 && !gpibBus.isController() && session == &sessions[streamSession]) && inputAvailable()) {
+    session->lnRdy = serialIn_h();
+    if (millis() - start >= PROLOGIX_LINE_BUDGET) break;
+    processLine();
+    // Data in device mode waits until the controller reads it
+    if (session->lnRdy) break;
+#ifdef USE_MACROS
+    // A macro that runs another macro: that one runs at the start of the next pass, before the next line
+    if (runMacro > 0) break;
+#endif
   }
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
-/*
-if (lnRdy>0){
-  dataPort.print(F("lnRdy2: "));
-  dataPort.println(lnRdy);
+  delayMicroseconds(5);
 }
-*/
+/***** END MAIN LOOP *****/
 
-  // If charaters waiting in the serial input buffer then call handler
-  if (dataPort.available()) lnRdy = serialIn_h();
 
-  delayMicroseconds(5);
-  // >>> CHANGED FROM AR488 UPSTREAM >>>: added return value for number of clients
-  return nrclients;
+// >>> CHANGED FROM AR488 UPSTREAM >>> moved out of loopSession(), so several lines can be executed in one pass
+/**
+ * @brief Execute the line in the parse buffer (lnRdy) and answer a pending *idn? query
+ * 
+ * Data for the instrument in device mode is left in the buffer, lnRdy stays set.
+ */
+void processLine() {
+  bool errFlg = false;
+
+  // lnRdy=1: received a command so execute it...
+  if (session->lnRdy == 1) {
+    if (session->autoRead) {
+      // Issuing any command stops autoread mode
+      session->autoRead = false;
+      session->autoReading = false;
+      gpibBus.unAddressDevice();
+    }
+    execCmd(session->pBuf, session->pbPtr);
+#ifdef USE_MACROS
+    // ++macro n runs the macro now, before the lines that follow it (the parse buffer is empty again)
+    if (runMacro > 0) {
+      uint8_t idx = runMacro;
+      runMacro = 0;
+      execMacro(idx);
+    }
+#endif
+  }
+
+  // lnRdy=2: received data in controller mode - send it to the instrument...
+  if (session->lnRdy == 2 && gpibBus.isController()) {
+
+    sendToInstrument(session->pBuf, session->pbPtr);
+
+    // Auto-read data from GPIB bus following a command or query
+    if ( (gpibBus.cfg.amode == 1) || ((gpibBus.cfg.amode == 2) && session->isQuery) ) {
+      gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOTALK);
+      errFlg = gpibBus.receiveData(dataPort, gpibBus.cfg.eoi, false, 0);
+      if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
+      if (session->isQuery) session->isQuery = false;
+      gpibBus.unAddressDevice();
+    }
+
+    // Did we get an error during read?
+    if (errFlg && session->isVerb) {
+      dataPort.println(F("Error while receiving data."));
+    }
+  }
+
+  // lnRdy=3: ++! outside of a read, nothing to do
+  if (session->lnRdy == 3) session->lnRdy = 0;
+
+  // IDN query ?
+  if (session->sendIdn) {
+    if (gpibBus.cfg.idn==1) dataPort.println(gpibBus.cfg.sname);
+    if (gpibBus.cfg.idn==2) {dataPort.print(gpibBus.cfg.sname);dataPort.print("-");dataPort.println(gpibBus.cfg.serial);}
+    session->sendIdn = false;
+  }
 }
-/***** END MAIN LOOP *****/
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
 
 
@@ -749,19 +972,48 @@ void initController() {
 
 /***** Serial event handler *****/
 /*
- * Note: the Arduino serial buffer is 64 characters long. Characters are stored in
- * this buffer until serialEvent_h() is called. parsedInput() takes a character at 
- * a time and places it into the 256 character parse buffer whereupon it is parsed
- * to determine whether a command or data are present.
+ * Note: the input is read from the socket in blocks of PROLOGIX_RX_SIZE into the
+ * receive buffer of the session. Runs of ordinary characters are copied to the
+ * parse buffer at once; CR, LF, ESC and the character after an ESC go through
+ * parseInput(), which determines whether a command or data are present.
  * lnRdy=0: terminator not detected yetloop
  * lnRdy=1: terminator detected, sequence in parse buffer is a ++ command
  * lnRdy=2: terminator detected, sequence in parse buffer is data or direct instrument command
  */ 
+// >>> CHANGED FROM AR488 UPSTREAM >>> reads the input in blocks
 uint8_t serialIn_h() {
   uint8_t bufferStatus = 0;
-  // Parse serial input until we have detected a line terminator
-  while (dataPort.available() && bufferStatus==0) {   // Parse while characters available and line is not complete
-    bufferStatus = parseInput(dataPort.read());
+  // Parse input until we have detected a line terminator (or an *idn? query)
+  while (bufferStatus==0 && !session->sendIdn) {
+    if (session->rxPos == session->rxLen) {
+      // Nothing left to parse, read the next block from the socket
+      session->rxPos = 0;
+      session->rxLen = dataPort.read((uint8_t *)session->rxBuf, PROLOGIX_RX_SIZE);
+      if (session->rxLen == 0) break;
+    }
+    char *start = session->rxBuf + session->rxPos;
+    // The character after an ESC, or a full buffer: character by character
+    if (session->isEsc || session->pbPtr >= PBSIZE) {
+      session->rxPos++;
+      bufferStatus = parseInput(*start);
+      continue;
+    }
+    // Find the next CR, LF or ESC, the characters before it go to the buffer as they are
+    char *end = session->rxBuf + session->rxLen;
+    char *p = start;
+    while (p < end && *p != CR && *p != LF && *p != ESC) p++;
+    uint8_t n = p - start;
+    if (n == 0) {
+      session->rxPos++;
+      bufferStatus = parseInput(*start);
+      continue;
+    }
+    if (n > PBSIZE - session->pbPtr) n = PBSIZE - session->pbPtr;
+    memcpy(session->pBuf + session->pbPtr, start, n);
+    session->pbPtr += n;
+    session->rxPos += n;
+    if (session->isVerb) dataPort.write((uint8_t *)start, n);  // Humans like to see what they are typing...
+    bufferStatus = checkPbufFull(0);
   }
 
 #ifdef DEBUG_SERIAL_INPUT
@@ -774,6 +1026,20 @@ uint8_t serialIn_h() {
 }
 
 
+/***** Characters waiting in the receive buffer or on the socket? *****/
+bool inputAvailable() {
+  return session->rxPos < session->rxLen || dataPort.available();
+}
+
+
+/***** Read one character, from the receive buffer first *****/
+int inputRead() {
+  if (session->rxPos < session->rxLen) return (uint8_t)session->rxBuf[session->rxPos++];
+  return dataPort.read();
+}
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
+
 /*************************************/
 /***** Device operation routines *****/
 /*************************************/
@@ -804,35 +1070,35 @@ uint8_t parseInput(char c) {
   uint8_t r = 0;
 
   // Read until buffer full
-  if (pbPtr < PBSIZE) {
-    if (isVerb && c!=LF) dataPort.print(c);  // Humans like to see what they are typing...
+  if (session->pbPtr < PBSIZE) {
+    if (session->isVerb && c!=LF) dataPort.print(c);  // Humans like to see what they are typing...
     // Actions on specific characters
     switch (c) {
       // Carriage return or newline? Then process the line
       case CR:
       case LF:
         // If escaped add char 0x10 or 0x13 to buffer and clear Escape flag
-        if (isEsc) {
+        if (session->isEsc) {
           addPbuf(c);
-          isEsc = false;
+          session->isEsc = false;
         } else {
           // Carriage return on blank line?
           // Note: for data CR and LF will always be escaped
-          if (pbPtr == 0) {
+          if (session->pbPtr == 0) {
             flushPbuf();
-            if (isVerb) {
+            if (session->isVerb) {
               dataPort.println();
               showPrompt();
             }
             return 0;
           } else {
 #ifdef DEBUG_SERIAL_INPUT
-            DB_PRINT(F("parseInput: Received "), pBuf);
+            DB_PRINT(F("parseInput: Received "), session->pBuf);
 #endif
             // Buffer starts with ++ and contains at least 3 characters - command?
-            if (pbPtr>2 && isCmd(pBuf) && !isPlusEscaped) {
+            if (session->pbPtr>2 && isCmd(session->pBuf) && !session->isPlusEscaped) {
               // Exclamation mark (break read loop command)
-              if (pBuf[2]==0x21) {
+              if (session->pBuf[2]==0x21) {
                 r = 3;
                 flushPbuf();
               // Otherwise flag command received and ready to process 
@@ -840,14 +1106,14 @@ uint8_t parseInput(char c) {
                 r = 1;
               }
             // Buffer contains *idn? query and interface to respond
-            }else if (pbPtr>3 && gpibBus.cfg.idn>0 && isIdnQuery(pBuf)){
-              sendIdn = true;
+            }else if (session->pbPtr>3 && gpibBus.cfg.idn>0 && isIdnQuery(session->pBuf)){
+              session->sendIdn = true;
               flushPbuf();
             // Buffer has at least 1 character = instrument data to send to gpib bus
-            }else if (pbPtr > 0) {
+            }else if (session->pbPtr > 0) {
               r = 2;
             }
-            isPlusEscaped = false;
+            session->isPlusEscaped = false;
 #ifdef DEBUG_SERIAL_INPUT
             DB_PRINT(F("R: "), r);
 #endif
@@ -857,19 +1123,19 @@ uint8_t parseInput(char c) {
         break;
       case ESC:
         // Handle the escape character
-        if (isEsc) {
+        if (session->isEsc) {
           // Add character 0x27 to buffer and clear Escape flag
           addPbuf(c);
-          isEsc = false;
+          session->isEsc = false;
         } else {
           // Flag that we have seen an Escape character
-          isEsc  = true;
+          session->isEsc  = true;
         }
         break;
       case PLUS:
-        if (isEsc) {
-          isEsc = false;
-          if (pbPtr < 2) isPlusEscaped = true;
+        if (session->isEsc) {
+          session->isEsc = false;
+          if (session->pbPtr < 2) session->isPlusEscaped = true;
         }
         addPbuf(c);
 //        if (isVerb) dataPort.print(c);
@@ -877,23 +1143,31 @@ uint8_t parseInput(char c) {
       // Something else?
       default: // any char other than defined above
         addPbuf(c);
-        isEsc = false;
+        session->isEsc = false;
     }
   }
-  if (pbPtr >= PBSIZE) {
-    if (isCmd(pBuf) && !r) {  // Command without terminator and buffer full
-      if (isVerb) {
+  return checkPbufFull(r);
+}
+
+
+// >>> CHANGED FROM AR488 UPSTREAM >>> split from parseInput(), serialIn_h() also adds characters to the buffer
+/***** Handle a full parse buffer *****/
+uint8_t checkPbufFull(uint8_t r) {
+  if (session->pbPtr >= PBSIZE) {
+    if (isCmd(session->pBuf) && !r) {  // Command without terminator and buffer full
+      if (session->isVerb) {
         dataPort.println(F("ERROR - Command buffer overflow!"));
       }
       flushPbuf();
     }else{  // Buffer contains data and is full, so process the buffer (send data via GPIB)
-      dataBufferFull = true;
+      session->dataBufferFull = true;
       // Signal to GPIB object that more data will follow (suppress GPIB addressing)
       r = 2;
     }
   }
   return r;
 }
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
 
 /***** Is this a command? *****/
@@ -946,82 +1220,48 @@ bool isNumber(char *numstr){
 
 /***** Add character to the buffer *****/
 void addPbuf(char c) {
-  pBuf[pbPtr] = c;
-  pbPtr++;
+  session->pBuf[session->pbPtr] = c;
+  session->pbPtr++;
 }
 
 
 /***** Clear the parse buffer *****/
 void flushPbuf() {
-  memset(pBuf, '\0', PBSIZE);
-  pbPtr = 0;
+  memset(session->pBuf, '\0', PBSIZE);
+  session->pbPtr = 0;
 }
 
 
+// >>> CHANGED FROM AR488 UPSTREAM >>>
 /***** Comand function record *****/
+typedef void (*cmdHandler)(char *);
+
 struct cmdRec { 
-  const char* token; 
-  int opmode;
-  void (*handler)(char *);
+  const char* token;  // In PROGMEM
+  uint8_t opmode;     // 1=device; 2=controller; 3=both
+  cmdHandler handler;
 };
 
 
-/***** Array containing index of accepted ++ commands *****/
+/***** Tables of accepted ++ commands *****/
 /*
- * Commands without parameters require casting to a pointer
- * requiring a char* parameter. The functon is called with
- * NULL by the command processor.
- * 
- * Format: token, mode, function_ptr
- * Mode: 1=device; 2=controller; 3=both; 
+ * The command table and its perfect hash index are generated
+ * by tools/gen_prologix_commands.py and live in PROGMEM, so they
+ * take no SRAM. Commands without parameters are cast to a
+ * cmdHandler and called with NULL by the command processor.
  */
-static cmdRec cmdHidx [] = { 
- 
-  { "addr",        3, addr_h      }, 
-  { "allspoll",    2, (void(*)(char*)) aspoll_h  },
-  { "auto",        2, amode_h     },
-  { "clr",         2, (void(*)(char*)) clr_h     },
-  { "dcl",         2, (void(*)(char*)) dcl_h     },
-  { "default",     3, default_h   },
-  { "eoi",         3, eoi_h       },
-  { "eor",         3, eor_h       },
-  { "eos",         3, eos_h       },
-  { "eot_char",    3, eot_char_h  },
-  { "eot_enable",  3, eot_en_h    },
-  { "flags",       2, hflags_h    },
-  { "fndl",        2, fndl_h      },
-  { "help",        3, help_h      },
-  { "ifc",         2, (void(*)(char*)) ifc_h     },
-  { "id",          3, id_h        },
-  { "idn",         3, idn_h       },
-  { "llo",         2, llo_h       },
-  { "loc",         2, loc_h       },
-  { "lon",         1, lon_h       },
-  { "macro",       2, macro_h     },
-  { "mode" ,       3, cmode_h     },
-  { "ppoll",       2, (void(*)(char*)) ppoll_h   },
-  { "prom",        1, prom_h      },
-  { "read",        2, read_h      },
-  { "read_tmo_ms", 2, rtmo_h      },
-  { "ren",         2, ren_h       },
-  { "repeat",      2, repeat_h    },
-  { "rst",         3, (void(*)(char*)) rst_h     },
-  { "trg",         2, trg_h       },
-  { "savecfg",     3, (void(*)(char*)) save_h    },
-  { "send",        2, send_h      },
-  { "setvstr",     3, setvstr_h   },
-  { "spoll",       2, spoll_h     },
-  { "srq",         2, (void(*)(char*)) srq_h     },
-  { "srqauto",     2, srqa_h      },
-  { "status",      1, stat_h      },
-  { "tct",         2, tct_h       },
-  { "ton",         1, ton_h       },
-  { "unl",         2, (void(*)(char*)) unlisten_h  },
-  { "unt",         2, (void(*)(char*)) untalk_h    },
-  { "ver",         3, ver_h       },
-  { "verbose",     3, (void(*)(char*)) verb_h    },
-  { "xdiag",       3, xdiag_h     }
-};
+#include "prologix_commands.h"
+
+
+/***** Hash of a command token, must match tools/gen_prologix_commands.py *****/
+static uint8_t prologixHash(const char *token) {
+  uint16_t h = PROLOGIX_CMD_SEED;
+  while (*token) {
+    h = h * PROLOGIX_CMD_MULTIPLIER + (*token++ | 0x20);
+  }
+  return (h ^ (h >> 8)) & (PROLOGIX_CMD_SLOTS - 1);
+}
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 
 
 /***** Show a prompt *****/
@@ -1043,7 +1283,7 @@ void sendToInstrument(char *buffr, uint8_t dsize) {
 #endif
 
   // Is this an instrument query command (string ending with ?)
-  if (buffr[dsize-1] == '?') isQuery = true;
+  if (buffr[dsize-1] == '?') session->isQuery = true;
 
   if (gpibBus.isController()) {
     // Has controller already addressed the device? - if not then address it
@@ -1054,12 +1294,12 @@ void sendToInstrument(char *buffr, uint8_t dsize) {
   gpibBus.sendData(buffr, dsize);
 
   // If controller then unaddress devicesendTo
-  if (gpibBus.isController() &&  dataBufferFull == false) {
+  if (gpibBus.isController() &&  session->dataBufferFull == false) {
     gpibBus.unAddressDevice();
   }
 
   // Clear buffer full flag
-  if (dataBufferFull) dataBufferFull = false;
+  if (session->dataBufferFull) session->dataBufferFull = false;
 
 #ifdef DEBUG_SEND_TO_INSTR
   DB_PRINT(F("done."),"");
@@ -1069,11 +1309,11 @@ void sendToInstrument(char *buffr, uint8_t dsize) {
   if (gpibBus.cfg.hflags & 0x04) showFlag(F("Send^OK"));
 
   // Show a prompt on completion?
-  if (isVerb) showPrompt();
+  if (session->isVerb) showPrompt();
 
   // Flush the parse buffer
   flushPbuf();
-  lnRdy = 0;
+  session->lnRdy = 0;
 }
 
 
@@ -1098,15 +1338,15 @@ void execCmd(char *buffr, uint8_t dsize) {
 #endif
 
   // Execute the command
-  if (isVerb) dataPort.println();
+  if (session->isVerb) dataPort.println();
   getCmd(buffr);
 
   // Flush the parse buffer and clear ready flag
   flushPbuf();
-  lnRdy = 0;
+  session->lnRdy = 0;
 
   // Show a prompt on completion?
-  if (isVerb) showPrompt();
+  if (session->isVerb) showPrompt();
 }
 
 
@@ -1116,8 +1356,7 @@ void getCmd(char *buffr) {
   char *token;  // Pointer to command token
   char *params; // Pointer to parameters (remaining buffer characters)
   
-  int casize = sizeof(cmdHidx) / sizeof(cmdHidx[0]);
-  int i = 0;
+  uint8_t i;    // Index of the command in cmdHidx[]
 
 #ifdef DEBUG_CMD_PARSER
   DB_PRINT(F("command buffer: "), buffr);
@@ -1136,20 +1375,19 @@ void getCmd(char *buffr) {
   DB_PRINT(F("process token: "), token);
 #endif
 
+// >>> CHANGED FROM AR488 UPSTREAM >>>
   // Check whether it is a valid command token
-  i = 0;
-  do {
-    if (strcasecmp(cmdHidx[i].token, token) == 0) break;
-    i++;
-  } while (i < casize);
+  i = pgm_read_byte(&cmdSlots[prologixHash(token)]);
+  if (i != 0xFF && strcasecmp_P(token, (const char *)pgm_read_ptr(&cmdHidx[i].token)) != 0) i = 0xFF;
 
-  if (i < casize) {
+  if (i != 0xFF) {
     // We have found a valid command and handler
 #ifdef DEBUG_CMD_PARSER
-    DB_PRINT(F("found handler for: "), cmdHidx[i].token);
+    DB_PRINT(F("found handler for: "), token);
 #endif
+    cmdHandler handler = (cmdHandler)pgm_read_ptr(&cmdHidx[i].handler);
     // If command is relevant to mode then execute it
-    if (cmdHidx[i].opmode & gpibBus.cfg.cmode) {
+    if (pgm_read_byte(&cmdHidx[i].opmode) & gpibBus.cfg.cmode) {
       // If its a command with parameters
       // Copy command parameters to params and call handler with parameters
       params = token + strlen(token) + 1;
@@ -1160,20 +1398,21 @@ void getCmd(char *buffr) {
         DB_PRINT(F("calling handler with parameters: "), params);
 #endif
         // Call handler with parameters specified
-        cmdHidx[i].handler(params);
+        handler(params);
       }else{
 #ifdef DEBUG_CMD_PARSER
         DB_PRINT(F("calling handler without parameters..."),"");
 #endif
         // Call handler without parameters
-        cmdHidx[i].handler(NULL);
+        handler(NULL);
       }
 #ifdef DEBUG_CMD_PARSER
       DB_PRINT(F("handler done."),"");
 #endif
+// <<< CHANGED FROM AR488 UPSTREAM <<<
     }else{
       errorMsg(0);
-      if (isVerb) dataPort.println(F("getCmd: command not available in this mode."));
+      if (session->isVerb) dataPort.println(F("getCmd: command not available in this mode."));
     }
   } else {
     // No valid command found
@@ -1220,7 +1459,7 @@ bool notInRange(char *param, uint16_t lowl, uint16_t higl, uint16_t &rval) {
   // Check range
   if (rval < lowl || rval > higl) {
     errorMsg(2);
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Valid range is between "));
       dataPort.print(lowl);
       dataPort.print(F(" and "));
@@ -1249,7 +1488,7 @@ bool notInRange(char *param, uint16_t lowl, uint16_t higl, uint16_t &rval) {
   // Check range
   if (val < lowl || val > higl) {
     errorMsg(2);
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Valid range is between "));
       dataPort.print(lowl);
       dataPort.print(F(" and "));
@@ -1264,50 +1503,89 @@ bool notInRange(char *param, uint16_t lowl, uint16_t higl, uint16_t &rval) {
 
 /***** If enabled, executes a macro *****/
 #ifdef USE_MACROS
+// >>> CHANGED FROM AR488 UPSTREAM >>> macros can be stored in the 24AA256 with ++macro set/add
+extern _24AA256UID eeprom;
+
+static uint8_t macroCache[32];             // Block of the 24AA256 that was read last
+static uint16_t macroCacheAddr = 0xFFFF;   // Its address, 0xFFFF if none
+
+/***** Character i of macro idx in the 24AA256, 0 at the end *****/
+static char storedMacroChar(uint8_t idx, uint16_t i) {
+  if (i >= MACRO_SLOT_SIZE) return 0;
+  uint16_t addr = MACRO_EEPROM_START + idx * MACRO_SLOT_SIZE + i;
+  uint16_t block = addr & ~(uint16_t)(sizeof(macroCache) - 1);
+  if (block != macroCacheAddr) {
+    eeprom.readBlock(block, macroCache, sizeof(macroCache));
+    macroCacheAddr = block;
+  }
+  uint8_t c = macroCache[addr - block];
+  return (c == 0xFF) ? 0 : (char)c;  // 0xFF: never written
+}
+
+/***** Character i of macro idx, 0 at the end *****/
+/*
+ * The macro stored in the 24AA256 if there is one, otherwise the one of AR488_Config.h.
+ * The characters must be read in order, up to the end.
+ */
+static char macroChar(uint8_t idx, uint16_t i) {
+  static bool stored;
+  if (i == 0) stored = storedMacroChar(idx, 0) != 0;
+  if (stored) return storedMacroChar(idx, i);
+  const char * macro = (const char *)pgm_read_ptr(macros + idx);
+  return pgm_read_byte_near(macro + i);
+}
+
+/***** Store (or append a line to) macro idx in the 24AA256 *****/
+static void storeMacro(uint8_t idx, const char *text, bool append) {
+  uint16_t start = MACRO_EEPROM_START + idx * MACRO_SLOT_SIZE;
+  uint16_t end = 0;
+  size_t len = strlen(text);
+
+  if (append) {
+    while (storedMacroChar(idx, end)) end++;
+  }
+  if (end + 1 + len + 1 > MACRO_SLOT_SIZE) {
+    errorMsg(2);
+    if (session->isVerb) dataPort.println(F("Macro too long"));
+    return;
+  }
+  if (end > 0) {
+    eeprom.writeBlock(start + end, (const uint8_t *)"\n", 1);
+    end++;
+  }
+  eeprom.writeBlock(start + end, (const uint8_t *)text, len + 1);  // With its terminating 0
+  macroCacheAddr = 0xFFFF;
+}
+
+/***** Run a macro, line by line *****/
 void execMacro(uint8_t idx) {
   char c;
-//  const char * macptrs = pgm_read_ptr(macros);
-//  const char macro[] = macptrs[idx];
-  const char * macro = (const char *)pgm_read_ptr(macros + idx);
-  size_t ssize = strlen_P(macro);
-
-  // Read characters from macro character array
-  for (size_t i = 0; i < ssize; i++) {
-    c = pgm_read_byte_near(macro + i);
-    if (c == CR || c == LF || i == (ssize - 1)) {
-      // Reached terminator or end of marcro. Add to buffer before processing
-      if (i == ssize-1) {
-        // Check buffer and add character
-        if (pbPtr < (PBSIZE - 1)){
-          if ((c != CR) && (c != LF)) addPbuf(c);
+  uint16_t i = 0;
+
+  flushPbuf();
+  do {
+    c = macroChar(idx, i++);
+    if (c == CR || c == LF || c == 0) {
+      // Reached terminator or end of macro: process the line
+      if (session->pbPtr > 0) {
+        if (isCmd(session->pBuf)){
+          execCmd(session->pBuf, session->pbPtr);
         }else{
-          // Buffer full - clear and exit
-          flushPbuf();
-          return;
+          sendToInstrument(session->pBuf, session->pbPtr);
         }
       }
-      if (isCmd(pBuf)){
-        execCmd(pBuf, strlen(pBuf));
-      }else{
-        sendToInstrument(pBuf, strlen(pBuf));
-      }
       // Done - clear the buffer
       flushPbuf();
+    } else if (session->pbPtr < (PBSIZE - 1)) {
+      addPbuf(c);
     } else {
-      // Check buffer and add character
-      if (pbPtr < (PBSIZE - 1)) {
-        addPbuf(c);
-      } else {
-        // Exceeds buffer size - clear buffer and exit
-        i = ssize;
-        return;
-      }
+      // Exceeds buffer size - clear buffer and exit
+      flushPbuf();
+      return;
     }
-  }
-
-  // Clear the buffer ready for serial input
-  flushPbuf();
+  } while (c != 0);
 }
+// <<< CHANGED FROM AR488 UPSTREAM <<<
 #endif
 
 
@@ -1332,7 +1610,7 @@ void addr_h(char *params) {
     if (notInRange(param, 0, 30, val)) return;
     if (val == gpibBus.cfg.caddr) {
       errorMsg(2);
-      if (isVerb) dataPort.println(F("Cannot address the controller!"));
+      if (session->isVerb) dataPort.println(F("Cannot address the controller!"));
       return;
     }
     gpibBus.cfg.paddr = val;
@@ -1356,7 +1634,7 @@ void addr_h(char *params) {
       gpibBus.cfg.saddr = saddr;
     }
 
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("PRI address set to: "));
       dataPort.println(gpibBus.cfg.paddr);
       dataPort.print(F("SEC address set to: "));
@@ -1384,7 +1662,7 @@ void rtmo_h(char *params) {
   if (params != NULL) {
     if (notInRange(params, 1, 32000, val)) return;
     gpibBus.cfg.rtmo = val;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Set [read_tmo_ms] to: "));
       dataPort.print(val);
       dataPort.println(F(" milliseconds"));
@@ -1401,7 +1679,7 @@ void eos_h(char *params) {
   if (params != NULL) {
     if (notInRange(params, 0, 3, val)) return;
     gpibBus.cfg.eos = (uint8_t)val;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Set EOS to: "));
       dataPort.println(val);
     };
@@ -1417,7 +1695,7 @@ void eoi_h(char *params) {
   if (params != NULL) {
     if (notInRange(params, 0, 1, val)) return;
     gpibBus.cfg.eoi = val ? true : false;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Set EOI assertion: "));
       dataPort.println(val ? "ON" : "OFF");
     };
@@ -1440,7 +1718,7 @@ void cmode_h(char *params) {
         gpibBus.startControllerMode();
         break;
     }
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Interface mode set to: "));
       dataPort.println(val ? "CONTROLLER" : "DEVICE");
     }
@@ -1456,7 +1734,7 @@ void eot_en_h(char *params) {
   if (params != NULL) {
     if (notInRange(params, 0, 1, val)) return;
     gpibBus.cfg.eot_en = val ? true : false;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Appending of EOT character: "));
       dataPort.println(val ? "ON" : "OFF");
     }
@@ -1472,7 +1750,7 @@ void eot_char_h(char *params) {
   if (params != NULL) {
     if (notInRange(params, 0, 255, val)) return;
     gpibBus.cfg.eot_ch = (uint8_t)val;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("EOT set to ASCII character: "));
       dataPort.println(val);
     };
@@ -1487,13 +1765,13 @@ void amode_h(char *params) {
   uint16_t val;
   if (params != NULL) {
     if (notInRange(params, 0, 3, val)) return;
-    if (val > 0 && isVerb) {
+    if (val > 0 && session->isVerb) {
       dataPort.println(F("WARNING: automode ON can cause some devices to generate"));
       dataPort.println(F("         'addressed to talk but nothing to say' errors"));
     }
     gpibBus.cfg.amode = (uint8_t)val;
-    if (gpibBus.cfg.amode < 3) autoRead = false;
-    if (isVerb) {
+    if (gpibBus.cfg.amode < 3) session->autoRead = false;
+    if (session->isVerb) {
       dataPort.print(F("Auto mode: "));      // 3rd parameter
       dataPort.println(gpibBus.cfg.amode);
     }
@@ -1526,7 +1804,7 @@ bool validReadEndType(char * param){
   uint16_t endval = 0xff;
   if (param){
     if ( (strncasecmp(param, "eoi", 3)) == 0 ){
-      readWithEoi = true;
+      session->readWithEoi = true;
       return true;
     } else if (strlen(param)==1) {
       if (param[0] == '0') {
@@ -1544,8 +1822,8 @@ bool validReadEndType(char * param){
     }
   }
   if (endflg) {
-    endByte = endval;
-    readWithEndByte = true;
+    session->endByte = endval;
+    session->readWithEndByte = true;
     return true;
   }
   return false;
@@ -1591,12 +1869,21 @@ void read_h(char *params) {
   uint8_t pri = gpibBus.cfg.paddr;
   uint8_t sec = gpibBus.cfg.saddr;
   uint16_t val = 0xFF;
+  bool binary = false;
 //  char * param;
 
   // Clear read flags (Global vars)
-  readWithEoi = false;
-  readWithEndByte = false;
-  endByte = 0;
+  session->readWithEoi = false;
+  session->readWithEndByte = false;
+  session->endByte = 0;
+
+  // >>> CHANGED FROM AR488 UPSTREAM >>> added ++read bin [@addr]
+  if (params && strncasecmp(params, "bin", 3) == 0) {
+    binary = true;
+    params += 3;
+    while (*params == ' ') params++;
+    if (*params == 0) params = NULL;
+  }
 
   if (params) {
     if (params[0] == '@') {
@@ -1620,12 +1907,17 @@ void read_h(char *params) {
   if (gpibBus.haveAddressedDevice() != TOTALK) gpibBus.addressDevice(pri, sec, TOTALK);
 
   // Read data
-  if (gpibBus.cfg.amode == 3) {
+  if (binary) {
+    // >>> CHANGED FROM AR488 UPSTREAM >>> binary read
+    readBinary();
+    if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
+    gpibBus.unAddressDevice();
+  } else if (gpibBus.cfg.amode == 3) {
     // In auto continuous mode we set this flag to indicate we are ready for continuous read
-    autoRead = true;
+    session->autoRead = true;
   } else {
     // If auto mode is disabled we do a single read
-    gpibBus.receiveData(dataPort, readWithEoi, readWithEndByte, endByte);
+    gpibBus.receiveData(dataPort, session->readWithEoi, session->readWithEndByte, session->endByte);
     if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
     gpibBus.unAddressDevice();
   }
@@ -1670,10 +1962,10 @@ void read_h(char *params) {
       errorMsg(2);
       return;
     } else if (strncasecmp(params, "eoi", 3) == 0) { // Read with eoi detection
-      readWithEoi = true;
+      session->readWithEoi = true;
     } else { // Assume ASCII character given and convert to an 8 bit byte
-      readWithEndByte = true;
-      endByte = atoi(param);
+      session->readWithEndByte = true;
+      session->endByte = atoi(param);
     }
   }
 
@@ -1686,10 +1978,10 @@ void read_h(char *params) {
   // Read data
   if (gpibBus.cfg.amode == 3) {
     // In auto continuous mode we set this flag to indicate we are ready for continuous read
-    autoRead = true;
+    session->autoRead = true;
   } else {
     // If auto mode is disabled we do a single read
-    gpibBus.receiveData(dataPort, readWithEoi, readWithEndByte, endByte);
+    gpibBus.receiveData(dataPort, session->readWithEoi, session->readWithEndByte, session->endByte);
     if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
     gpibBus.unAddressDevice();
   }
@@ -1698,10 +1990,38 @@ void read_h(char *params) {
 }
 
 
+// >>> CHANGED FROM AR488 UPSTREAM >>> new readBinary() for ++read bin
+static uint8_t binBlock[PROLOGIX_BIN_BLOCK_SIZE];
+
+/**
+ * @brief Read binary data from the addressed instrument until EOI, in frames
+ *
+ * Every frame is a 3 byte header followed by the data: the number of data bytes (big endian
+ * 16 bit) and the receive state (see enum receiveState). RECEIVE_LIMIT means that another frame
+ * follows, any other state ends the read: RECEIVE_EOI when all went well, RECEIVE_ERR on a timeout.
+ * No terminator or EOT character is added, and nothing is escaped.
+ */
+void readBinary() {
+  bool eot_en = gpibBus.cfg.eot_en;
+  enum receiveState state;
+
+  gpibBus.cfg.eot_en = false;
+  do {
+    bufStream block(binBlock, sizeof(binBlock));
+    state = gpibBus.receiveData(block, true, false, 0, sizeof(binBlock));
+    uint8_t header[3] = { (uint8_t)(block.len() >> 8), (uint8_t)(block.len() & 0xFF), (uint8_t)state };
+    dataPort.write(header, sizeof(header));
+    dataPort.write(binBlock, block.len());
+  } while (state == RECEIVE_LIMIT);
+  dataPort.flush();
+  gpibBus.cfg.eot_en = eot_en;
+}
+
+
 /***** Send device clear (usually resets the device to power on state) *****/
 void clr_h() {
   if (gpibBus.sendSDC())  {
-    if (isVerb) dataPort.println(F("Failed to send SDC"));
+    if (session->isVerb) dataPort.println(F("Failed to send SDC"));
     return;
   }
   // Set GPIB controls back to idle state
@@ -1718,13 +2038,13 @@ void llo_h(char *params) {
     if (params != NULL) {
       if (0 == strncasecmp(params, "all", 3)) {
         if (gpibBus.sendCmd(GC_LLO)) {
-          if (isVerb) dataPort.println(F("Failed to send universal LLO."));
+          if (session->isVerb) dataPort.println(F("Failed to send universal LLO."));
         }
       }
     } else {
       // Send LLO to currently addressed device
       if (gpibBus.sendLLO()){
-        if (isVerb) dataPort.println(F("Failed to send LLO!"));
+        if (session->isVerb) dataPort.println(F("Failed to send LLO!"));
       }
     }
   }
@@ -1745,7 +2065,7 @@ void loc_h(char *params) {
     } else {
       // Send GTL to addressed device
       if (gpibBus.sendGTL()) {
-        if (isVerb) dataPort.println(F("Failed to send LOC!"));
+        if (session->isVerb) dataPort.println(F("Failed to send LOC!"));
       }
       // Set GPIB controls back to idle state
       gpibBus.setControls(CIDS);
@@ -1766,7 +2086,7 @@ void ifc_h() {
     delayMicroseconds(150);
     // De-assert IFC
     gpibBus.clearSignal(IFC_BIT);
-    if (isVerb) dataPort.println(F("IFC signal asserted for 150 microseconds"));
+    if (session->isVerb) dataPort.println(F("IFC signal asserted for 150 microseconds"));
   }
 }
 
@@ -1809,7 +2129,7 @@ void trg_h(char *params) {
     for (int i = 0; i < cnt; i++) {
       // Sent GET to the requested device
       if (gpibBus.sendGET(addrs[i]))  {
-        if (isVerb) dataPort.println(F("Failed to trigger device!"));
+        if (session->isVerb) dataPort.println(F("Failed to trigger device!"));
         return;
       }
     }
@@ -1817,7 +2137,7 @@ void trg_h(char *params) {
     // Set GPIB controls back to idle state
     gpibBus.setControls(CIDS);
 
-    if (isVerb) dataPort.println(F("Group trigger completed."));
+    if (session->isVerb) dataPort.println(F("Group trigger completed."));
   }
 }
 
@@ -1838,7 +2158,7 @@ void rst_h() {
   wdt_enable(WDTO_1S);
   while (millis() < tout) {};
   // Should never reach here....
-  if (isVerb) {
+  if (session->isVerb) {
     dataPort.println(F("Reset FAILED."));
   };
 #elif defined(ESP32)
@@ -1879,7 +2199,7 @@ void spoll_h(char *params) {
   } else if (strncasecmp(params, "all", 3) == 0) {   // ALL parameter given
     all = true;
     j = 30;
-    if (isVerb) dataPort.println(F("Serial poll of all devices requested..."));
+    if (session->isVerb) dataPort.println(F("Serial poll of all devices requested..."));
   }
 
   if (j == 0) {
@@ -1989,7 +2309,7 @@ void spoll_h(char *params) {
         } else {
           // Return decimal number representing status byte
           dataPort.println(sb, DEC);
-          if (isVerb) {
+          if (session->isVerb) {
             dataPort.print(F("Received status byte ["));
             dataPort.print(sb);
             dataPort.print(F("] from device at address: "));
@@ -1999,7 +2319,7 @@ void spoll_h(char *params) {
           i = j;
         }
       } else {
-        if (isVerb) {
+        if (session->isVerb) {
           dataPort.print(F("Failed to retrieve status byte from "));
           dataPort.println(addrval);
         }
@@ -2035,7 +2355,7 @@ void spoll_h(char *params) {
   // Set GPIB control to controller idle state
   gpibBus.setControls(CIDS);
 
-  if (isVerb) dataPort.println(F("Serial poll completed."));
+  if (session->isVerb) dataPort.println(F("Serial poll completed."));
 
 }
 
@@ -2066,7 +2386,8 @@ void stat_h(char *params) {
 void save_h() {
 #ifdef E2END
   epWriteData(gpibBus.cfg.db, GPIB_CFG_SIZE);
-  if (isVerb) dataPort.println(F("Settings saved."));
+  storeSettings(defaultSettings);  // >>> CHANGED FROM AR488 UPSTREAM >>> new clients start with the saved settings
+  if (session->isVerb) dataPort.println(F("Settings saved."));
 #else
   dataPort.println(F("EEPROM not supported."));
 #endif
@@ -2082,8 +2403,9 @@ void lon_h(char *params) {
     if (isRO) {
       isTO = 0;       // Talk-only mode must be disabled!
       isProm = false; // Promiscuous mode must be disabled!
+      streamSession = session - sessions;  // >>> CHANGED FROM AR488 UPSTREAM >>> this client gets the data
     }
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("LON: "));
       dataPort.println(lval ? "ON" : "OFF") ;
     }
@@ -2213,7 +2535,7 @@ void aspoll_h() {
  */
 void dcl_h() {
   if ( gpibBus.sendCmd(GC_DCL) )  {
-    if (isVerb) dataPort.println(F("Sending DCL failed"));
+    if (session->isVerb) dataPort.println(F("Sending DCL failed"));
     return;
   }
   // Set GPIB controls back to idle state
@@ -2243,7 +2565,7 @@ void eor_h(char *params) {
   if (params != NULL) {
     if (notInRange(params, 0, 15, val)) return;
     gpibBus.cfg.eor = (uint8_t)val;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Set EOR to: "));
       dataPort.println(val);
     };
@@ -2278,7 +2600,7 @@ void ppoll_h() {
   // Output the response byte
   dataPort.println(sb, DEC);
 
-  if (isVerb) dataPort.println(F("Parallel poll completed."));
+  if (session->isVerb) dataPort.println(F("Parallel poll completed."));
 }
 
 
@@ -2294,7 +2616,7 @@ void ren_h(char *params) {
     if (notInRange(params, 0, 1, val)) return;
 //    val ? gpibBus.assertSignal(REN_PIN) | gpibBus.clearSignal(REN_PIN);
     digitalWrite(REN_PIN, (val ? LOW : HIGH));
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("REN: "));
       dataPort.println(val ? "REN asserted" : "REN un-asserted") ;
     };
@@ -2307,9 +2629,9 @@ void ren_h(char *params) {
 
 /***** Enable verbose mode 0=OFF; 1=ON *****/
 void verb_h() {
-  isVerb = !isVerb;
+  session->isVerb = !session->isVerb;
   dataPort.print("Verbose: ");
-  dataPort.println(isVerb ? "ON" : "OFF");
+  dataPort.println(session->isVerb ? "ON" : "OFF");
 }
 
 
@@ -2341,7 +2663,7 @@ void prom_h(char *params) {
       isTO = 0;     // Talk-only mode must be disabled!
       isRO = false; // Listen-only mode must be disabled!
     }
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("PROM: "));
       dataPort.println(pval ? "ON" : "OFF") ;
     }
@@ -2361,9 +2683,10 @@ void ton_h(char *params) {
     if (isTO>0) {
       isRO = false;   // Read-only mode must be disabled in TO mode!
       isProm = false; // Promiscuous mode must be disabled in TO mode!
+      streamSession = session - sessions;  // >>> CHANGED FROM AR488 UPSTREAM >>> this client sends the data
     }
   }else{
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("TON: "));
       switch (isTO) {
         case 1:
@@ -2402,7 +2725,7 @@ void srqa_h(char *params) {
         isSrqa = true;
         break;
     }
-    if (isVerb) dataPort.println(isSrqa ? "SRQ auto ON" : "SRQ auto OFF") ;
+    if (session->isVerb) dataPort.println(isSrqa ? "SRQ auto ON" : "SRQ auto OFF") ;
   } else {
     dataPort.println(isSrqa);
   }
@@ -2410,46 +2733,213 @@ void srqa_h(char *params) {
 
 
 /***** Repeat a given command and return result *****/
+// >>> CHANGED FROM AR488 UPSTREAM >>> ++repeat runs in the background, see acqStep()
+/*
+ * ++repeat count period command  start: send command every period ms, count times (0 = until stopped)
+ * ++repeat read [n]               print (and remove) the oldest n samples, all by default
+ * ++repeat stop                   stop, the samples that were not read stay available
+ * ++repeat                        show the state
+ */
 void repeat_h(char *params) {
 
   uint16_t count;
-  uint16_t tmdly;
+  uint16_t period;
   char *param;
 
-  if (params != NULL) {
-    // Count (number of repetitions)
-    param = strtok(params, " \t");
-    if (strlen(param) > 0) {
-      if (notInRange(param, 2, 255, count)) return;
-    }
-    // Time delay (milliseconds)
+  if (params == NULL) {
+    acqStatus();
+    return;
+  }
+
+  param = strtok(params, " \t");
+  if (strcasecmp_P(param, PSTR("read")) == 0) {
     param = strtok(NULL, " \t");
-    if (strlen(param) > 0) {
-      if (notInRange(param, 0, 30000, tmdly)) return;
-    }
-
-    // Pointer to remainder of parameters string
-    param = strtok(NULL, "\n\r");
-    if (strlen(param) > 0) {
-      for (uint16_t i = 0; i < count; i++) {
-        // Send string to instrument
-        gpibBus.sendData(param, strlen(param));
-        delay(tmdly);
-        gpibBus.receiveData(dataPort, gpibBus.cfg.eoi, false, 0);
-      }
-    } else {
-      errorMsg(2);
-      if (isVerb) dataPort.println(F("Missing parameter"));
+    if (param == NULL) {
+      count = 0xFFFF;
+    } else if (notInRange(param, 1, 60000, count)) {
       return;
     }
-  } else {
-    errorMsg(1);
-    if (isVerb) dataPort.println(F("Missing parameters"));
+    acqRead(count);
+    return;
+  }
+  if (strcasecmp_P(param, PSTR("stop")) == 0) {
+    if (acq.state == ACQ_READ) gpibBus.unAddressDevice();
+    if (busOwner == ACQ_BUS_OWNER) busOwner = -1;
+    acq.state = ACQ_IDLE;
+    return;
   }
 
+  // Count (number of repetitions, 0 = until stopped)
+  if (notInRange(param, 0, 60000, count)) return;
+  // Period (milliseconds)
+  param = strtok(NULL, " \t");
+  if (param == NULL || notInRange(param, 0, 60000, period)) {
+    if (param == NULL) errorMsg(1);
+    return;
+  }
+  // Pointer to remainder of parameters string
+  param = strtok(NULL, "\n\r");
+  if (param == NULL || strlen(param) == 0 || strlen(param) >= PROLOGIX_ACQ_QUERY_SIZE) {
+    errorMsg(2);
+    if (session->isVerb) dataPort.println(F("Missing or too long command"));
+    return;
+  }
+
+  if (acq.state == ACQ_READ) gpibBus.unAddressDevice();
+  memset(&acq, 0, sizeof(acq));
+  strcpy(acq.query, param);
+  acq.count = count;
+  acq.period = (uint32_t)period * 1000;
+  storeSettings(acq.settings);
+  acq.start = micros();
+  acq.startMs = millis();
+  acq.next = acq.start;
+  acq.state = ACQ_WAIT;
+}
+
+
+/***** Timed acquisition *****/
+/*
+ * The command is sent at start + n * period (micros()), whatever the time the
+ * instrument takes to answer. A deadline that passes while the previous sample is
+ * still being read, or while a client holds the bus, is served late; deadlines that
+ * are missed completely are skipped and counted as late.
+ * Every reply goes to a ring buffer with its sample number and the time it was asked
+ * (ms since the start). When the buffer is full, the oldest samples are dropped.
+ * The reply is read in steps with receiveDataPart(), like ++auto 3.
+ */
+static void acqPut(uint8_t b) {
+  acq.ring[acq.head] = b;
+  acq.head = (acq.head + 1) % PROLOGIX_ACQ_BUFFER_SIZE;
+  acq.used++;
+}
+
+static uint8_t acqGet() {
+  uint8_t b = acq.ring[acq.tail];
+  acq.tail = (acq.tail + 1) % PROLOGIX_ACQ_BUFFER_SIZE;
+  acq.used--;
+  return b;
+}
+
+// Sample number (16 bit), time (32 bit), reply length (8 bit), reply
+#define ACQ_HEADER_SIZE 7
+
+static void acqDropOldest() {
+  for (uint8_t i = 0; i < ACQ_HEADER_SIZE - 1; i++) acqGet();
+  uint8_t len = acqGet();
+  while (len--) acqGet();
+  acq.dropped++;
+}
+
+static void acqStore(uint16_t sample, uint32_t time, const uint8_t *reply, uint8_t len) {
+  while (PROLOGIX_ACQ_BUFFER_SIZE - acq.used < ACQ_HEADER_SIZE + len) acqDropOldest();
+  acqPut(sample >> 8);
+  acqPut(sample);
+  for (int8_t shift = 24; shift >= 0; shift -= 8) acqPut(time >> shift);
+  acqPut(len);
+  for (uint8_t i = 0; i < len; i++) acqPut(reply[i]);
+}
+
+
+/***** Print the oldest samples: sample,time_ms,reply *****/
+void acqRead(uint16_t max) {
+  while (acq.used > 0 && max--) {
+    uint16_t sample = acqGet() << 8;
+    sample |= acqGet();
+    uint32_t time = 0;
+    for (uint8_t i = 0; i < 4; i++) time = (time << 8) | acqGet();
+    uint8_t len = acqGet();
+    dataPort.print(sample);
+    dataPort.print(',');
+    dataPort.print(time);
+    dataPort.print(',');
+    while (len--) dataPort.write(acqGet());
+    dataPort.println();
+  }
 }
 
 
+/***** Print the state of the acquisition *****/
+void acqStatus() {
+  dataPort.print(acq.state == ACQ_IDLE ? F("stopped ") : F("running "));
+  dataPort.print(acq.taken);
+  dataPort.print('/');
+  dataPort.print(acq.count);
+  dataPort.print(F(" buffered "));
+  dataPort.print(acq.used);
+  dataPort.print(F(" dropped "));
+  dataPort.print(acq.dropped);
+  dataPort.print(F(" late "));
+  dataPort.println(acq.late);
+}
+
+
+/***** Run the acquisition, called every pass of the loop *****/
+void acqStep() {
+  enum receiveState rstate;
+
+  if (acq.state == ACQ_IDLE) return;
+  if (!gpibBus.isController()) {
+    acq.state = ACQ_IDLE;
+    return;
+  }
+
+  if (acq.state == ACQ_WAIT) {
+    uint32_t now = micros();
+    if ((int32_t)(now - acq.next) < 0) return;
+    // A client is in the middle of a transaction: wait until it is done
+    if (busOwner >= 0) return;
+
+    loadSettings(acq.settings);
+    acq.sent = now;
+    acq.stamp = millis() - acq.startMs;
+    gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOLISTEN);
+    gpibBus.sendData(acq.query, strlen(acq.query));
+    gpibBus.unAddressDevice();
+    gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOTALK);
+    memset(acq.lastBytes, 0, sizeof(acq.lastBytes));
+    acq.replyLen = 0;
+    acq.state = ACQ_READ;
+    busOwner = ACQ_BUS_OWNER;
+    return;
+  }
+
+  // ACQ_READ: read the part of the reply that is ready
+  loadSettings(acq.settings);
+  gpibBus.cfg.eot_en = false;
+  bufStream reply(acq.reply + acq.replyLen, sizeof(acq.reply) - acq.replyLen);  // A longer reply is truncated
+  rstate = gpibBus.receiveDataPart(reply, acq.lastBytes, gpibBus.cfg.eoi, false, 0, PROLOGIX_STREAM_BYTES, PROLOGIX_STREAM_TIME);
+  acq.replyLen += reply.len();
+  if (rstate == RECEIVE_INIT) {
+    // No timeout in receiveDataPart(): a reply that does not end is stored as it is
+    if ((micros() - acq.sent) / 1000 < gpibBus.cfg.rtmo) return;
+    gpibBus.setControls(CIDS);
+  }
+  gpibBus.unAddressDevice();
+  busOwner = -1;
+
+  // Store the reply without its terminator
+  while (acq.replyLen > 0 && (acq.reply[acq.replyLen - 1] == CR || acq.reply[acq.replyLen - 1] == LF)) acq.replyLen--;
+  acqStore(acq.taken, acq.stamp, acq.reply, acq.replyLen);
+  acq.taken++;
+  if (acq.count > 0 && acq.taken >= acq.count) {
+    acq.state = ACQ_IDLE;
+    return;
+  }
+
+  // Next deadline, skipping the ones that passed
+  acq.next += acq.period;
+  if (acq.period > 0) {
+    while ((int32_t)(micros() - acq.next) >= (int32_t)acq.period) {
+      acq.next += acq.period;
+      acq.late++;
+    }
+  }
+  acq.state = ACQ_WAIT;
+}
+// <<< CHANGED FROM AR488 UPSTREAM <<<
+
+
 /***** Take Control command *****/
 void tct_h(char *params){
   uint16_t val;
@@ -2458,46 +2948,83 @@ void tct_h(char *params){
     if (notInRange(params, 0, 30, val)) return;
     if (val == gpibBus.cfg.caddr) {
       errorMsg(2);
-      if (isVerb) dataPort.println(F("That is my address! Please provide the address of a remote device."));
+      if (session->isVerb) dataPort.println(F("That is my address! Please provide the address of a remote device."));
       return;
     }
 
     tctfail = gpibBus.sendTCT(val);
 
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Sending TCT to device at address "));
       dataPort.print(val);
     }
     
     if (tctfail) {
-      if (isVerb) dataPort.println(F(" failed!"));
+      if (session->isVerb) dataPort.println(F(" failed!"));
       return;
     }else{
-      if (isVerb) dataPort.println(F(" succeeded."));
+      if (session->isVerb) dataPort.println(F(" succeeded."));
       gpibBus.startDeviceMode();
-      if (isVerb) dataPort.println(F("Switched to device mode."));
+      if (session->isVerb) dataPort.println(F("Switched to device mode."));
     }
   }
 }
 
 
 /***** Run a macro *****/
+// >>> CHANGED FROM AR488 UPSTREAM >>> added set, add, clear and show
+/*
+ * ++macro                 list the macros
+ * ++macro n               run macro n (0-9)
+ * ++macro set n text      store macro n in the EEPROM (escape CR/LF to store several lines)
+ * ++macro add n text      add a line to stored macro n
+ * ++macro clear n         erase stored macro n (the one of AR488_Config.h is used again)
+ * ++macro show n          print macro n
+ */
 void macro_h(char *params) {
 #ifdef USE_MACROS
   uint16_t val;
-  const char * macro;
+  char *param;
+  char *text;
 
   if (params != NULL) {
-    if (notInRange(params, 0, 9, val)) return;
-    //    execMacro((uint8_t)val);
-    runMacro = (uint8_t)val;
+    param = strtok(params, " \t");
+    if (isNumber(param)) {
+      if (notInRange(param, 0, 9, val)) return;
+      //    execMacro((uint8_t)val);
+      runMacro = (uint8_t)val;
+      return;
+    }
+    char *action = param;
+    param = strtok(NULL, " \t");
+    if (param == NULL || !isNumber(param)) {
+      errorMsg(1);
+      return;
+    }
+    if (notInRange(param, 0, 9, val)) return;
+    text = strtok(NULL, "");  // The rest of the line
+    if (strcasecmp_P(action, PSTR("set")) == 0 || strcasecmp_P(action, PSTR("add")) == 0) {
+      if (text == NULL) {
+        errorMsg(1);
+        return;
+      }
+      storeMacro(val, text, tolower(action[0]) == 'a');
+    } else if (strcasecmp_P(action, PSTR("clear")) == 0) {
+      storeMacro(val, "", false);
+    } else if (strcasecmp_P(action, PSTR("show")) == 0) {
+      char c;
+      uint16_t i = 0;
+      while ((c = macroChar(val, i++)) != 0) {
+        if (c == LF) dataPort.println();
+        else if (c != CR) dataPort.print(c);
+      }
+      dataPort.println();
+    } else {
+      errorMsg(2);
+    }
   } else {
     for (uint8_t i = 0; i < 10; i++) {
-//      macro = pgm_read_ptr(macros[i]);
-//      macro = (const char *)pgm_read_word(macros + i);
-      macro = (const char *)pgm_read_ptr(macros + i);
-      //      dataPort.print(i);dataPort.print(F(": "));
-      if (strlen_P(macro) > 0) {
+      if (macroChar(i, 0) != 0) {
         dataPort.print(i);
         dataPort.print(" ");
       }
@@ -2649,12 +3176,12 @@ void id_h(char *params) {
 #endif
           memset(gpibBus.cfg.vstr, '\0', 48);
           strncpy(gpibBus.cfg.vstr, datastr, dlen);
-          if (isVerb) {
+          if (session->isVerb) {
             dataPort.print(F("VerStr: "));
             dataPort.println(gpibBus.cfg.vstr);
           }
         }else{
-          if (isVerb) dataPort.println(F("Length of version string must not exceed 48 characters!"));
+          if (session->isVerb) dataPort.println(F("Length of version string must not exceed 48 characters!"));
           errorMsg(2);
         }
         return;
@@ -2664,7 +3191,7 @@ void id_h(char *params) {
           memset(gpibBus.cfg.sname, '\0', 16);
           strncpy(gpibBus.cfg.sname, datastr, dlen);
         }else{
-          if (isVerb) dataPort.println(F("Length of name must not exceed 15 characters!"));
+          if (session->isVerb) dataPort.println(F("Length of name must not exceed 15 characters!"));
           errorMsg(2);
         }
         return;
@@ -2673,7 +3200,7 @@ void id_h(char *params) {
         if (dlen < 10) {
           gpibBus.cfg.serial = atol(datastr);
         }else{
-          if (isVerb) dataPort.println(F("Serial number must not exceed 9 characters!"));
+          if (session->isVerb) dataPort.println(F("Serial number must not exceed 9 characters!"));
           errorMsg(2);
         }
         return;
@@ -2712,7 +3239,7 @@ void idn_h(char * params){
   if (params != NULL) {
     if (notInRange(params, 0, 2, val)) return;
     gpibBus.cfg.idn = (uint8_t)val;
-    if (isVerb) {
+    if (session->isVerb) {
       dataPort.print(F("Sending IDN: "));
       dataPort.print(val ? "Enabled" : "Disabled"); 
       if (val==2) dataPort.print(F(" with serial number"));
@@ -3010,17 +3537,17 @@ void send_h(char *params) {
 
     }
 
-    if (param[strlen(param)-1] == '?') isQuery = true;
+    if (param[strlen(param)-1] == '?') session->isQuery = true;
 
 //    gpibBus.unAddressDevice();
     gpibBus.addressDevice(pri, sec, TOLISTEN);
     gpibBus.sendData(param, strlen(param));
 
-    if ( (gpibBus.cfg.amode == 1) || ((gpibBus.cfg.amode == 2) && isQuery) ) {
+    if ( (gpibBus.cfg.amode == 1) || ((gpibBus.cfg.amode == 2) && session->isQuery) ) {
       gpibBus.addressDevice(pri, sec, TOTALK);
       gpibBus.receiveData(dataPort, gpibBus.cfg.eoi, false, 0);
       if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
-      if (isQuery) isQuery = false;
+      if (session->isQuery) session->isQuery = false;
       gpibBus.unAddressDevice();
     }
 
@@ -3034,7 +3561,7 @@ void send_h(char *params) {
 /***** Send device clear (usually resets the device to power on state) *****/
 void unlisten_h() {
   if (gpibBus.sendUNL())  {
-    if (isVerb) dataPort.println(F("Failed to send UNL"));
+    if (session->isVerb) dataPort.println(F("Failed to send UNL"));
     return;
   }
   // Set GPIB controls back to idle state
@@ -3045,7 +3572,7 @@ void unlisten_h() {
 /***** Send device clear (usually resets the device to power on state) *****/
 void untalk_h() {
   if (gpibBus.sendUNT())  {
-    if (isVerb) dataPort.println(F("Failed to send UNT"));
+    if (session->isVerb) dataPort.println(F("Failed to send UNT"));
     return;
   }
   // Set GPIB controls back to idle state
@@ -3335,12 +3862,12 @@ void device_listen_h(){
 
 /***** Device is addressed to talk - so send data *****/
 void device_talk_h(){
-  DB_PRINT("LnRdy: ", lnRdy);
-  DB_PRINT("Buffer: ", pBuf);
-  if (lnRdy == 2) gpibBus.sendData(pBuf, pbPtr);
+  DB_PRINT("LnRdy: ", session->lnRdy);
+  DB_PRINT("Buffer: ", session->pBuf);
+  if (session->lnRdy == 2) gpibBus.sendData(session->pBuf, session->pbPtr);
   // Flush the parse buffer and clear line ready flag
   flushPbuf();
-  lnRdy = 0;
+  session->lnRdy = 0;
 }
 
 
@@ -3350,12 +3877,12 @@ void device_sdc_h() {
   #ifdef DEBUG_DEVICE_ATN
     DB_PRINT(F("SDC requested..."),"");
   #endif
-  if (isVerb) dataPort.println(F("Clearing..."));
+  if (session->isVerb) dataPort.println(F("Clearing..."));
   flushPbuf();
-  lnRdy = 0;
+  session->lnRdy = 0;
   gpibBus.cfg.stat = 0;
   gpibBus.clearSignal(SRQ_BIT);
-  if (isVerb) dataPort.println(F("Done."));
+  if (session->isVerb) dataPort.println(F("Done."));
 }
 
 
@@ -3397,7 +3924,7 @@ void device_tct_h(){
 /***** Unlisten *****/
 bool device_unl_h() {
   // Stop receiving and go to idle
-  readWithEoi = false;
+  session->readWithEoi = false;
   // Immediate break - shouldn't ATN do this anyway?
 //  tranBrk = 3;  // Stop receving transmission
   // Clear addressed state flag and set controls to idle
@@ -3436,80 +3963,127 @@ void device_gtl_h(){
 #endif
 
 
-void lonMode(){
+// >>> CHANGED FROM AR488 UPSTREAM >>> lonMode() and tonMode() move at most PROLOGIX_STREAM_BYTES or
+// PROLOGIX_STREAM_TIME us per call and return, they are called again in every pass of the loop.
+// Commands are parsed and executed by the main loop in between.
+/***** Room for captured data on the socket *****/
+/*
+ * Without a client the data is dropped, so a listener never holds up the bus.
+ */
+size_t streamRoom() {
+  if (!session->connected) return PROLOGIX_STREAM_BYTES;
+  size_t room = dataPort.availableForWrite();
+  return room < PROLOGIX_STREAM_BYTES ? room : PROLOGIX_STREAM_BYTES;
+}
 
-  uint8_t db = 0;
-  enum gpibHandshakeState state;
-  bool eoiDetected = false;
 
-  // Set bus for device listner active mode
-  gpibBus.setControls(DLAS);
+/***** Passes the received data on to the data port and counts it *****/
+class countStream : public Stream {
+  public:
+    size_t write(uint8_t ch) override { count++; return dataPort.write(ch); }
+    int available() { return 0; }  // dummy
+    int read() { return 0; }       // dummy
+    int peek() { return 0; }       // dummy
+    size_t count = 0;
+};
 
-  while (isRO) {
 
-    state = gpibBus.readByte(&db, false, &eoiDetected);
-    if (state == HANDSHAKE_COMPLETE) dataPort.write(db);
+/***** Continuous read (auto mode 3) *****/
+/*
+ * The device is addressed when a reading starts, and unaddressed when it ends.
+ * In between, every call reads what the device has ready. A device that sends
+ * nothing for read_tmo_ms ends the reading with an error, so it does not hold
+ * the bus forever.
+ */
+void autoReadStep() {
+  enum receiveState rstate;
+
+  if (!session->autoReading) {
+    // Auto 3 needs to address and unadress between each reading
+    gpibBus.addressDevice(gpibBus.cfg.paddr, gpibBus.cfg.saddr, TOTALK);
+    memset(session->lastBytes, 0, sizeof(session->lastBytes));
+    session->autoReading = true;
+    session->autoReadTime = millis();
+  }
+
+  size_t room = streamRoom();
+  if (room < 2) return;  // Keep room for the EOT character
+
+  countStream out;
+  rstate = gpibBus.receiveDataPart(out, session->lastBytes, session->readWithEoi, session->readWithEndByte,
+                                   session->endByte, room - 1, PROLOGIX_STREAM_TIME);
+  if (rstate == RECEIVE_INIT) {
+    if (out.count > 0) session->autoReadTime = millis();
+    if (millis() - session->autoReadTime < gpibBus.cfg.rtmo) return;
+    // Timeout: receiveDataPart() leaves the bus as it is while the message goes on
+    gpibBus.setControls(CIDS);
+    rstate = RECEIVE_ERR;
+  }
 
-    // Check whether there are charaters waiting in the serial input buffer and call handler
-    if (dataPort.available()) {
+  gpibBus.unAddressDevice();
+  session->autoReading = false;
+  if (gpibBus.cfg.hflags & 0x02) showFlag(F("Read^OK"));
+  if (rstate == RECEIVE_ERR && session->isVerb) dataPort.println(F("Error while receiving data."));
+}
 
-      lnRdy = serialIn_h();
 
-      // We have a command so return to main loop and execute it
-      if (lnRdy==1) break;
+/***** Listen only mode *****/
+void lonMode(){
 
-      // Clear the buffer to prevent it getting blocked
-      if (lnRdy==2) flushPbuf();
+  uint8_t db = 0;
+  enum gpibHandshakeState state;
+  bool eoiDetected = false;
+  size_t room = streamRoom();
+  unsigned long start = micros();
 
-    }
+  // Set bus for device listner active mode
+  gpibBus.setControls(DLAS);
+  isStreaming = true;
 
+  while (room > 0 && (unsigned long)(micros() - start) < PROLOGIX_STREAM_TIME) {
+    if (!gpibBus.isDataWaiting()) break;
+    state = gpibBus.readByte(&db, false, &eoiDetected);
+    if (state != HANDSHAKE_COMPLETE) break;
+    if (session->connected) dataPort.write(db);
+    room--;
   }
 
-  // Set bus to idle
-  gpibBus.setControls(DIDS);
-
 }
 
 
 /***** Talk only mpode *****/
 void tonMode(){
 
+  uint8_t n = 0;
+  unsigned long start = micros();
+
   // Set bus for device taker active mode
   gpibBus.setControls(DTAS);
+  isStreaming = true;
 
-  while (isTO>0) {
+  while (n < PROLOGIX_STREAM_BYTES && (unsigned long)(micros() - start) < PROLOGIX_STREAM_TIME) {
 
-    // Check whether there are charaters waiting in the serial input buffer and call handler
-    if (dataPort.available()) {
+    // Listeners not ready: try again in the next call instead of waiting
+    if (gpibBus.isAsserted(NRFD_PIN)) break;
 
-      if (isTO == 1) {
-        // Unbuffered version
-        gpibBus.writeByte(dataPort.read(), false);
+    if (isTO == 1) {
+      // Unbuffered version: the input as it is
+      if (!inputAvailable()) break;
+      gpibBus.writeByte(inputRead(), false);
+    } else {
+      // Buffered version: the data lines, the main loop executes the commands
+      if (session->lnRdy != 2) break;
+      if (session->tonPos < session->pbPtr) {
+        gpibBus.writeByte(session->pBuf[session->tonPos++], false);  // False = No EOI
       }
-
-      if (isTO == 2) {
-        
-        // Buffered version
-        lnRdy = serialIn_h();
-
-        // We have a command return to main loop and execute it
-        if (lnRdy==1) break;
-
-        // Otherwise send the buffered data
-        if (lnRdy==2) {
-          for (uint8_t i=0; i<pbPtr; i++){
-            gpibBus.writeByte(pBuf[i], false);  // False = No EOI
-          }
-          flushPbuf();
-        }
-        
+      if (session->tonPos >= session->pbPtr) {
+        flushPbuf();
+        session->tonPos = 0;
+        session->lnRdy = 0;
       }
-
     }
-
+    n++;
   }
 
-  // Set bus to idle
-  gpibBus.setControls(DIDS);
-
 }
+// <<< CHANGED FROM AR488 UPSTREAM <<<
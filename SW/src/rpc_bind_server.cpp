@@ -7,6 +7,9 @@
 #include "rpc_enums.h"
 #include "rpc_packets.h"
 #include "vxi_server.h"
+#ifdef USE_METRICS
+#include "metrics.h"
+#endif
 
 void RPC_Bind_Server::begin()
 {
@@ -97,6 +100,10 @@ void RPC_Bind_Server::process_request(bool onUDP)
     rpc_request_packet *rpc_request = (onUDP ? udp_request : tcp_request);
     bind_response_packet *bind_response = (onUDP ? udp_bind_response : tcp_bind_response);
 
+#ifdef USE_METRICS
+    metrics.countPortmap(onUDP);
+#endif
+
     if (rpc_request->program != rpc::PORTMAP) {
         rc = rpc::PROG_UNAVAIL;
 
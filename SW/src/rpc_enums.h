@@ -21,16 +21,12 @@ namespace rpc
   @brief  Port numbers used in the RPC and VXI communication.
 
   Bind requests always come in on port 111, via either UDP or TCP.
-  Some clients (Siglent oscilloscopes for example) require a different port per link; therefore
-  it is possible to cycle through a block of ports, changing each time VXI_Server
-  begins listening for a new link request.
-  Keeping START and END the same will allow for mDNS publication of the VXI_Server port.
+  The VXI_Server hands out a different port per link, cycling through the
+  block of ports VXI11_PORT_START..VXI11_PORT_END defined in config.h.
 */
 enum ports {
 
-    BIND_PORT = 111,       ///< Port to listen on for bind requests
-    VXI_PORT_START = 9010, ///< Start of a block of ports to use for VXI transactions
-    VXI_PORT_END = 9010    ///< End of a block of ports to use for VXI transactions
+    BIND_PORT = 111        ///< Port to listen on for bind requests
 };
 
 /*!
@@ -110,10 +106,14 @@ enum procedures {
     VXI_11_CREATE_LINK = 10, ///< Create a link to handle a series of requests
     VXI_11_DEV_WRITE = 11,   ///< Write
     VXI_11_DEV_READ = 12,    ///< Read
-    VXI_11_DEV_READSTB = 13, ///< Read the status byte (partially implemented)
-    VXI_11_DEV_TRIGGER = 14, ///< Trigger the device (not implemented)
+    VXI_11_DEV_READSTB = 13, ///< Read the status byte (serial poll)
+    VXI_11_DEV_TRIGGER = 14, ///< Trigger the device
     VXI_11_DEV_CLEAR = 15,   ///< Clear the device
-    VXI_11_DEV_LOCK = 18,    ///< Lock the device (not implemented)
+    VXI_11_DEV_REMOTE = 16,  ///< Put the device in remote
+    VXI_11_DEV_LOCAL = 17,   ///< Return the device to local
+    VXI_11_DEV_LOCK = 18,    ///< Lock the device (does not wait for the lock)
+    VXI_11_DEV_UNLOCK = 19,  ///< Unlock the device
+    VXI_11_DEV_DOCMD = 22,   ///< Execute an interface specific command, see docmd_commands
     VXI_11_DESTROY_LINK = 23, ///< Destroy the link
     VXI_11_CREATE_INT_CHAN = 25 ///< Create an interrupt channel (not implemented)
 };
@@ -140,6 +140,20 @@ enum errors {
     DUPLICATE_CHANNEL = 29 ///< This channel is already in use (?)
 };
 
+/*!
+  @brief  The GPIB specific commands of VXI_11_DEV_DOCMD (VXI-11.2).
+*/
+enum docmd_commands {
+
+    DOCMD_SEND_COMMAND = 0x020000, ///< Send the data bytes with ATN asserted
+    DOCMD_BUS_STATUS = 0x020001,   ///< Return the state of the bus, see SCPI_handler_bus_status
+    DOCMD_ATN_CONTROL = 0x020002,  ///< Assert (non zero) or release (zero) ATN
+    DOCMD_REN_CONTROL = 0x020003,  ///< Assert (non zero) or release (zero) REN
+    DOCMD_PASS_CONTROL = 0x020004, ///< Pass control to the device at the given address
+    DOCMD_BUS_ADDRESS = 0x02000A,  ///< Set the bus address of the interface
+    DOCMD_IFC_CONTROL = 0x020010   ///< Send IFC
+};
+
 /*!
   @brief  Indicates the reason for ending the read of data.
 */
@@ -6,6 +6,7 @@
 
 #include "rpc_packets.h"
 #include "rpc_enums.h"
+#include <utility/w5100.h>
 
 /*  The definition of the buffers to hold packet data */
 
@@ -16,6 +17,11 @@ uint8_t tcp_send_buffer[TCP_SEND_SIZE]; // only for tcp bind responses
 uint8_t vxi_read_buffer[VXI_READ_SIZE]; // only for vxi requests
 uint8_t vxi_send_buffer[VXI_SEND_SIZE]; // only for vxi responses
 
+/*  The state of the response being built in the W5500 TX buffer by the scatter functions */
+
+static uint32_t scatter_header_len; // length of the header (without prefix), reserved at the start of the response
+static uint32_t scatter_data_len;   // length of the data appended so far, behind the header
+
 /*!
   @brief  Receive an RPC bind request packet via UDP.
 
@@ -176,6 +182,128 @@ void send_vxi_packet(EthernetClient &tcp, uint32_t len)
     tcp.flush();
 }
 
+/*!
+  @brief  Write data in the socket TX buffer of the W5500, beyond
+          the current write pointer, without sending it yet.
+
+  Same as the write_data() of the Ethernet library, but leaving the
+  write pointer alone. The caller must hold the SPI transaction.
+
+  @param  s       The socket number.
+  @param  offset  The offset from the current write pointer.
+  @param  data    The data to write.
+  @param  len     The length of the data.
+*/
+static void write_tx_buffer(uint8_t s, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    uint16_t ptr = (W5100.readSnTX_WR(s) + offset) & W5100.SMASK;
+    uint16_t dst = ptr + W5100.SBASE(s);
+
+    if (W5100.hasOffsetAddressMapping() || ptr + len <= W5100.SSIZE) {
+        W5100.write(dst, data, len);
+    } else {
+        // wrap around the end of the circular buffer
+        uint16_t size = W5100.SSIZE - ptr;
+        W5100.write(dst, data, size);
+        W5100.write(W5100.SBASE(s), data + size, len - size);
+    }
+}
+
+/*!
+  @brief  Start a VXI response in the socket TX buffer of the W5500.
+
+  Waits until the TX buffer has room for the complete response, and
+  reserves the space for the prefix and the header. The header itself
+  is taken from the vxi_send_buffer when the response is sent.
+
+  @param  tcp           The EthernetClient to which to send.
+  @param  header_len    The length of the response header (without prefix).
+  @param  max_data_len  The maximum length of the data that will be appended.
+  @return False if the connection was closed while waiting.
+*/
+bool begin_vxi_scatter(EthernetClient &tcp, uint32_t header_len, uint32_t max_data_len)
+{
+    uint8_t s = tcp.getSocketNumber();
+    uint16_t needed = 4 + header_len + max_data_len + 3; // prefix, and padding to a multiple of 4
+
+    scatter_header_len = header_len;
+    scatter_data_len = 0;
+
+    while (true) {
+        SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+        // the free size register must be read twice to get a stable value
+        uint16_t free_size = W5100.readSnTX_FSR(s);
+        while (free_size != W5100.readSnTX_FSR(s)) {
+            free_size = W5100.readSnTX_FSR(s);
+        }
+        uint8_t status = W5100.readSnSR(s);
+        SPI.endTransaction();
+        if (free_size >= needed) {
+            return true;
+        }
+        if (status != SnSR::ESTABLISHED && status != SnSR::CLOSE_WAIT) {
+            return false;
+        }
+        yield();
+    }
+}
+
+/*!
+  @brief  Append data to the VXI response in the W5500 TX buffer.
+
+  @param  tcp   The EthernetClient to which to send.
+  @param  data  The data to append.
+  @param  len   The length of the data.
+*/
+void append_vxi_scatter(EthernetClient &tcp, const uint8_t *data, uint16_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    write_tx_buffer(tcp.getSocketNumber(), 4 + scatter_header_len + scatter_data_len, data, len);
+    SPI.endTransaction();
+    scatter_data_len += len;
+}
+
+/*!
+  @brief  Send the VXI response built in the W5500 TX buffer.
+
+  Pads the data to a multiple of 4 bytes, writes the record mark
+  and the header from the vxi_send_buffer in front of the data,
+  and only then hands the complete response to the W5500.
+
+  @param  tcp   The EthernetClient to which to send.
+*/
+void send_vxi_scatter(EthernetClient &tcp)
+{
+    uint8_t s = tcp.getSocketNumber();
+    static const uint8_t zeros[3] = {0, 0, 0};
+    uint32_t padding = (4 - (scatter_data_len & 3)) & 3;
+    uint32_t len = scatter_header_len + scatter_data_len + padding;
+
+    fill_response_header(vxi_response_packet_buffer, vxi_request->xid);
+    vxi_response_prefix->length = 0x80000000 | len; // set the FRAG bit and the length;
+
+    SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    if (padding) {
+        write_tx_buffer(s, 4 + scatter_header_len + scatter_data_len, zeros, padding);
+    }
+    write_tx_buffer(s, 0, vxi_response_prefix_buffer, 4 + scatter_header_len);
+    W5100.writeSnTX_WR(s, W5100.readSnTX_WR(s) + len + 4);
+    W5100.execCmdSn(s, Sock_SEND);
+    while ((W5100.readSnIR(s) & SnIR::SEND_OK) != SnIR::SEND_OK) {
+        if (W5100.readSnSR(s) == SnSR::CLOSED) {
+            break;
+        }
+        SPI.endTransaction();
+        yield();
+        SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    }
+    W5100.writeSnIR(s, SnIR::SEND_OK);
+    SPI.endTransaction();
+}
+
 /*!
   @brief  Fill in the standard response header data.
 
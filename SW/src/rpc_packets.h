@@ -27,6 +27,17 @@ void send_bind_packet(EthernetUDP &udp, uint32_t len);
 void send_bind_packet(EthernetClient &tcp, uint32_t len);
 void send_vxi_packet(EthernetClient &tcp, uint32_t len);
 
+/*  The scatter functions build a VXI response directly in the
+    socket TX buffer of the W5500: the data is appended behind
+    the space reserved for the header while it comes in, and the
+    header (with the record mark length) is filled in at the end.
+    This way, the data of a read response never needs a copy in SRAM.
+*/
+
+bool begin_vxi_scatter(EthernetClient &tcp, uint32_t header_len, uint32_t max_data_len);
+void append_vxi_scatter(EthernetClient &tcp, const uint8_t *data, uint16_t len);
+void send_vxi_scatter(EthernetClient &tcp);
+
 /*  The send functions call on fill_response_header to generate
     the "generic" data used in all responses.
 */
@@ -49,7 +60,8 @@ enum packet_buffer_sizes {
     TCP_READ_SIZE = 64,  ///< The TCP bind request should be at least 40 bytes + 4 bytes for prefix
     TCP_SEND_SIZE = 36,  ///< The TCP bind response should be at least 24 or 28 bytes + 4 bytes for prefix, and 4 for padding
     VXI_READ_SIZE = TARGET_MAX_WRITE_REQUEST_DATA_SIZE+64,///< The VXI requests size, is struct size + MAX_WRITE_REQUEST_DATA_SIZE + 4 bytes for prefix.
-    VXI_SEND_SIZE = TARGET_MAX_READ_RESPONSE_DATA_SIZE+44 ///< The VXI response size, struct size + MAX_READ_RESPONSE_DATA_SIZE + 4 bytes for prefix, and 4 for padding
+    VXI_SEND_SIZE = 112,  ///< The VXI response size, struct size + 4 bytes for prefix, and 4 for padding. Read data does not pass through here, see begin_vxi_scatter()
+    VXI_SCATTER_CHUNK_SIZE = 64 ///< The part of the vxi_send_buffer behind the read response header, used to collect read data before writing it to the W5500
 };
 
 /*  declaration of data buffers  */
@@ -339,10 +351,11 @@ struct read_response_packet {
     char data[];                 ///< The data returned, see MAX_READ_RESPONSE_DATA_SIZE
 };
 
-#define MAX_READ_RESPONSE_DATA_SIZE (VXI_SEND_SIZE - (9*4) - 4 - 4) ///< Maximum size of the data returned in a read response
+#define MAX_READ_RESPONSE_DATA_SIZE TARGET_MAX_READ_RESPONSE_DATA_SIZE ///< Maximum size of the data returned in a read response
 
-static_assert(MAX_READ_RESPONSE_DATA_SIZE == TARGET_MAX_READ_RESPONSE_DATA_SIZE, "MAX_READ_RESPONSE_DATA_SIZE is wrong");
-static_assert((sizeof(read_response_packet) + MAX_READ_RESPONSE_DATA_SIZE) == VXI_SEND_SIZE - 4 - 4, "read_response_packet is wrong size");
+static_assert(sizeof(read_response_packet) + VXI_SCATTER_CHUNK_SIZE <= VXI_SEND_SIZE - 4, "read_response_packet and scatter chunk do not fit");
+// the complete read response is built in the socket TX buffer of the W5500, which is 2kB per socket
+static_assert(4 + sizeof(read_response_packet) + MAX_READ_RESPONSE_DATA_SIZE + 4 <= 2048, "read_response_packet does not fit in the W5500 TX buffer");
 
 /*!
   @brief  Structure of the VXI_11_DEV_WRITE request packet.
@@ -486,6 +499,102 @@ struct clear_response_packet {
 
 static_assert(sizeof(clear_response_packet) < VXI_SEND_SIZE - 4, "clear_response_packet is too big");
 
+/*!
+  @brief  Structure of the VXI_11_DEV_TRIGGER, VXI_11_DEV_REMOTE and VXI_11_DEV_LOCAL
+  request and response packets.
+
+  These use the same Device_GenericParms and Device_Error as VXI_11_DEV_CLEAR.
+*/
+typedef clear_request_packet generic_request_packet;
+typedef clear_response_packet generic_response_packet;
+
+/*!
+  @brief  Structure of the VXI_11_DEV_LOCK request packet.
+
+  In addition to the basic RPC request data, the DEV_LOCK request
+  includes the link id, flags (can signal to wait for the lock) and the lock timeout.
+  The response is a generic_response_packet.
+*/
+struct lock_request_packet {
+    big_endian_32_t xid;             ///< Transaction id (should be checked to make sure it matches, but we will just pass it back)
+    big_endian_32_t msg_type;        ///< Message type (see rpc::msg_type)
+    big_endian_32_t rpc_version;     ///< RPC protocol version (should be 2, but we can ignore)
+    big_endian_32_t program;         ///< Program code (see rpc::programs)
+    big_endian_32_t program_version; ///< Program version - what version of the program is requested (we can ignore)
+    big_endian_32_t procedure;       ///< Procedure code (see rpc::procedures)
+    big_endian_32_t credentials_l;   ///< Security data (not used in this context)
+    big_endian_32_t credentials_h;   ///< Security data (not used in this context)
+    big_endian_32_t verifier_l;      ///< Security data (not used in this context)
+    big_endian_32_t verifier_h;      ///< Security data (not used in this context)
+    big_endian_32_t link_id;         ///< Unique link id generated for this session (see CREATE_LINK)
+    big_endian_32_t flags;           ///< Used to indicate whether to wait for the lock (we will ignore)
+    big_endian_32_t lock_timeout;    ///< How long to wait before timing out a lock request (we will ignore)
+};
+
+static_assert(sizeof(lock_request_packet) < VXI_READ_SIZE - 4, "lock_request_packet is too big");
+
+/*!
+  @brief  Structure of the VXI_11_DEV_UNLOCK request packet.
+
+  The DEV_UNLOCK request only includes the link id, like DESTROY_LINK.
+  The response is a generic_response_packet.
+*/
+typedef destroy_request_packet unlock_request_packet;
+
+/*!
+  @brief  Structure of the VXI_11_DEV_DOCMD request packet.
+
+  In addition to the basic RPC request data, the DEV_DOCMD request
+  includes the link id, flags, timeouts for lock and i/o, the command
+  (see rpc::docmd_commands), the byte order and element size of the
+  data, the length of the data sent, and the data itself.
+*/
+struct docmd_request_packet {
+    big_endian_32_t xid;             ///< Transaction id (should be checked to make sure it matches, but we will just pass it back)
+    big_endian_32_t msg_type;        ///< Message type (see rpc::msg_type)
+    big_endian_32_t rpc_version;     ///< RPC protocol version (should be 2, but we can ignore)
+    big_endian_32_t program;         ///< Program code (see rpc::programs)
+    big_endian_32_t program_version; ///< Program version - what version of the program is requested (we can ignore)
+    big_endian_32_t procedure;       ///< Procedure code (see rpc::procedures)
+    big_endian_32_t credentials_l;   ///< Security data (not used in this context)
+    big_endian_32_t credentials_h;   ///< Security data (not used in this context)
+    big_endian_32_t verifier_l;      ///< Security data (not used in this context)
+    big_endian_32_t verifier_h;      ///< Security data (not used in this context)
+    big_endian_32_t link_id;         ///< Unique link id generated for this session (see CREATE_LINK)
+    big_endian_32_t flags;           ///< Used to indicate whether an "end" character is supplied (we will ignore)
+    big_endian_32_t io_timeout;      ///< How long to wait before timing out the command
+    big_endian_32_t lock_timeout;    ///< How long to wait before timing out a lock request (we will ignore)
+    big_endian_32_t cmd;             ///< The command to execute (see rpc::docmd_commands)
+    big_endian_32_t network_order;   ///< True if the data elements are in network (big-endian) byte order
+    big_endian_32_t datasize;        ///< Size of the individual data elements (1, 2 or 4 bytes)
+    big_endian_32_t data_len;        ///< Length of the data sent
+    uint8_t data[];                  ///< The data sent
+};
+
+#define MAX_DOCMD_REQUEST_DATA_SIZE (VXI_READ_SIZE - (18*4) - 4) ///< Maximum size of the data sent in a docmd request
+
+static_assert((sizeof(docmd_request_packet) + MAX_DOCMD_REQUEST_DATA_SIZE) == VXI_READ_SIZE - 4, "docmd_request_packet is wrong size");
+
+/*!
+  @brief  Structure of the VXI_11_DEV_DOCMD response packet.
+
+  In addition to the basic RPC response data, the DEV_DOCMD response
+  includes an error field, the length of the data returned, and the
+  data itself. The data is not stored here, see begin_vxi_scatter().
+*/
+struct docmd_response_packet {
+    big_endian_32_t xid;         ///< Transaction id (we just pass it back what we received in the request)
+    big_endian_32_t msg_type;    ///< Message type (see rpc::msg_type)
+    big_endian_32_t reply_state; ///< Accepted or rejected (see rpc::reply_state)
+    big_endian_32_t verifier_l;  ///< Security data (not used in this context)
+    big_endian_32_t verifier_h;  ///< Security data (not used in this context)
+    big_endian_32_t rpc_status;  ///< Status of accepted message (see rpc::rpc_status)
+    big_endian_32_t error;       ///< Error code (see rpc::errors)
+    big_endian_32_t data_len;    ///< Length of the data returned
+};
+
+static_assert(sizeof(docmd_response_packet) < VXI_SEND_SIZE - 4, "docmd_response_packet is too big");
+
 /*  constant variables used to access the data buffers as the various structures defined above  */
 
 rpc_request_packet *const udp_request = (rpc_request_packet *)udp_request_packet_buffer;     ///< udp_request accesses the udp_request_packet_buffer as a generic rpc request
@@ -526,3 +635,12 @@ readstb_response_packet *const readstb_response = (readstb_response_packet *)vxi
 
 clear_request_packet *const clear_request = (clear_request_packet *)vxi_request_packet_buffer;     ///< clear_request accesses the vxi_request_packet_buffer as a clear request
 clear_response_packet *const clear_response = (clear_response_packet *)vxi_response_packet_buffer; ///< clear_response accesses the vxi_response_packet_buffer as a clear response
+
+generic_request_packet *const generic_request = (generic_request_packet *)vxi_request_packet_buffer;     ///< generic_request accesses the vxi_request_packet_buffer as a trigger, remote or local request
+generic_response_packet *const generic_response = (generic_response_packet *)vxi_response_packet_buffer; ///< generic_response accesses the vxi_response_packet_buffer as a trigger, remote, local, lock or unlock response
+
+lock_request_packet *const lock_request = (lock_request_packet *)vxi_request_packet_buffer;       ///< lock_request accesses the vxi_request_packet_buffer as a lock request
+unlock_request_packet *const unlock_request = (unlock_request_packet *)vxi_request_packet_buffer; ///< unlock_request accesses the vxi_request_packet_buffer as an unlock request
+
+docmd_request_packet *const docmd_request = (docmd_request_packet *)vxi_request_packet_buffer;     ///< docmd_request accesses the vxi_request_packet_buffer as a docmd request
+docmd_response_packet *const docmd_response = (docmd_response_packet *)vxi_response_packet_buffer; ///< docmd_response accesses the vxi_response_packet_buffer as a docmd response
@@ -0,0 +1,157 @@
+/*!
+  @file   scpi_socket_server.cpp
+  @brief  Definition of the SCPI_Socket_Server class.
+
+  The simplest and fastest way to talk to an instrument: no RPC, no port mapper and no ++ commands.
+
+  Example of connection string:
+
+    TCPIP::192.168.1.105::5025::SOCKET      the gateway, or the default instrument (see the serial menu)
+    TCPIP::192.168.1.105::5030::SOCKET      the instrument at GPIB address 5, if 5 is in SCPI_SOCKET_ADDRESSES
+
+  With pyvisa, set read_termination and write_termination to "\n".
+  The requests go to the same SCPI_handler as the VXI-11 requests, so both servers share the GPIB bus.
+*/
+
+#include "scpi_socket_server.h"
+#include "rpc_packets.h"
+
+static const uint8_t scpi_socket_addresses[SCPI_SOCKET_NR_PORTS] = { SCPI_SOCKET_ADDRESSES }; ///< The GPIB address of every port
+
+// Use of shared memory zones:
+// The lines and the replies go through vxi_read_buffer: the servers run one after the other in the main loop.
+static char *const scpi_socket_buffer = (char *)vxi_read_buffer;
+
+SCPI_Socket_Server::SCPI_Socket_Server(SCPI_handler_interface &scpi_handler)
+    : scpi_handler(scpi_handler)
+{
+}
+
+/**
+ * @brief Start listening on all ports.
+ * 
+ * EthernetServer only records the port of its sockets in server_port[], so a temporary object
+ * per port is enough for begin() and accept().
+ */
+void SCPI_Socket_Server::begin()
+{
+    killClients();
+    for (int i = 0; i < SCPI_SOCKET_NR_PORTS; i++) {
+        EthernetServer(SCPI_SOCKET_PORT + scpi_socket_addresses[i]).begin();
+    }
+}
+
+int SCPI_Socket_Server::nr_connections(void)
+{
+    int count = 0;
+    for (int i = 0; i < SCPI_SOCKET_NR_PORTS; i++) {
+        if (clients[i]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void SCPI_Socket_Server::killClients(void)
+{
+    for (int i = 0; i < SCPI_SOCKET_NR_PORTS; i++) {
+        if (clients[i]) {
+            clients[i].stop();
+        }
+    }
+}
+
+/**
+ * @brief run the SCPI socket server loop.
+ *
+ * @return int the active number of clients
+ */
+int SCPI_Socket_Server::loop()
+{
+    // This is a TCP server based on 'server.accept()', meaning I must handle the lifecycle of the clients
+    // It is blocking for input and output, like the VXI server
+
+    for (int i = 0; i < SCPI_SOCKET_NR_PORTS; i++) {
+        // close any client that is not connected
+        if (clients[i] && !clients[i].connected()) {
+            clients[i].stop();
+        }
+
+        EthernetClient newClient = EthernetServer(SCPI_SOCKET_PORT + scpi_socket_addresses[i]).accept();
+        if (newClient) {
+            if (clients[i]) {
+                // only 1 client per instrument
+                newClient.stop();
+            } else {
+                clients[i] = newClient;
+#ifdef LOG_VXI_DETAILS
+                debugPort.print(F("New SCPI socket connection on port "));
+                debugPort.print(SCPI_SOCKET_PORT + scpi_socket_addresses[i]);
+                debugPort.print(F(" from remote port "));
+                debugPort.println(newClient.remotePort());
+#endif
+            }
+        }
+
+        if (clients[i] && clients[i].available()) {
+            handle_line(i);
+        }
+    }
+    return nr_connections();
+}
+
+/**
+ * @brief Write a line to the instrument, and send back the reply if it is a query.
+ * 
+ * A line longer than the buffer is written in parts, only the last part gets EOI.
+ * The last byte of a full buffer is held back, so the last part is never empty
+ * and always has a byte to carry EOI.
+ */
+void SCPI_Socket_Server::handle_line(int slot)
+{
+    EthernetClient &client = clients[slot];
+    uint8_t address = scpi_socket_addresses[slot];
+    size_t kept = 0;  // 1 when the first byte of the buffer was held back from the previous part
+
+    while (true) {
+        size_t len = kept + client.readBytesUntil('\n', scpi_socket_buffer + kept, SCPI_SOCKET_BUFFER_SIZE - kept);
+        if (len == SCPI_SOCKET_BUFFER_SIZE) {
+            // the line goes on, write all but the last byte
+            scpi_handler.write(address, scpi_socket_buffer, len - 1, false);
+            scpi_socket_buffer[0] = scpi_socket_buffer[len - 1];
+            kept = 1;
+            continue;
+        }
+        // the newline (or a timeout) ended the line, the terminator is added by the GPIB bus, see eos
+        while (len > 0 && (scpi_socket_buffer[len - 1] == '\r' || scpi_socket_buffer[len - 1] == ' ')) {
+            len--;
+        }
+        bool is_query = len > 0 && scpi_socket_buffer[len - 1] == '?';
+        if (len == 0) {
+            if (!kept) {
+                return;  // empty line
+            }
+            len = 1;  // the held back space ends the line that was written before
+        }
+        scpi_handler.write(address, scpi_socket_buffer, len, true);
+        if (is_query) {
+            send_response(slot);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Read the reply from the instrument, and send it in blocks of the buffer size.
+ */
+void SCPI_Socket_Server::send_response(int slot)
+{
+    SCPI_handler_read_stop_reasons rv;
+    do {
+        bufStream stream((uint8_t *)scpi_socket_buffer, SCPI_SOCKET_BUFFER_SIZE);
+        rv = scpi_handler.read(scpi_socket_addresses[slot], stream, SCPI_SOCKET_BUFFER_SIZE);
+        if (stream.len() > 0) {
+            clients[slot].write((uint8_t *)scpi_socket_buffer, stream.len());
+        }
+    } while (rv == SRS_MAXSIZE);
+}
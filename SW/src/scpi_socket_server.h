@@ -0,0 +1,38 @@
+#pragma once
+
+/*!
+  @file   scpi_socket_server.h
+  @brief  Declares the SCPI_Socket_Server class, a raw SCPI socket server next to the VXI-11 server.
+*/
+
+#include "utilities.h"
+#include <Ethernet.h>
+#include "config.h"
+#include "vxi_server.h"
+
+#define SCPI_SOCKET_BUFFER_SIZE VXI_READ_SIZE ///< The buffer is shared with the VXI server
+
+/*!
+  @brief  Listens for and responds to raw SCPI socket connections.
+
+  Every port (SCPI_SOCKET_PORT + N) is bound to the instrument at GPIB address N, see SCPI_SOCKET_ADDRESSES.
+  Every line received is written to the instrument with EOI. When the line ends with a '?',
+  the reply of the instrument is read and sent back.
+*/
+class SCPI_Socket_Server
+{
+  public:
+    SCPI_Socket_Server(SCPI_handler_interface &scpi_handler);
+
+    void begin();
+    int loop();
+    int nr_connections(void);
+    void killClients(void);
+
+  protected:
+    void handle_line(int slot);
+    void send_response(int slot);
+
+    EthernetClient clients[SCPI_SOCKET_NR_PORTS];   ///< One client per port
+    SCPI_handler_interface &scpi_handler;
+};
@@ -0,0 +1,95 @@
+#include "config.h"
+
+#ifdef USE_WEBSOCKET
+#include <Arduino.h>
+#include "sha1.h"
+
+static inline uint32_t rotateLeft(uint32_t x, uint8_t n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+Sha1::Sha1(void) {
+    state[0] = 0x67452301;
+    state[1] = 0xEFCDAB89;
+    state[2] = 0x98BADCFE;
+    state[3] = 0x10325476;
+    state[4] = 0xC3D2E1F0;
+}
+
+size_t Sha1::write(uint8_t c) {
+    block.bytes[blockLength++] = c;
+    length++;
+    if (blockLength == SHA1_BLOCK_SIZE) {
+        processBlock();
+    }
+    return 1;
+}
+
+void Sha1::processBlock(void) {
+    // The words are big endian: turn them around in place, the AVR is little endian
+    for (uint8_t i = 0; i < SHA1_BLOCK_SIZE; i += 4) {
+        uint8_t b = block.bytes[i];
+        block.bytes[i] = block.bytes[i + 3];
+        block.bytes[i + 3] = b;
+        b = block.bytes[i + 1];
+        block.bytes[i + 1] = block.bytes[i + 2];
+        block.bytes[i + 2] = b;
+    }
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    for (uint8_t i = 0; i < 80; i++) {
+        // only the last 16 words of the schedule are needed, so they are kept in a ring
+        uint32_t *w = &block.words[i & 15];
+        if (i >= 16) {
+            *w = rotateLeft(block.words[(i + 13) & 15] ^ block.words[(i + 8) & 15] ^ block.words[(i + 2) & 15] ^ *w, 1);
+        }
+        uint32_t f;
+        if (i < 20) {
+            f = ((b & c) | (~b & d)) + 0x5A827999;
+        } else if (i < 40) {
+            f = (b ^ c ^ d) + 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDC;
+        } else {
+            f = (b ^ c ^ d) + 0xCA62C1D6;
+        }
+        uint32_t t = rotateLeft(a, 5) + f + e + *w;
+        e = d;
+        d = c;
+        c = rotateLeft(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    blockLength = 0;
+}
+
+/**
+ * @brief Pad the message and give its hash. The object cannot be used anymore afterwards.
+ *
+ * @param hash the 20 bytes of the hash, big endian as usual
+ */
+void Sha1::result(uint8_t hash[SHA1_HASH_SIZE]) {
+    uint32_t bits = length << 3;  // messages are short, the high 32 bits of the length are 0
+    write(0x80);
+    while (blockLength != SHA1_BLOCK_SIZE - 8) {
+        write(0);
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        write(0);
+    }
+    for (int8_t i = 24; i >= 0; i -= 8) {
+        write(bits >> i);
+    }
+    for (uint8_t i = 0; i < SHA1_HASH_SIZE; i++) {
+        hash[i] = state[i >> 2] >> (24 - 8 * (i & 3));
+    }
+}
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+/*!
+  @file   sha1.h
+  @brief  Declares the Sha1 class, a compact SHA-1 for the WebSocket handshake of the web server.
+*/
+
+#include <Arduino.h>
+#include "config.h"
+
+#define SHA1_BLOCK_SIZE 64  ///< SHA-1 works on blocks of 64 bytes
+#define SHA1_HASH_SIZE 20   ///< Size of the hash in bytes
+
+/*!
+  @brief  SHA-1 of everything printed to it.
+
+  It keeps a single block and the 16 words of the message schedule in the same 64 bytes,
+  so it takes about 90 bytes of RAM (on the stack of the caller), and little ROM.
+  SHA-1 is only used to accept WebSocket connections, not for any security.
+*/
+class Sha1 : public Print
+{
+  public:
+    Sha1(void);
+    size_t write(uint8_t c) override;
+    void result(uint8_t hash[SHA1_HASH_SIZE]);
+
+  protected:
+    void processBlock(void);
+
+    uint32_t state[5];                                  ///< The hash so far
+    union {
+        uint8_t bytes[SHA1_BLOCK_SIZE];                 ///< The current block
+        uint32_t words[SHA1_BLOCK_SIZE / 4];            ///< The message schedule while processing it
+    } block;
+    uint8_t blockLength = 0;                            ///< Bytes in the current block
+    uint32_t length = 0;                                ///< Bytes of the message
+};
@@ -27,6 +27,18 @@ BasicWebServer webServer;
 extern VXI_Server vxi_server;
 extern RPC_Bind_Server rpc_bind_server;
 #endif
+#ifdef INTERFACE_HISLIP
+#include "hislip_server.h"
+extern HiSLIP_Server hislip_server;
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+#include "scpi_socket_server.h"
+extern SCPI_Socket_Server scpi_socket_server;
+#endif
+#ifdef USE_MDNS
+#include "mdns_server.h"
+extern MDNS_Server mdns_server;
+#endif
 #ifdef INTERFACE_PROLOGIX
 extern EthernetStream ethernetPort;
 #endif
@@ -381,6 +393,13 @@ void setup_serial_ui_and_led(const __FlashStringHelper* helloStr) {
     debugPort.println("");
 }
 
+#if defined(USE_WEBSERVER) && defined(INTERFACE_VXI11)
+// Called by the VXI-11 server when a new link finds no free socket.
+static bool free_web_socket(void) {
+    return webServer.freeSocket();
+}
+#endif
+
 // This function is called once at the end of setup.
 // It is to be called at the end of setup, after network initialization.
 void end_of_setup(void) {
@@ -392,6 +411,10 @@ void end_of_setup(void) {
 #ifdef USE_WEBSERVER
     debugPort.println(F("Starting Web server on port 80..."));
     webServer.begin();
+#ifdef INTERFACE_VXI11
+    // a new VXI-11 link that finds no free socket takes the one of an idle browser connection
+    vxi_server.set_socket_reclaimer(free_web_socket);
+#endif
 #endif
 
 #ifdef USE_SERIALMENU
@@ -463,6 +486,15 @@ void loop_serial_ui_and_led(int nrConnections) {
                 rpc_bind_server.killClients();
                 vxi_server.killClients();
 #endif
+#ifdef INTERFACE_HISLIP
+                hislip_server.killClients();
+#endif
+#ifdef INTERFACE_SCPI_SOCKET
+                scpi_socket_server.killClients();
+#endif
+#ifdef USE_MDNS
+                mdns_server.announce();
+#endif
 #ifdef INTERFACE_PROLOGIX
                 ethernetPort.killClients();
 #endif
@@ -486,6 +518,12 @@ void loop_serial_ui_and_led(int nrConnections) {
         display_freeram();
         debugPort.print(F(", Clients: "));
         debugPort.print(nrConnections);
+#ifdef INTERFACE_VXI11
+        debugPort.print(F(", Evicted: "));
+        debugPort.print(vxi_server.nr_evictions());
+        debugPort.print(F(", Refused: "));
+        debugPort.print(vxi_server.nr_evictions_refused());
+#endif
         debugPort.print('\r');
 #endif
         /*
@@ -187,3 +187,37 @@ class cyclic_uint32_t
     }
 };
 
+/**
+ * @brief a helper class to capture data from the instruments in a buffer, to send it to the client in one block.
+ * This class only supports basic write operations.
+ */
+class bufStream : public Stream {
+   public:
+    bufStream(uint8_t *buf, size_t size) : buffer(buf), bufferSize(size) {}
+
+    size_t write(uint8_t ch) override {
+        if (data_len < bufferSize) {
+            buffer[data_len++] = ch;
+            return 1;
+        }
+        return 0;
+    }
+
+    size_t write(const uint8_t *buf, size_t size) override {
+        size_t n = min(size, bufferSize - data_len);
+        memcpy(buffer + data_len, buf, n);
+        data_len += n;
+        return n;
+    }
+
+    int available() { return 0; }  // dummy
+    int read() { return 0; }       // dummy
+    int peek() { return 0; }       // dummy
+
+    size_t len(void) { return data_len; }
+
+   private:
+    uint8_t *buffer;
+    size_t bufferSize;
+    size_t data_len = 0;
+};
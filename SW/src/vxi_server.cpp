@@ -1,12 +1,21 @@
 #include "vxi_server.h"
 #include "rpc_enums.h"
 #include "rpc_packets.h"
+#include <utility/w5100.h>
+#ifdef USE_METRICS
+#include "metrics.h"
+#endif
 
 
 VXI_Server::VXI_Server(SCPI_handler_interface &scpi_handler)
-    : scpi_handler(scpi_handler)
+    : evictions(0), evictions_refused(0), reclaim_socket(NULL), port_start(VXI11_PORT_START), port_end(VXI11_PORT_END),
+      next_port(VXI11_PORT_START, VXI11_PORT_END), scpi_handler(scpi_handler)
 {
-    tcp_server = NULL;
+    for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
+        ports[i] = 0;
+        listen_socks[i] = MAX_SOCK_NUM;
+        locked[i] = false;
+    }
 }
 
 VXI_Server::~VXI_Server()
@@ -24,52 +33,305 @@ int VXI_Server::nr_connections(void) {
 }
 
 bool VXI_Server::have_free_connections(void) {
+    // an idle link can make room for a new one, see allocate()
+    return free_slot() >= 0 || idle_slot() >= 0;
+}
+
+int VXI_Server::free_slot(void) {
+    for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
+        if (!clients[i] && listen_socks[i] == MAX_SOCK_NUM) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool VXI_Server::is_locked(int slot) {
+    // a lock is only held as long as the link is there, and until the link has been idle for VXI11_LOCK_TIMEOUT
+#if VXI11_LOCK_TIMEOUT > 0
+    if (locked[slot] && millis() - last_activity[slot] > VXI11_LOCK_TIMEOUT) {
+#ifdef LOG_VXI_DETAILS
+        debugPort.print(F("Releasing the lock of idle VXI link of slot "));
+        debugPort.println(slot);
+#endif
+        locked[slot] = false;
+    }
+#endif
+    return locked[slot] && clients[slot];
+}
+
+/**
+ * @brief Find the link holding a lock that covers the device of the link in this slot.
+ * 
+ * A lock covers the links to the same GPIB address. A lock of the interface link (gpib0, address 0)
+ * covers all links, and a lock of any device covers the interface link.
+ * 
+ * @return int the slot holding the lock, or -1 if there is none
+ */
+int VXI_Server::lock_holder(int slot) {
+    for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
+        if (i != slot && is_locked(i) && (addresses[i] == addresses[slot] || addresses[i] == 0 || addresses[slot] == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Refuse a device request with DEVICE_LOCKED when another link holds a lock on the device.
+ * 
+ * Link management and lock requests are always allowed. The server is blocking, so there is
+ * no waiting for the lock up to lock_timeout.
+ * 
+ * @return true if the request was refused and answered
+ */
+bool VXI_Server::locked_out(EthernetClient &client, int slot) {
+    uint32_t len;
+    switch (vxi_request->procedure) {
+        case rpc::VXI_11_DEV_READ:
+            len = sizeof(read_response_packet);  // with reason 0 and no data
+            break;
+        case rpc::VXI_11_DEV_WRITE:
+            len = sizeof(write_response_packet);  // with size 0
+            break;
+        case rpc::VXI_11_DEV_READSTB:
+            len = sizeof(readstb_response_packet);
+            break;
+        case rpc::VXI_11_DEV_DOCMD:
+            len = sizeof(docmd_response_packet);  // with no data
+            break;
+        case rpc::VXI_11_DEV_TRIGGER:
+        case rpc::VXI_11_DEV_REMOTE:
+        case rpc::VXI_11_DEV_LOCAL:
+        case rpc::VXI_11_DEV_CLEAR:
+            len = sizeof(generic_response_packet);
+            break;
+        default:
+            return false;
+    }
+    int holder = lock_holder(slot);
+    if (holder < 0) {
+        return false;
+    }
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("Refusing VXI procedure "));
+    debugPort.print((uint32_t)vxi_request->procedure);
+    debugPort.print(F(" of slot "));
+    debugPort.print(slot);
+    debugPort.print(F(", locked by slot "));
+    debugPort.println(holder);
+#endif
+    memset(vxi_response, 0, len);
+    generic_response->rpc_status = rpc::SUCCESS;
+    generic_response->error = rpc::DEVICE_LOCKED;
+    send_vxi_packet(client, len);
+    return true;
+}
+
+/**
+ * @brief Find the least recently used link that has been idle for longer than VXI11_IDLE_TIMEOUT.
+ * 
+ * Links that hold a device_lock are never considered.
+ * 
+ * @return int the slot, or -1 if there is none
+ */
+int VXI_Server::idle_slot(void) {
+    int slot = -1;
+#if VXI11_IDLE_TIMEOUT > 0
+    unsigned long now = millis();
+    unsigned long longest = VXI11_IDLE_TIMEOUT;
     for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
-        if (!clients[i]) {
+        if (clients[i] && !is_locked(i) && now - last_activity[i] > longest) {
+            longest = now - last_activity[i];
+            slot = i;
+        }
+    }
+#endif
+    return slot;
+}
+
+/**
+ * @brief Close the least recently used idle link, to free its slot and socket for a new link.
+ * 
+ * This reclaims the links of clients that crashed or forgot to destroy their link, which would
+ * otherwise hold their socket until TCP times out.
+ * 
+ * @return true if a link was closed
+ */
+bool VXI_Server::evict_idle_link(void) {
+    int slot = idle_slot();
+    if (slot < 0) {
+        return false;
+    }
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("Evicting idle VXI link on port "));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F(" of slot "));
+    debugPort.print(slot);
+    debugPort.print(F(", idle for "));
+    debugPort.print(millis() - last_activity[slot]);
+    debugPort.println(F(" ms"));
+#endif
+    clients[slot].setConnectionTimeout(1);  // the client is likely gone, do not wait for it
+    clients[slot].stop();
+    locked[slot] = false;
+    scpi_handler.release_control();
+    evictions++;
+    return true;
+}
+
+bool VXI_Server::port_in_use(uint16_t port) {
+    for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
+        if ((clients[i] || listen_socks[i] != MAX_SOCK_NUM) && ports[i] == port) {
             return true;
         }
     }
     return false;
 }
 
+/**
+ * @brief Hand out a port for a new link (called by the port mapper on GET_PORT).
+ * 
+ * Every link gets its own port out of the configured range, and its own listening socket.
+ * The listening socket is opened here, and is released again if no client connects within VXI11_LISTEN_TIMEOUT.
+ * 
+ * @return uint32_t the port, or 0 if there is no free slot, port or socket
+ */
 uint32_t VXI_Server::allocate()
 {
+    int slot = free_slot();
+    if (slot < 0 && evict_idle_link()) {
+        slot = free_slot();
+    }
+    if (slot < 0) {
+        evictions_refused++;
+        return 0;
+    }
+
+    // cycle through the range, skipping the ports that are still in use by other links
     uint32_t port = 0;
+    for (uint32_t n = 0; n <= port_end - port_start; n++) {
+        uint32_t candidate = next_port++;
+        if (!port_in_use(candidate)) {
+            port = candidate;
+            break;
+        }
+    }
+    if (port == 0) {
+        return 0;
+    }
 
-    if (have_free_connections()) {
-        port = vxi_port; // This can be a cyclic counter, not a simple integer
+    // Open a listening socket for this port. EthernetServer only records the socket in server_port[],
+    // so the object itself is not needed afterwards. I do not use EthernetServer::accept(), as it would
+    // immediately open a new listening socket on the same port after a connection.
+    // When all W5500 sockets are taken (also by the other servers), try once more after the reclaimer closed
+    // an idle connection of another server (the web server), or else after evicting an idle link.
+    EthernetServer server(port);
+    for (int attempt = 0; attempt < 2 && listen_socks[slot] == MAX_SOCK_NUM; attempt++) {
+        if (attempt > 0 && !(reclaim_socket && reclaim_socket()) && !evict_idle_link()) {
+            break;
+        }
+        server.begin();
+        for (uint8_t s = 0; s < MAX_SOCK_NUM; s++) {
+            if (EthernetServer::server_port[s] == port && EthernetClient(s).status() == SnSR::LISTEN) {
+                listen_socks[slot] = s;
+                break;
+            }
+        }
     }
+    if (listen_socks[slot] == MAX_SOCK_NUM) {
+#ifdef LOG_VXI_DETAILS
+        debugPort.print(F("ERROR: No free socket to listen on port "));
+        debugPort.println(port);
+#endif
+        evictions_refused++;
+        return 0;
+    }
+    ports[slot] = port;
+    listen_since[slot] = millis();
+
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("VXI slot "));
+    debugPort.print(slot);
+    debugPort.print(F(" listening on port "));
+    debugPort.print(port);
+    debugPort.print(F(" with socket "));
+    debugPort.println(listen_socks[slot]);
+#endif
     return port;
 }
 
 /**
- * @brief Start the VXI server on the specified port.
+ * @brief Check the listening socket of a slot, and turn it into the client of that slot once connected.
  * 
- * @param port TCP port to listen on
+ * @param slot the slot
  */
-void VXI_Server::begin(uint32_t port)
+void VXI_Server::accept_listener(int slot)
 {
-    this->vxi_port = port;
+    uint8_t s = listen_socks[slot];
+    uint8_t stat = EthernetClient(s).status();
 
-    if (tcp_server) {
-        delete tcp_server;
-        tcp_server = NULL;
-    }
-
-    tcp_server = new EthernetServer(vxi_port);
-    if (!tcp_server) {
+    if (stat == SnSR::ESTABLISHED || stat == SnSR::CLOSE_WAIT) {
+        EthernetServer::server_port[s] = 0;  // no longer a listening socket
+        listen_socks[slot] = MAX_SOCK_NUM;
+        clients[slot] = EthernetClient(s);
+        last_activity[slot] = millis();
+        locked[slot] = false;
+#ifdef LOG_VXI_DETAILS
+        debugPort.print(F("New VXI connection on port "));
+        debugPort.print((uint32_t)ports[slot]);
+        debugPort.print(F(" in slot "));
+        debugPort.print(slot);
+        debugPort.print(F(" from remote port "));
+        debugPort.println(clients[slot].remotePort());
+#endif
+    } else if (stat == SnSR::CLOSED) {
+        EthernetServer::server_port[s] = 0;
+        listen_socks[slot] = MAX_SOCK_NUM;
+    } else if (stat == SnSR::LISTEN && millis() - listen_since[slot] > VXI11_LISTEN_TIMEOUT) {
+        // the client asked for a port, but never connected
 #ifdef LOG_VXI_DETAILS
-        debugPort.print(F("ERROR: Failed to create TCP server on port "));
-        debugPort.printf("%u\n", (uint32_t)vxi_port);
+        debugPort.print(F("Releasing unused VXI port "));
+        debugPort.print((uint32_t)ports[slot]);
+        debugPort.print(F(" of slot "));
+        debugPort.println(slot);
 #endif
+        release_listener(slot);
+    }
+}
+
+void VXI_Server::release_listener(int slot)
+{
+    uint8_t s = listen_socks[slot];
+    if (s == MAX_SOCK_NUM) {
         return;
     }
+    EthernetServer::server_port[s] = 0;
+    EthernetClient listener(s);
+    listener.setConnectionTimeout(1);  // nothing to wait for on a listening socket
+    listener.stop();
+    listen_socks[slot] = MAX_SOCK_NUM;
+}
+
+/**
+ * @brief Start the VXI server on the specified range of ports.
+ * 
+ * No socket is opened here: a listening socket is only opened when the port mapper hands out a port (see allocate()).
+ * 
+ * @param port_start first TCP port of the range
+ * @param port_end last TCP port of the range
+ */
+void VXI_Server::begin(uint32_t port_start, uint32_t port_end)
+{
+    killClients();
+    this->port_start = port_start < port_end ? port_start : port_end;
+    this->port_end = port_start < port_end ? port_end : port_start;
+    next_port = cyclic_uint32_t(this->port_start, this->port_end);
 
 #ifdef LOG_VXI_DETAILS
-    debugPort.print(F("VXI server listening on port "));
-    debugPort.printf("%u\n", (uint32_t)vxi_port);
+    debugPort.print(F("VXI server will listen on ports "));
+    debugPort.printf("%u-%u\n", (uint32_t)port_start, (uint32_t)port_end);
 #endif
-    tcp_server->begin();
 }
 
 /**
@@ -79,7 +341,7 @@ void VXI_Server::begin(uint32_t port)
  */
 int VXI_Server::loop()
 {
-    // This is a TCP server based on 'server.accept()', meaning I must handle the lifecycle of the client 
+    // This is a TCP server with one listening socket per link, meaning I must handle the lifecycle of the client 
     // It is blocking for input and output
 
     // close any clients that are not connected
@@ -88,7 +350,7 @@ int VXI_Server::loop()
             clients[i].stop();
 #ifdef LOG_VXI_DETAILS
             debugPort.print(F("Force Closing VXI connection on port "));
-            debugPort.print((uint32_t)vxi_port);
+            debugPort.print((uint32_t)ports[i]);
             debugPort.print(F(" of slot "));
             debugPort.print(i);
             debugPort.print(F(" from remote port "));
@@ -97,36 +359,10 @@ int VXI_Server::loop()
         }
     }
 
-    if (have_free_connections()) {
-        // check if a new client is available
-        EthernetClient newClient = tcp_server->accept();
-        if (newClient) {
-            bool found = false;
-            for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
-                if (!clients[i]) {
-                    clients[i] = newClient;
-                    found = true;
-#ifdef LOG_VXI_DETAILS
-                    debugPort.print(F("New VXI connection on port "));
-                    debugPort.print((uint32_t)vxi_port);
-                    debugPort.print(F(" in slot "));
-                    debugPort.print(i);
-                    debugPort.print(F(" from remote port "));
-                    debugPort.println(newClient.remotePort());
-#endif
-                    break;
-                }
-            }
-            if (!found) {
-                // shouldn't happen, but still....
-#ifdef LOG_VXI_DETAILS
-                debugPort.print(F("VXI connection limit reached on port "));
-                debugPort.print((uint32_t)vxi_port);
-                debugPort.print(F(" from remote port "));
-                debugPort.println(newClient.remotePort());
-#endif
-                newClient.stop();
-            }
+    // pick up new connections on the ports handed out by the port mapper
+    for (int i = 0; i < MAX_VXI_CLIENTS; i++) {
+        if (listen_socks[i] != MAX_SOCK_NUM) {
+            accept_listener(i);
         }
     }
 
@@ -139,6 +375,8 @@ int VXI_Server::loop()
             // read the entire packet, blocking if needed. The packet is small in general, so should have arrived completely
             // TODO: make this work in a non blocking way, but then you'd need non-static memory buffers
             uint32_t len = get_vxi_packet(clients[i]);
+            is_locked(i);  // a lock that expired while the link was idle is not renewed by this request
+            last_activity[i] = millis();
 
             // do not handle overflow for now, let the protocol handle it, as there is checking on max_receive_size
             if (len != 0) {
@@ -148,7 +386,7 @@ int VXI_Server::loop()
             if (bClose) {
 #ifdef LOG_VXI_DETAILS
                 debugPort.print(F("Closing VXI connection on port "));
-                debugPort.print((uint32_t)vxi_port);
+                debugPort.print((uint32_t)ports[i]);
                 debugPort.print(F(" of slot "));
                 debugPort.print(i);
                 debugPort.print(F(" from remote port "));
@@ -167,6 +405,7 @@ void VXI_Server::killClients(void)
         if (clients[i]) {
             clients[i].stop();
         }
+        release_listener(i);
     }
 }
 
@@ -181,6 +420,10 @@ bool VXI_Server::handle_packet(EthernetClient &client, int slot, bool overflow =
     bool bClose = false;
     uint32_t rc = rpc::SUCCESS;
 
+#ifdef USE_METRICS
+    metrics.countRpc(vxi_request->procedure);
+#endif
+
     if (vxi_request->program != rpc::VXI_11_CORE) {
         rc = rpc::PROG_UNAVAIL;
 
@@ -195,7 +438,7 @@ bool VXI_Server::handle_packet(EthernetClient &client, int slot, bool overflow =
 #ifdef LOG_VXI_DETAILS
         debugPort.print(F("ERROR: Buffer overflow on inbound VXI packet\n"));
 #endif
-    } else {
+    } else if (!locked_out(client, slot)) {
         switch (vxi_request->procedure) {
             case rpc::VXI_11_CREATE_LINK:
                 create_link(client, slot);
@@ -211,15 +454,27 @@ bool VXI_Server::handle_packet(EthernetClient &client, int slot, bool overflow =
                 bClose = true;
                 break;
             case rpc::VXI_11_DEV_READSTB:
-                if (!readstb(client, slot)) {
-                    rc = rpc::PROC_UNAVAIL;
-                }
+                readstb(client, slot);
+                break;
+            case rpc::VXI_11_DEV_TRIGGER:
+            case rpc::VXI_11_DEV_REMOTE:
+            case rpc::VXI_11_DEV_LOCAL:
+                generic(client, slot);
                 break;
             case rpc::VXI_11_DEV_CLEAR:
                 if (!devclear(client, slot)) {
                     rc = rpc::PROC_UNAVAIL;
                 }
                 break;
+            case rpc::VXI_11_DEV_DOCMD:
+                docmd(client, slot);
+                break;
+            case rpc::VXI_11_DEV_LOCK:
+                lock(client, slot);
+                break;
+            case rpc::VXI_11_DEV_UNLOCK:
+                unlock(client, slot);
+                break;
             default:
                 rc = rpc::PROC_UNAVAIL;
                 break;
@@ -283,7 +538,7 @@ void VXI_Server::create_link(EthernetClient &client, int slot)
     debugPort.print(F("CREATE LINK request from "));
     printBuf(create_request->data, len);
     debugPort.print(F(" on port "));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F(" -> LID="));
     debugPort.print(slot);
     debugPort.println();
@@ -342,13 +597,14 @@ void VXI_Server::destroy_link(EthernetClient &client, int slot)
     debugPort.print(F("DESTROY LINK slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.println();        
 #endif
     memset(destroy_response, 0, sizeof(destroy_response_packet));
     destroy_response->rpc_status = rpc::SUCCESS;
     destroy_response->error = rpc::NO_ERROR;
     send_vxi_packet(client, sizeof(destroy_response_packet));
+    locked[slot] = false;
     scpi_handler.release_control();
 }
 
@@ -358,14 +614,15 @@ void VXI_Server::read(EthernetClient &client, int slot)
     
     // Use of shared memory zones:
     // read_request points to the static buffer vxi_read_buffer
-    // read_response points to the static buffer vxi_send_buffer
+    // read_response points to the static buffer vxi_send_buffer, but only for the header.
+    // The data goes straight to the TX buffer of the W5500, see vxiTxStream
 
 #ifdef LOG_VXI_DETAILS
     char buffer[16];
     debugPort.print(F("READ DATA Call slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; LID="));
@@ -390,10 +647,14 @@ void VXI_Server::read(EthernetClient &client, int slot)
         max_len = request_len;
     }
 
-    memset(read_response, 0, sizeof(read_response_packet));
+    // reserve the room for the header and the data in the TX buffer of the W5500
+    if (!begin_vxi_scatter(client, sizeof(read_response_packet), max_len)) {
+        return; // connection is gone, nobody to reply to
+    }
     // If I surpass my max size, I just cut off and the client will have to issue another read 
-    vxiBufStream vxiStream(read_response->data, max_len);  ///< using the static buffer's data area
+    vxiTxStream vxiStream(client, max_len);
     SCPI_handler_read_stop_reasons rv = scpi_handler.read(addresses[slot], vxiStream, max_len, read_request->io_timeout);
+    vxiStream.flush();
     // FIXME handle error codes, maybe even pick up errors from the SCPI Parser
 
     read_response->rpc_status = rpc::SUCCESS;
@@ -415,7 +676,7 @@ void VXI_Server::read(EthernetClient &client, int slot)
     debugPort.print(F("READ DATA Reply slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; max_len="));
@@ -427,12 +688,12 @@ void VXI_Server::read(EthernetClient &client, int slot)
     debugPort.print(F("; Reason="));
     sprintf(buffer, "0x%08X", (uint32_t)read_response->reason);
     debugPort.print(buffer);
-    debugPort.print(F("; Data="));
-    printBuf(read_response->data, (int)vxiStream.len());
+    debugPort.print(F("; Data_Len="));
+    debugPort.print((uint32_t)vxiStream.len());
     debugPort.println();
 #endif
 
-    send_vxi_packet(client, sizeof(read_response_packet) + read_response->data_len);
+    send_vxi_scatter(client);
 }
 
 void VXI_Server::write(EthernetClient &client, int slot)
@@ -467,7 +728,7 @@ void VXI_Server::write(EthernetClient &client, int slot)
     debugPort.print(F("WRITE DATA Call slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; LID="));
@@ -501,7 +762,7 @@ void VXI_Server::write(EthernetClient &client, int slot)
     debugPort.print(F("WRITE DATA Reply slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; Error_Code="));
@@ -514,7 +775,7 @@ void VXI_Server::write(EthernetClient &client, int slot)
     send_vxi_packet(client, sizeof(write_response_packet));
 }
 
-bool VXI_Server::readstb(EthernetClient &client, int slot)
+void VXI_Server::readstb(EthernetClient &client, int slot)
 {
     // This is where we read the status byte from the device
     
@@ -522,14 +783,12 @@ bool VXI_Server::readstb(EthernetClient &client, int slot)
     // readstb_request points to the static buffer vxi_read_buffer
     // readstb_response points to the static buffer vxi_send_buffer
 
-    // Will return False when the device does not support the request
-
 #ifdef LOG_VXI_DETAILS
     char buffer[16];
     debugPort.print(F("READSTB DATA Call slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; LID="));
@@ -543,19 +802,17 @@ bool VXI_Server::readstb(EthernetClient &client, int slot)
     debugPort.println((uint32_t)readstb_request->lock_timeout);
 #endif
 
+    uint8_t stb = 0;
+    SCPI_handler_read_stop_reasons rv = scpi_handler.read_stb(addresses[slot], stb, readstb_request->io_timeout);
     readstb_response->rpc_status = rpc::SUCCESS;
-    readstb_response->error = rpc::NO_ERROR;
-    readstb_response->status = scpi_handler.read_stb(addresses[slot], readstb_request->io_timeout);
-    if (readstb_response->status == 0xFF) {
-        // invalid status byte, probably not implemented
-        return false;
-    }   
+    readstb_response->error = rv == SRS_NONE ? rpc::NO_ERROR : rpc::IO_TIMEOUT;
+    readstb_response->status = stb;
 
 #ifdef LOG_VXI_DETAILS
     debugPort.print(F("READSTB Reply slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; Error_Code="));
@@ -566,7 +823,62 @@ bool VXI_Server::readstb(EthernetClient &client, int slot)
 #endif
 
     send_vxi_packet(client, sizeof(readstb_response_packet));
-    return true;
+}
+
+void VXI_Server::generic(EthernetClient &client, int slot)
+{
+    // This is where we trigger the device, or put it in remote or local
+
+    // Use of shared memory zones:
+    // generic_request points to the static buffer vxi_read_buffer
+    // generic_response points to the static buffer vxi_send_buffer
+
+    uint32_t procedure = generic_request->procedure;
+
+#ifdef LOG_VXI_DETAILS
+    char buffer[16];
+    debugPort.print(procedure == rpc::VXI_11_DEV_TRIGGER ? F("TRIGGER") : procedure == rpc::VXI_11_DEV_REMOTE ? F("REMOTE") : F("LOCAL"));
+    debugPort.print(F(" Call slot="));
+    debugPort.print(slot);
+    debugPort.print(F("; port="));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F("; gpib_address="));
+    debugPort.print(addresses[slot]);
+    debugPort.print(F("; LID="));
+    debugPort.print((uint32_t)generic_request->link_id);
+    debugPort.print(F("; Flags="));
+    sprintf(buffer, "0x%08X", (uint32_t)generic_request->flags);
+    debugPort.print(buffer);
+    debugPort.print(F("; I/O_Timeout="));
+    debugPort.print((uint32_t)generic_request->io_timeout);
+    debugPort.print(F("; Lock_Timeout="));
+    debugPort.println((uint32_t)generic_request->lock_timeout);
+#endif
+
+    SCPI_handler_read_stop_reasons rv;
+    if (procedure == rpc::VXI_11_DEV_TRIGGER) {
+        rv = scpi_handler.trigger(addresses[slot], generic_request->io_timeout);
+    } else if (procedure == rpc::VXI_11_DEV_REMOTE) {
+        rv = scpi_handler.remote(addresses[slot], generic_request->io_timeout);
+    } else {
+        rv = scpi_handler.local(addresses[slot], generic_request->io_timeout);
+    }
+    generic_response->rpc_status = rpc::SUCCESS;
+    generic_response->error = rv == SRS_NONE ? rpc::NO_ERROR : rpc::IO_TIMEOUT;
+
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("GENERIC Reply slot="));
+    debugPort.print(slot);
+    debugPort.print(F("; port="));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F("; gpib_address="));
+    debugPort.print(addresses[slot]);
+    debugPort.print(F("; Error_Code="));
+    debugPort.print((uint32_t)generic_response->error);
+    debugPort.println();
+#endif
+
+    send_vxi_packet(client, sizeof(generic_response_packet));
 }
 
 bool VXI_Server::devclear(EthernetClient &client, int slot)
@@ -584,7 +896,7 @@ bool VXI_Server::devclear(EthernetClient &client, int slot)
     debugPort.print(F("CLEAR DATA Call slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; LID="));
@@ -605,7 +917,7 @@ bool VXI_Server::devclear(EthernetClient &client, int slot)
     debugPort.print(F("CLEAR Reply slot="));
     debugPort.print(slot);
     debugPort.print(F("; port="));
-    debugPort.print((uint32_t)vxi_port);
+    debugPort.print((uint32_t)ports[slot]);
     debugPort.print(F("; gpib_address="));
     debugPort.print(addresses[slot]);
     debugPort.print(F("; Error_Code="));
@@ -617,6 +929,218 @@ bool VXI_Server::devclear(EthernetClient &client, int slot)
     return true;
 }
 
+void VXI_Server::lock(EthernetClient &client, int slot)
+{
+    // This is where a link locks its device, which also protects the link against eviction.
+    // The lock lasts until unlock or destroy_link, or until the link has been idle for VXI11_LOCK_TIMEOUT.
+    // There is no waiting for the lock: the server is blocking, so no other link could release it meanwhile.
+
+    // Use of shared memory zones:
+    // lock_request points to the static buffer vxi_read_buffer
+    // generic_response points to the static buffer vxi_send_buffer
+
+    uint32_t error = rpc::NO_ERROR;
+    if (is_locked(slot) || lock_holder(slot) >= 0) {
+        error = rpc::DEVICE_LOCKED;  // as per VXI-11, also when the lock is held by this link
+    }
+    if (error == rpc::NO_ERROR) {
+        locked[slot] = true;
+    }
+
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("LOCK slot="));
+    debugPort.print(slot);
+    debugPort.print(F("; port="));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F("; gpib_address="));
+    debugPort.print(addresses[slot]);
+    debugPort.print(F("; Lock_Timeout="));
+    debugPort.print((uint32_t)lock_request->lock_timeout);
+    debugPort.print(F("; Error_Code="));
+    debugPort.println(error);
+#endif
+
+    generic_response->rpc_status = rpc::SUCCESS;
+    generic_response->error = error;
+    send_vxi_packet(client, sizeof(generic_response_packet));
+}
+
+void VXI_Server::unlock(EthernetClient &client, int slot)
+{
+    // Use of shared memory zones:
+    // generic_response points to the static buffer vxi_send_buffer
+
+    uint32_t error = is_locked(slot) ? rpc::NO_ERROR : rpc::NO_LOCK_HELD;
+    locked[slot] = false;
+
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("UNLOCK slot="));
+    debugPort.print(slot);
+    debugPort.print(F("; port="));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F("; Error_Code="));
+    debugPort.println(error);
+#endif
+
+    generic_response->rpc_status = rpc::SUCCESS;
+    generic_response->error = error;
+    send_vxi_packet(client, sizeof(generic_response_packet));
+}
+
+/**
+ * @brief Get a data element of a docmd request, in the byte order given by the request.
+ */
+static uint32_t docmd_get_value(const uint8_t *data, uint32_t datasize, bool network_order)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < datasize; i++) {
+        value = (value << 8) | (network_order ? data[i] : data[datasize - 1 - i]);
+    }
+    return value;
+}
+
+/**
+ * @brief Store a data element for a docmd response, in the byte order given by the request.
+ */
+static void docmd_put_value(uint8_t *data, uint32_t datasize, bool network_order, uint32_t value)
+{
+    for (uint32_t i = 0; i < datasize; i++) {
+        data[network_order ? datasize - 1 - i : i] = (uint8_t)(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+void VXI_Server::docmd(EthernetClient &client, int slot)
+{
+    // This is where we execute the GPIB specific commands of VXI-11.2 on the bus
+
+    // Use of shared memory zones:
+    // docmd_request points to the static buffer vxi_read_buffer
+    // docmd_response points to the static buffer vxi_send_buffer, but only for the header.
+    // The data goes straight to the TX buffer of the W5500, see begin_vxi_scatter()
+
+    uint32_t cmd = docmd_request->cmd;
+    uint32_t datasize = docmd_request->datasize;
+    bool network_order = (uint32_t)docmd_request->network_order != 0;
+    uint32_t len = docmd_request->data_len;
+    if (len > MAX_DOCMD_REQUEST_DATA_SIZE) {
+        len = MAX_DOCMD_REQUEST_DATA_SIZE; // I do not have more than that. The input buffer will have been truncated before.
+    }
+
+#ifdef LOG_VXI_DETAILS
+    char buffer[16];
+    debugPort.print(F("DOCMD Call slot="));
+    debugPort.print(slot);
+    debugPort.print(F("; port="));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F("; gpib_address="));
+    debugPort.print(addresses[slot]);
+    debugPort.print(F("; LID="));
+    debugPort.print((uint32_t)docmd_request->link_id);
+    debugPort.print(F("; Cmd="));
+    sprintf(buffer, "0x%06lX", (unsigned long)cmd);
+    debugPort.print(buffer);
+    debugPort.print(F("; Datasize="));
+    debugPort.print(datasize);
+    debugPort.print(F("; Data_Len="));
+    debugPort.println(len);
+#endif
+
+    uint32_t error = rpc::NO_ERROR;
+    const uint8_t *data_out = NULL;  // data to return, either the echo of the request, or the value below
+    uint32_t data_out_len = 0;
+    uint8_t value_out[4];
+    SCPI_handler_read_stop_reasons rv = SRS_NONE;
+
+    if (addresses[slot] != 0) {
+        // the bus commands are only valid on the interface link (gpib0 or inst0), not on a device link
+        error = rpc::INVALID_OPERATION;
+    } else if (cmd == rpc::DOCMD_SEND_COMMAND) {
+        if (datasize != 1) {
+            error = rpc::PARAMETER_ERROR;
+        } else {
+            rv = scpi_handler.send_command(docmd_request->data, len, docmd_request->io_timeout);
+            // the reply echoes the command bytes
+            data_out = docmd_request->data;
+            data_out_len = len;
+        }
+    } else if (cmd == rpc::DOCMD_IFC_CONTROL) {
+        rv = scpi_handler.bus_control(BC_IFC, 1, docmd_request->io_timeout);
+    } else if (cmd == rpc::DOCMD_BUS_STATUS || cmd == rpc::DOCMD_ATN_CONTROL || cmd == rpc::DOCMD_REN_CONTROL) {
+        // these take and return a short
+        if (datasize != 2 || len < 2) {
+            error = rpc::PARAMETER_ERROR;
+        } else {
+            uint32_t value = docmd_get_value(docmd_request->data, 2, network_order);
+            if (cmd == rpc::DOCMD_BUS_STATUS) {
+                int status = -1;
+                if (value >= BS_REMOTE && value <= BS_BUS_ADDRESS) {
+                    status = scpi_handler.bus_status((SCPI_handler_bus_status)value);
+                }
+                if (status < 0) {
+                    error = rpc::PARAMETER_ERROR;
+                } else {
+                    value = (uint32_t)status;
+                }
+            } else {
+                rv = scpi_handler.bus_control(cmd == rpc::DOCMD_ATN_CONTROL ? BC_ATN : BC_REN, value != 0, docmd_request->io_timeout);
+            }
+            docmd_put_value(value_out, 2, network_order, value);
+            data_out = value_out;
+            data_out_len = 2;
+        }
+    } else if (cmd == rpc::DOCMD_PASS_CONTROL || cmd == rpc::DOCMD_BUS_ADDRESS) {
+        // these take and return a long
+        if (datasize != 4 || len < 4) {
+            error = rpc::PARAMETER_ERROR;
+        } else {
+            uint32_t value = docmd_get_value(docmd_request->data, 4, network_order);
+            if (value > 30) {
+                error = rpc::PARAMETER_ERROR;
+            } else {
+                rv = scpi_handler.bus_control(cmd == rpc::DOCMD_PASS_CONTROL ? BC_PASS_CONTROL : BC_BUS_ADDRESS, value, docmd_request->io_timeout);
+            }
+            docmd_put_value(value_out, 4, network_order, value);
+            data_out = value_out;
+            data_out_len = 4;
+        }
+    } else {
+        error = rpc::INVALID_OPERATION; // "operation not supported"
+    }
+
+    if (error == rpc::NO_ERROR) {
+        if (rv == SRS_TIMEOUT) {
+            error = rpc::IO_TIMEOUT;
+        } else if (rv == SRS_ERROR) {
+            error = rpc::PARAMETER_ERROR;
+        }
+    }
+    if (error != rpc::NO_ERROR) {
+        data_out_len = 0;
+    }
+
+    if (!begin_vxi_scatter(client, sizeof(docmd_response_packet), data_out_len)) {
+        return; // connection is gone, nobody to reply to
+    }
+    append_vxi_scatter(client, data_out, data_out_len);
+    docmd_response->rpc_status = rpc::SUCCESS;
+    docmd_response->error = error;
+    docmd_response->data_len = data_out_len;
+
+#ifdef LOG_VXI_DETAILS
+    debugPort.print(F("DOCMD Reply slot="));
+    debugPort.print(slot);
+    debugPort.print(F("; port="));
+    debugPort.print((uint32_t)ports[slot]);
+    debugPort.print(F("; Error_Code="));
+    debugPort.print(error);
+    debugPort.print(F("; Data_Len="));
+    debugPort.println(data_out_len);
+#endif
+
+    send_vxi_scatter(client);
+}
+
 // const char *VXI_Server::get_visa_resource()
 // {
 //     static char visa_resource[40];
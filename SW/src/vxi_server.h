@@ -6,17 +6,23 @@
 #include "rpc_packets.h"
 
 /**
- * @brief a helper class to capture data from the instruments, and send it through to the VXI buffers.
- * This class only supports basic write operations (for now)
+ * @brief a helper class to capture data from the instruments, and send it through to the VXI client.
+ * The data is collected per VXI_SCATTER_CHUNK_SIZE bytes, and written straight into the socket TX buffer
+ * of the W5500 (see begin_vxi_scatter()), so a read response never needs a full copy in SRAM.
+ * This class only supports basic write operations.
  */
-class vxiBufStream : public Stream {
+class vxiTxStream : public Stream {
    public:
-    vxiBufStream(char *buf, size_t size) : buffer(buf), bufferSize(size) {}
+    vxiTxStream(EthernetClient &tcp, size_t size) : client(tcp), bufferSize(size) {}
 
     size_t write(uint8_t ch) override {
         // debugPort.print((char)ch);
-        if (buffer_pos < bufferSize) {
-            buffer[buffer_pos++] = ch;
+        if (data_len < bufferSize) {
+            chunk[chunk_pos++] = ch;
+            data_len++;
+            if (chunk_pos == VXI_SCATTER_CHUNK_SIZE) {
+                flush();
+            }
             return 1;
         }
         _had_overflow = true;
@@ -40,17 +46,20 @@ class vxiBufStream : public Stream {
     int peek() { return 0; }       // dummy
     bool had_overflow() { return _had_overflow; }
 
-    size_t len(void) { return buffer_pos; }
+    size_t len(void) { return data_len; }
 
-    // flush is not used
+    // move the collected chunk to the W5500
     void flush() {
-      buffer_pos = 0;  // clear the buffer
+        append_vxi_scatter(client, chunk, chunk_pos);
+        chunk_pos = 0;
     }
 
    private:
-    char *buffer;
+    EthernetClient &client;
+    uint8_t *const chunk = vxi_response_packet_buffer + sizeof(read_response_packet);  ///< behind the read response header
     size_t bufferSize;
-    size_t buffer_pos = 0;
+    size_t data_len = 0;
+    uint8_t chunk_pos = 0;
     bool _had_overflow = false;
 };
 
@@ -63,6 +72,27 @@ enum SCPI_handler_read_stop_reasons {
     SRS_ERROR
 };
 
+// The states of the bus that can be requested, numbered as in VXI-11.2 device_docmd "bus status"
+enum SCPI_handler_bus_status {
+    BS_REMOTE = 1,
+    BS_SRQ,
+    BS_NDAC,
+    BS_SYSTEM_CONTROLLER,
+    BS_CONTROLLER_IN_CHARGE,
+    BS_TALKER,
+    BS_LISTENER,
+    BS_BUS_ADDRESS
+};
+
+// The bus controls that can be operated directly
+enum SCPI_handler_bus_control {
+    BC_ATN = 0,
+    BC_REN,
+    BC_PASS_CONTROL,
+    BC_BUS_ADDRESS,
+    BC_IFC
+};
+
 #ifdef LOG_VXI_DETAILS
 inline const char* SCPI_handler_read_stop_reasons_to_string(SCPI_handler_read_stop_reasons reason) {
     switch (reason) {
@@ -96,13 +126,31 @@ class SCPI_handler_interface
     virtual SCPI_handler_read_stop_reasons write(int address, const char *data, size_t len, bool is_end = true, uint32_t io_timeout = 1200) = 0;
 
     // read a response from the SCPI parser or device and write to a Stream
-    virtual SCPI_handler_read_stop_reasons read(int address, vxiBufStream &dataStream, size_t max_size, uint32_t io_timeout = 1200) = 0;
+    virtual SCPI_handler_read_stop_reasons read(int address, Stream &dataStream, size_t max_size, uint32_t io_timeout = 1200) = 0;
+
+    // read the status byte from the device (serial poll)
+    virtual SCPI_handler_read_stop_reasons read_stb(int address, uint8_t &stb, uint32_t io_timeout = 1200) = 0;
 
-    // read the status byte from the device
-    virtual uint8_t read_stb(int address, uint32_t io_timeout = 1200) = 0;
+    // trigger the device (GET)
+    virtual SCPI_handler_read_stop_reasons trigger(int address, uint32_t io_timeout = 1200) = 0;
+
+    // put the device in remote (REN asserted and addressed to listen)
+    virtual SCPI_handler_read_stop_reasons remote(int address, uint32_t io_timeout = 1200) = 0;
+
+    // return the device to local (GTL)
+    virtual SCPI_handler_read_stop_reasons local(int address, uint32_t io_timeout = 1200) = 0;
 
     // clear the device
     virtual SCPI_handler_read_stop_reasons devclear(int address, uint32_t io_timeout = 1200) = 0;
+
+    // send raw command bytes to the bus, with ATN asserted
+    virtual SCPI_handler_read_stop_reasons send_command(const uint8_t *data, size_t len, uint32_t io_timeout = 1200) = 0;
+
+    // return the state of the bus, or -1 if not supported
+    virtual int bus_status(SCPI_handler_bus_status what) = 0;
+
+    // operate a bus control line or setting. Value is the new state, or the address for BC_PASS_CONTROL and BC_BUS_ADDRESS
+    virtual SCPI_handler_read_stop_reasons bus_control(SCPI_handler_bus_control what, uint32_t value, uint32_t io_timeout = 1200) = 0;
     
     // claim_control() should return true if the SCPI parser is ready to accept a command
     virtual bool claim_control() = 0;
@@ -126,18 +174,18 @@ class VXI_Server
 
   public:
     VXI_Server(SCPI_handler_interface &scpi_handler);
-    // VXI_Server(SCPI_handler_interface &scpi_handler, uint32_t port_min, uint32_t port_max);
-    // VXI_Server(SCPI_handler_interface &scpi_handler, uint32_t port);
     ~VXI_Server();
 
     int loop();
-    void begin(uint32_t port);
+    void begin(uint32_t port_start, uint32_t port_end);
     int nr_connections(void);
     bool have_free_connections(void);
     void killClients(void);
+    uint16_t nr_evictions(void) { return evictions; }
+    uint16_t nr_evictions_refused(void) { return evictions_refused; }
+    void set_socket_reclaimer(bool (*reclaimer)(void)) { reclaim_socket = reclaimer; }
 
     uint32_t allocate();
-    uint32_t port() { return vxi_port; }
     // const char *get_visa_resource();
     // std::list<IPAddress> get_connected_clients();
     // void disconnect_client(const IPAddress &ip);
@@ -147,17 +195,39 @@ class VXI_Server
     void destroy_link(EthernetClient &tcp, int slot);
     void read(EthernetClient &tcp, int slot);
     void write(EthernetClient &tcp, int slot);
-    bool readstb(EthernetClient &tcp, int slot);
+    void readstb(EthernetClient &tcp, int slot);
+    void generic(EthernetClient &tcp, int slot);
     bool devclear(EthernetClient &tcp, int slot);
+    void docmd(EthernetClient &tcp, int slot);
+    void lock(EthernetClient &tcp, int slot);
+    void unlock(EthernetClient &tcp, int slot);
     bool handle_packet(EthernetClient &tcp, int slot, bool overflow = false);
     void parse_scpi(char *buffer);
+    bool port_in_use(uint16_t port);
+    void accept_listener(int slot);
+    void release_listener(int slot);
+    int free_slot(void);
+    int idle_slot(void);
+    bool evict_idle_link(void);
+    bool is_locked(int slot);
+    int lock_holder(int slot);
+    bool locked_out(EthernetClient &tcp, int slot);
 
-    EthernetServer *tcp_server;
     EthernetClient clients[MAX_VXI_CLIENTS];
     uint8_t addresses[MAX_VXI_CLIENTS];
+    uint16_t ports[MAX_VXI_CLIENTS];               ///< The port handed out to the link in this slot
+    uint8_t listen_socks[MAX_VXI_CLIENTS];         ///< W5500 socket listening for the link in this slot, MAX_SOCK_NUM if none
+    unsigned long listen_since[MAX_VXI_CLIENTS];   ///< When the port was handed out, to release it if no client shows up
+    unsigned long last_activity[MAX_VXI_CLIENTS];  ///< Last request on the link in this slot, to evict the least recently used idle link
+    bool locked[MAX_VXI_CLIENTS];                  ///< The link in this slot holds a device_lock, and is never evicted, see is_locked()
+    uint16_t evictions;                            ///< Number of idle links closed to make room for a new link
+    uint16_t evictions_refused;                    ///< Number of new links refused because no slot or socket could be freed
+    bool (*reclaim_socket)(void);                  ///< Frees a socket of another server for a new link, see set_socket_reclaimer()
+    uint32_t port_start;                           ///< First port handed out to the links, see begin()
+    uint32_t port_end;                             ///< Last port handed out to the links
+    cyclic_uint32_t next_port;
     Read_Type read_type;
     uint32_t rw_channel;
-    uint32_t vxi_port;
     SCPI_handler_interface &scpi_handler;
 };
 
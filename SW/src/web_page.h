@@ -0,0 +1,153 @@
+#pragma once
+
+/*!
+  @file   web_page.h
+  @brief  The page of the web server, gzip compressed, in PROGMEM.
+
+  GENERATED by tools/gen_web_page.py from web/index.html, do not edit: change the page and rebuild.
+  5325 bytes, 2204 bytes compressed.
+*/
+
+#define WEB_PAGE_SIZE 2204  ///< Size of webPage[]
+#define WEB_PAGE_ETAG "\"210cb58e\""  ///< ETag of the page, quotes included
+
+static const uint8_t webPage[WEB_PAGE_SIZE] PROGMEM = {
+  0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xBD, 0x58, 0xDF, 0x73, 0xE3, 0xB6,
+  0x11, 0x7E, 0xD7, 0x5F, 0x81, 0xC3, 0x4D, 0x6C, 0xAA, 0xB1, 0x28, 0xD9, 0x49, 0x6F, 0x3C, 0x94,
+  0x44, 0xCF, 0xD5, 0xE7, 0x34, 0x9E, 0xB9, 0xDC, 0xB9, 0x96, 0x93, 0x36, 0xD3, 0xF6, 0x01, 0x22,
+  0x21, 0x8B, 0x35, 0x49, 0x30, 0x00, 0x68, 0x59, 0xCD, 0xF9, 0x7F, 0xEF, 0xB7, 0x00, 0x29, 0x51,
+  0xB6, 0x7C, 0xE3, 0xF6, 0xA1, 0x7E, 0x90, 0x04, 0x60, 0x7F, 0xEF, 0xB7, 0x8B, 0x85, 0x27, 0x6F,
+  0x3E, 0x7C, 0x3E, 0xBF, 0xF9, 0xF5, 0xEA, 0x82, 0x2D, 0x6D, 0x91, 0xC7, 0xBD, 0x09, 0x7D, 0xB1,
+  0x5C, 0x94, 0xB7, 0x53, 0x2E, 0x4B, 0x4E, 0x1B, 0x52, 0xA4, 0xF8, 0x2A, 0xA4, 0x15, 0x2C, 0x59,
+  0x0A, 0x6D, 0xA4, 0x9D, 0xF2, 0x9F, 0x6F, 0x7E, 0x18, 0x9C, 0x72, 0x36, 0x6C, 0x0F, 0x4A, 0x51,
+  0xC8, 0x29, 0xBF, 0xCF, 0xE4, 0xAA, 0x52, 0xDA, 0x72, 0x96, 0xA8, 0xD2, 0xCA, 0x12, 0x84, 0xAB,
+  0x2C, 0xB5, 0xCB, 0x69, 0x2A, 0xEF, 0xB3, 0x44, 0x0E, 0xDC, 0xE2, 0x88, 0x65, 0x65, 0x66, 0x33,
+  0x91, 0x0F, 0x4C, 0x22, 0x72, 0x39, 0x3D, 0x0E, 0x47, 0x5E, 0x90, 0xCD, 0x6C, 0x2E, 0xE3, 0x0B,
+  0xBB, 0x94, 0xBA, 0x94, 0xF6, 0xE4, 0xCF, 0x57, 0x97, 0x7F, 0x9A, 0x0C, 0xFD, 0x66, 0x6F, 0x62,
+  0xEC, 0x9A, 0xBE, 0xE7, 0x2A, 0x5D, 0xB3, 0xDF, 0xD9, 0x02, 0xE2, 0x07, 0x0B, 0x51, 0x64, 0xF9,
+  0x3A, 0x62, 0xEF, 0x35, 0x84, 0x1D, 0x31, 0x23, 0x4A, 0x33, 0x30, 0x52, 0x67, 0x8B, 0x31, 0x7B,
+  0xEC, 0x59, 0x31, 0xCF, 0x25, 0x28, 0xAD, 0x7C, 0xB0, 0x03, 0x91, 0x67, 0xB7, 0x65, 0xC4, 0x72,
+  0xB9, 0xB0, 0x63, 0x36, 0x57, 0x3A, 0x95, 0x7A, 0x90, 0xA8, 0x3C, 0x17, 0x95, 0x91, 0x11, 0x6B,
+  0x7F, 0x39, 0x36, 0x98, 0x67, 0x53, 0xF0, 0x55, 0x22, 0x4D, 0xB3, 0xF2, 0x36, 0x62, 0x27, 0xD5,
+  0x03, 0x3B, 0xAD, 0x1E, 0xC6, 0x6C, 0xB5, 0xCC, 0xAC, 0x1C, 0x98, 0x4A, 0x24, 0xE0, 0x29, 0xD5,
+  0x4A, 0x8B, 0x6A, 0xCC, 0xEE, 0xA5, 0xB6, 0x19, 0xDC, 0x68, 0x55, 0x58, 0x55, 0x79, 0x31, 0x5B,
+  0x11, 0x03, 0xEC, 0x45, 0x5E, 0xC4, 0x63, 0x6F, 0x5E, 0x5B, 0xAB, 0x4A, 0x1C, 0x16, 0x42, 0xDF,
+  0x66, 0x60, 0x18, 0x41, 0xFC, 0x09, 0x9D, 0xC1, 0x0A, 0xA5, 0x23, 0xAF, 0x05, 0x46, 0x8A, 0xE4,
+  0xEE, 0x56, 0xAB, 0xBA, 0x4C, 0x07, 0xCD, 0xC1, 0xDB, 0x77, 0xEF, 0xDE, 0x8D, 0x77, 0xCD, 0x3A,
+  0x76, 0x8C, 0x8D, 0x3F, 0x5A, 0xA4, 0x59, 0x6D, 0x22, 0xF6, 0xFD, 0x76, 0x2F, 0x62, 0xC7, 0xA0,
+  0x32, 0x2A, 0xCF, 0x52, 0xF6, 0xF6, 0xF4, 0xF4, 0x14, 0x4A, 0x6A, 0x6D, 0x48, 0x58, 0xA5, 0x32,
+  0xE4, 0x47, 0x3B, 0x53, 0x11, 0x20, 0xA1, 0xA5, 0x80, 0x4D, 0x2E, 0x3D, 0x60, 0x1A, 0x8D, 0xBE,
+  0xC1, 0x09, 0xD2, 0x54, 0xD5, 0xF6, 0xF9, 0xF6, 0xF2, 0x04, 0x7B, 0x8D, 0xD2, 0xB9, 0x82, 0x3B,
+  0x85, 0xB7, 0xC6, 0xEB, 0xB9, 0xD5, 0x72, 0x4D, 0x62, 0x27, 0xC3, 0x26, 0x63, 0x93, 0x61, 0x03,
+  0x20, 0x4A, 0x1D, 0xC1, 0xE9, 0x98, 0x65, 0xE9, 0x94, 0x03, 0x11, 0xFC, 0x69, 0xAE, 0x97, 0xC7,
+  0x38, 0xAF, 0xE2, 0x4F, 0x75, 0x31, 0x97, 0x9A, 0xA9, 0x05, 0x4B, 0xF2, 0x0C, 0x20, 0x22, 0x30,
+  0x95, 0x32, 0xB1, 0x99, 0x2A, 0xE1, 0xDF, 0x04, 0x19, 0x28, 0x9D, 0x88, 0xA4, 0x7C, 0xE0, 0xF1,
+  0x19, 0x14, 0x61, 0x23, 0x9E, 0x0C, 0x2B, 0x12, 0x7E, 0x12, 0xFF, 0xF2, 0xB7, 0xCB, 0xC1, 0xF1,
+  0xF1, 0x11, 0xFB, 0xE5, 0x72, 0xF6, 0xBE, 0xC3, 0xC9, 0x8C, 0xD5, 0x08, 0x9C, 0x81, 0x96, 0x13,
+  0xC2, 0x1A, 0xC1, 0x83, 0xBE, 0x75, 0x3C, 0xB1, 0x69, 0x7C, 0x0E, 0x3C, 0x69, 0xC0, 0x00, 0x31,
+  0x03, 0xE4, 0x52, 0xB7, 0x37, 0x99, 0xC7, 0x37, 0xE7, 0x57, 0x97, 0x57, 0x51, 0xE4, 0x55, 0x26,
+  0xB9, 0x30, 0x66, 0xCA, 0xB3, 0x8A, 0xC7, 0x8D, 0xCE, 0x28, 0xBA, 0xFC, 0x34, 0xBB, 0xB9, 0x9E,
+  0x0C, 0xE7, 0x31, 0x0B, 0xEA, 0x32, 0x97, 0xC6, 0xB0, 0xB5, 0xAA, 0xD9, 0x52, 0xDC, 0x4B, 0x86,
+  0x32, 0x61, 0x70, 0x8F, 0xA5, 0x72, 0x21, 0xEA, 0xDC, 0x22, 0x9A, 0xB0, 0xA0, 0x2E, 0xC8, 0x1F,
+  0xE4, 0x50, 0x13, 0xAD, 0x55, 0x08, 0x1A, 0xCA, 0x67, 0x09, 0xC3, 0x98, 0xCC, 0x8D, 0x04, 0x03,
+  0x14, 0x8D, 0xFA, 0xDE, 0x86, 0x21, 0x8C, 0xDB, 0x58, 0x78, 0xB9, 0x61, 0x37, 0xFF, 0x9D, 0x89,
+  0xB7, 0x55, 0x36, 0x3F, 0x9A, 0x64, 0xF1, 0xA7, 0xC9, 0x30, 0xDB, 0xB1, 0x58, 0x69, 0x06, 0xFE,
+  0x30, 0x0C, 0xA3, 0x88, 0x6C, 0xDB, 0x43, 0x72, 0x04, 0x34, 0x4A, 0x2D, 0x59, 0x7B, 0xC4, 0x32,
+  0x43, 0x2E, 0x65, 0x7A, 0xE3, 0x01, 0xE2, 0x4A, 0x3E, 0x52, 0xFA, 0xD8, 0xBC, 0x36, 0x2C, 0x38,
+  0x0E, 0xC3, 0xEF, 0x76, 0xED, 0x1F, 0xB6, 0xA1, 0x46, 0xDC, 0x2F, 0x09, 0x74, 0x02, 0xF9, 0x40,
+  0x7C, 0x2E, 0x3F, 0xEF, 0x4D, 0x05, 0xD5, 0x01, 0x59, 0x3E, 0xE5, 0xDF, 0xF1, 0x78, 0x26, 0xCB,
+  0x94, 0x69, 0x59, 0x28, 0x2B, 0x59, 0xA5, 0xD5, 0xAD, 0x16, 0x45, 0x41, 0xB1, 0x0A, 0x66, 0xF0,
+  0xBA, 0x0F, 0xD2, 0xA2, 0x10, 0x65, 0x6A, 0x18, 0x3E, 0xD8, 0x6F, 0x35, 0x4A, 0x5F, 0xBA, 0xA0,
+  0x92, 0x49, 0xDD, 0x70, 0xE3, 0x94, 0x3A, 0x93, 0xDB, 0x87, 0xD9, 0x15, 0x70, 0x04, 0x42, 0x2D,
+  0x6D, 0x0D, 0xF0, 0xA5, 0x6C, 0xBE, 0x7E, 0xC2, 0x11, 0x4E, 0xE6, 0x1A, 0x1D, 0xE9, 0x59, 0x16,
+  0x96, 0xDD, 0x2C, 0xE0, 0x60, 0x49, 0x7B, 0x5B, 0x83, 0x4F, 0x38, 0x70, 0xE4, 0x2C, 0xF2, 0x67,
+  0x1B, 0xCE, 0x1E, 0xF9, 0xA5, 0xD5, 0xCA, 0x93, 0x7D, 0x8F, 0xE4, 0x18, 0x99, 0x03, 0x96, 0x0E,
+  0xC5, 0xA4, 0x96, 0x33, 0x93, 0xFD, 0x5B, 0xD2, 0x11, 0x73, 0x55, 0xD3, 0xB4, 0x4D, 0x74, 0x8D,
+  0x64, 0x39, 0x66, 0x0A, 0x4D, 0x66, 0x91, 0xAB, 0xD5, 0x00, 0xBD, 0x4E, 0xD4, 0x56, 0x8D, 0x5D,
+  0x76, 0x9D, 0x84, 0xB8, 0xB1, 0xB4, 0x69, 0x2B, 0xAA, 0x44, 0xC5, 0x24, 0x77, 0x53, 0xBE, 0xC8,
+  0xCA, 0x34, 0x58, 0x08, 0x40, 0xAA, 0xCF, 0xE3, 0x1F, 0x32, 0xB2, 0xC8, 0x93, 0x7C, 0x95, 0x01,
+  0xAE, 0x81, 0xBE, 0x35, 0x61, 0x4F, 0x0B, 0xA2, 0x1E, 0xC2, 0xE3, 0x6B, 0x89, 0xC6, 0x5D, 0x6E,
+  0x25, 0x52, 0x98, 0x9C, 0x8B, 0xBE, 0xD7, 0xF3, 0xD3, 0xD1, 0x37, 0xB0, 0xD0, 0x77, 0x0F, 0xBB,
+  0xAE, 0x20, 0x8A, 0x7A, 0x0C, 0xF7, 0x35, 0x5B, 0xA4, 0x9C, 0xDD, 0x8B, 0xBC, 0xC6, 0x2E, 0x6F,
+  0x63, 0xDC, 0xF3, 0x58, 0x7E, 0x62, 0x12, 0x3C, 0x5C, 0x84, 0xA0, 0x0F, 0x3D, 0xB9, 0x5B, 0x56,
+  0x5A, 0xFA, 0x25, 0x8F, 0x0F, 0x72, 0x3B, 0xDE, 0xD8, 0xD0, 0xEB, 0x46, 0x14, 0x44, 0x74, 0x6F,
+  0xA9, 0xCA, 0xD5, 0x7D, 0xA3, 0xEC, 0x0F, 0x97, 0x1F, 0x3E, 0x9D, 0xF1, 0xD8, 0x7D, 0x4D, 0x86,
+  0xFE, 0xEC, 0x39, 0xD1, 0xF5, 0xEC, 0x06, 0x34, 0xF8, 0x7C, 0x99, 0xE4, 0xF3, 0xD5, 0x39, 0xC9,
+  0xA1, 0xAF, 0x97, 0x89, 0xCE, 0x3F, 0xCE, 0x40, 0x83, 0xCF, 0x17, 0x49, 0xA2, 0xD9, 0xAF, 0xB3,
+  0x1B, 0x59, 0x44, 0x17, 0xD7, 0xD7, 0x4A, 0x43, 0xE0, 0xEE, 0xBA, 0xC3, 0xD6, 0x66, 0xBA, 0xD7,
+  0x84, 0xAA, 0xDB, 0x15, 0x76, 0xB0, 0xD7, 0x6B, 0x23, 0x48, 0x31, 0x90, 0x0F, 0x7C, 0x1B, 0x49,
+  0xF9, 0x10, 0x8C, 0x80, 0x83, 0xBF, 0xA0, 0x42, 0xD6, 0xDB, 0x90, 0x1D, 0x94, 0x73, 0x53, 0x8D,
+  0xFD, 0xE7, 0xB3, 0xE0, 0x83, 0xE5, 0xF8, 0x15, 0x50, 0xA0, 0x02, 0xED, 0x24, 0x61, 0x8F, 0x94,
+  0x93, 0x57, 0x01, 0x4A, 0xA4, 0x5F, 0xB7, 0x8B, 0x5C, 0x2A, 0x54, 0xD9, 0xF1, 0x09, 0xAB, 0xCC,
+  0x2A, 0x1D, 0xBC, 0x42, 0xFC, 0x4F, 0x9E, 0x74, 0xAB, 0x41, 0xA2, 0xA0, 0xD6, 0x6C, 0x07, 0xA1,
+  0xA5, 0xBB, 0x73, 0x3C, 0x46, 0x2B, 0xFA, 0x81, 0x3E, 0x33, 0xE5, 0xB8, 0xF2, 0x36, 0x68, 0xC5,
+  0xEF, 0xD1, 0xBE, 0xF2, 0x24, 0x14, 0xB3, 0x82, 0x2E, 0xA6, 0xB9, 0xE3, 0x06, 0x39, 0xD5, 0xE7,
+  0xBC, 0x49, 0xD8, 0x4E, 0xFF, 0xD8, 0xC9, 0xD7, 0x8F, 0x99, 0x81, 0x55, 0xEB, 0x27, 0xBD, 0xE2,
+  0x69, 0x56, 0x27, 0x9B, 0xFB, 0x99, 0x84, 0xC3, 0x30, 0xEA, 0x23, 0x64, 0x0D, 0x77, 0x64, 0x54,
+  0x6D, 0xD8, 0x43, 0x00, 0x55, 0x99, 0xAF, 0x49, 0x4E, 0x43, 0xDE, 0x14, 0x7A, 0x6F, 0x7F, 0x59,
+  0xE9, 0xA6, 0xA8, 0x0E, 0x0F, 0xC7, 0xCC, 0x24, 0x74, 0xF3, 0x21, 0x90, 0xF1, 0x79, 0x2E, 0x85,
+  0x66, 0xCB, 0xD6, 0xAE, 0x6E, 0x7D, 0x3F, 0x6D, 0xE6, 0x60, 0xCA, 0x2A, 0x80, 0x72, 0x51, 0x97,
+  0xFE, 0x7A, 0xC5, 0x14, 0x74, 0x17, 0xF4, 0xD9, 0xEF, 0xBD, 0x85, 0xB4, 0xC9, 0x32, 0xE0, 0xC3,
+  0xAC, 0x5C, 0x28, 0xDE, 0x0F, 0xD1, 0x59, 0xCB, 0x20, 0x68, 0xBB, 0x6E, 0x9F, 0x4D, 0x63, 0x4C,
+  0x0F, 0xD9, 0x82, 0x05, 0x6F, 0xDA, 0xBD, 0x50, 0xDD, 0xF5, 0x69, 0x50, 0x5B, 0xC2, 0x33, 0x56,
+  0xA2, 0x4D, 0x5F, 0x68, 0x8D, 0xC4, 0x72, 0x54, 0x42, 0xC4, 0x38, 0xFB, 0x76, 0xD3, 0xB2, 0x43,
+  0x63, 0x85, 0xAD, 0xCD, 0x0D, 0x3C, 0xEC, 0xD3, 0x20, 0xE2, 0x1B, 0xF8, 0xF6, 0xF8, 0x5F, 0x46,
+  0x95, 0x01, 0x9D, 0xF4, 0x7B, 0x8D, 0x5A, 0xB2, 0xC1, 0xAB, 0xEC, 0x39, 0xB7, 0x31, 0x74, 0x84,
+  0x19, 0x26, 0x02, 0x4D, 0x32, 0xD8, 0x94, 0xD1, 0x79, 0x48, 0xA3, 0xEB, 0xD8, 0x9F, 0x63, 0xA2,
+  0x78, 0x7E, 0x8E, 0xCD, 0x71, 0x2F, 0x55, 0x89, 0xBF, 0x1A, 0xE8, 0x9A, 0x59, 0xCF, 0x5C, 0x49,
+  0x2A, 0xFD, 0x1E, 0x71, 0xE3, 0x21, 0xAE, 0xDB, 0x7E, 0xB8, 0x50, 0xFA, 0x42, 0xC0, 0xF1, 0xA0,
+  0xF5, 0x51, 0x3E, 0x97, 0x94, 0xD1, 0x6C, 0xD8, 0x1F, 0xF7, 0xC8, 0xC0, 0x44, 0x50, 0x98, 0x82,
+  0x86, 0x78, 0xAF, 0x76, 0x7E, 0xC6, 0x1B, 0xFA, 0x9E, 0x8F, 0x2E, 0x59, 0x69, 0xDD, 0x1D, 0x8A,
+  0xEC, 0x05, 0xB4, 0x77, 0xC4, 0xFE, 0x08, 0x58, 0xE2, 0xA0, 0xD3, 0xF0, 0xC7, 0xDB, 0xA4, 0xF8,
+  0x5D, 0xA5, 0x13, 0xB9, 0xCD, 0x8C, 0x5B, 0xB2, 0x33, 0xC6, 0x87, 0x8B, 0x32, 0x3D, 0x73, 0x2B,
+  0xCE, 0x22, 0xBF, 0xFC, 0xFF, 0xE6, 0x8B, 0xA0, 0xBA, 0x9B, 0xAF, 0x54, 0x58, 0xD1, 0x8D, 0x08,
+  0xDD, 0x8D, 0x3E, 0x24, 0x3F, 0xDE, 0xFC, 0xF4, 0x11, 0x21, 0x21, 0x82, 0x36, 0x26, 0xF7, 0xC0,
+  0xEA, 0xCA, 0x60, 0xB3, 0xAC, 0xF3, 0x1C, 0x93, 0x38, 0x96, 0x86, 0xAE, 0xFB, 0x29, 0xFB, 0xFB,
+  0x3F, 0xFD, 0x72, 0x25, 0xF0, 0xCE, 0xC0, 0xB8, 0xE0, 0x76, 0xB6, 0x51, 0xC1, 0xA0, 0xB2, 0x0E,
+  0xE6, 0xE4, 0xC3, 0x26, 0xAB, 0x34, 0x9B, 0x86, 0xAE, 0xB6, 0x43, 0x3F, 0x22, 0x83, 0x67, 0x8E,
+  0x20, 0x1D, 0x92, 0x88, 0x43, 0x84, 0xE7, 0xB0, 0x19, 0xE3, 0xA8, 0x5E, 0xC8, 0x32, 0xF9, 0xF0,
+  0x5A, 0xF2, 0xC7, 0xAD, 0x62, 0x55, 0xC9, 0x12, 0x93, 0x26, 0x06, 0x65, 0xE9, 0x4A, 0xC5, 0x5B,
+  0x8F, 0x08, 0xFE, 0x55, 0xCE, 0x67, 0x2A, 0xB9, 0x93, 0x36, 0xE0, 0x2B, 0x13, 0x0D, 0x87, 0x14,
+  0xC5, 0x5C, 0x01, 0x22, 0xE0, 0x0A, 0x97, 0xCA, 0x58, 0xAC, 0xF9, 0x70, 0x65, 0x38, 0x1C, 0x5F,
+  0x99, 0x70, 0x9E, 0x95, 0x42, 0xAF, 0x6F, 0xD0, 0xB8, 0x08, 0x25, 0x42, 0x6B, 0xB1, 0x9E, 0xD7,
+  0x8B, 0x05, 0xDA, 0x96, 0x3B, 0x56, 0x25, 0x29, 0xC2, 0x51, 0x8B, 0xAE, 0x26, 0x0E, 0x5B, 0x8C,
+  0x16, 0xEE, 0x00, 0xA4, 0x08, 0x58, 0x8A, 0x15, 0x92, 0xB0, 0x13, 0x2B, 0xF6, 0xD8, 0x08, 0x2A,
+  0x30, 0xE4, 0x89, 0x5B, 0x52, 0xD3, 0xE2, 0xBA, 0x87, 0x91, 0x1A, 0xF6, 0x24, 0xD8, 0xA2, 0x68,
+  0x87, 0x66, 0x99, 0x2D, 0x5C, 0x16, 0xFD, 0x3E, 0x25, 0xA8, 0x71, 0x8A, 0xF2, 0xFE, 0x41, 0x26,
+  0x0A, 0xEF, 0x84, 0xA0, 0x8F, 0xD2, 0xA3, 0x5F, 0x81, 0x0C, 0x5D, 0x8E, 0xC7, 0x3D, 0x82, 0x54,
+  0xC2, 0x0E, 0x0E, 0x58, 0x10, 0x24, 0x21, 0x92, 0x36, 0x9D, 0xB2, 0x93, 0xFE, 0x97, 0x2F, 0xDB,
+  0xD5, 0xA8, 0x7F, 0x70, 0xE0, 0x00, 0xC1, 0xDE, 0x60, 0xC5, 0x79, 0x1F, 0x7F, 0x2D, 0x2E, 0x9A,
+  0xF6, 0x45, 0xDE, 0x4F, 0xA6, 0x0E, 0x73, 0x89, 0xC3, 0x0A, 0x85, 0xC9, 0x63, 0x90, 0x18, 0x43,
+  0x4C, 0xFC, 0x05, 0x62, 0x80, 0xCD, 0x7F, 0x94, 0xB4, 0xD9, 0xE5, 0xDD, 0xF6, 0x3D, 0xFF, 0x2C,
+  0x03, 0x24, 0x9C, 0x3F, 0xB9, 0x2C, 0x6F, 0xD1, 0xA8, 0x63, 0x46, 0x55, 0xD5, 0x86, 0x21, 0xC9,
+  0x95, 0x91, 0xDD, 0x80, 0x6E, 0x61, 0x47, 0x7E, 0x3C, 0x65, 0xDC, 0x63, 0xA6, 0x2B, 0x8E, 0xCE,
+  0x6B, 0xC4, 0x49, 0x4C, 0xF7, 0x99, 0xF5, 0xD8, 0x45, 0xF1, 0x6E, 0x56, 0x9C, 0x95, 0x4D, 0x91,
+  0x53, 0x8A, 0x3A, 0xD0, 0xC2, 0x4D, 0x6B, 0xFB, 0x9B, 0xEC, 0xB8, 0x58, 0x4C, 0x3B, 0x35, 0xD4,
+  0xC8, 0x6E, 0x72, 0x57, 0xA4, 0xED, 0xE1, 0x66, 0xBC, 0x6A, 0x62, 0xE5, 0xF3, 0xE2, 0xD9, 0x7D,
+  0xD4, 0xE1, 0x0B, 0x1E, 0xE9, 0x1A, 0xC8, 0xBC, 0xC2, 0xED, 0x60, 0xE8, 0x5D, 0xE3, 0x06, 0x2D,
+  0x7A, 0x83, 0x6D, 0x86, 0x61, 0xE0, 0xB2, 0xA9, 0x6E, 0x0A, 0x26, 0x95, 0x5E, 0x01, 0x0D, 0x36,
+  0xB4, 0x6A, 0xE6, 0x5E, 0x5D, 0x3E, 0x09, 0x0E, 0xD6, 0x6D, 0x9A, 0x86, 0xDC, 0xEB, 0xB2, 0x6C,
+  0x82, 0xC4, 0x37, 0x3D, 0xC6, 0x59, 0xF6, 0x82, 0x5E, 0x49, 0x7D, 0x8F, 0x89, 0x76, 0xE8, 0xDF,
+  0x51, 0x09, 0x75, 0xDF, 0x4E, 0xC9, 0x2F, 0x52, 0xBF, 0x23, 0xF5, 0x69, 0x1E, 0x90, 0xBE, 0xAE,
+  0x15, 0x1E, 0x2C, 0xA4, 0xF6, 0x15, 0x20, 0x71, 0x5D, 0x70, 0x65, 0x48, 0xEC, 0x4E, 0x25, 0xD3,
+  0x99, 0x83, 0x40, 0x55, 0x9B, 0x65, 0x80, 0xCE, 0x18, 0x31, 0x7B, 0xE4, 0x54, 0x44, 0x5E, 0x11,
+  0xFA, 0x95, 0xCF, 0x9D, 0x1B, 0xB0, 0xBD, 0xDF, 0xC0, 0x15, 0xDD, 0xDA, 0xEB, 0x19, 0x7A, 0xA4,
+  0x74, 0x4E, 0x1F, 0xF7, 0x1D, 0xB2, 0xDA, 0x9A, 0x24, 0xB7, 0xDC, 0x9B, 0x70, 0x5B, 0xBF, 0x4E,
+  0xBE, 0x3B, 0x69, 0xDA, 0x9F, 0xD1, 0x49, 0x0B, 0xC4, 0x2D, 0x14, 0x36, 0x93, 0x11, 0xE0, 0xE0,
+  0xD0, 0xA9, 0x13, 0x17, 0x09, 0x9D, 0x84, 0x0E, 0x75, 0x64, 0x70, 0x87, 0xD1, 0x3B, 0x0C, 0xA6,
+  0xDD, 0xBB, 0xA7, 0x19, 0x9A, 0x78, 0x37, 0xB1, 0xFF, 0x2B, 0xB8, 0x9E, 0xA1, 0x8A, 0x7D, 0xF9,
+  0xC2, 0xBE, 0x96, 0xEB, 0x7D, 0x18, 0x73, 0xCF, 0xB8, 0x16, 0x04, 0xEE, 0x16, 0xDE, 0x45, 0x5D,
+  0xE3, 0x12, 0xDD, 0x47, 0xF7, 0x20, 0x9B, 0xA9, 0x1A, 0x37, 0x1B, 0xE6, 0x10, 0xF0, 0x4B, 0x51,
+  0x9C, 0xD1, 0x8B, 0x75, 0xDA, 0x4D, 0xFD, 0xC1, 0x6F, 0x6E, 0x29, 0x4B, 0xEA, 0x4B, 0x3F, 0x5F,
+  0x5F, 0xE2, 0xE9, 0x86, 0x6B, 0x09, 0x9C, 0x84, 0x42, 0x87, 0xD7, 0x03, 0x0C, 0x82, 0x99, 0x4A,
+  0xA7, 0x1B, 0x54, 0x60, 0xED, 0x1D, 0xA2, 0x9B, 0x18, 0xE1, 0xDC, 0xD7, 0x1F, 0x3D, 0x25, 0xA8,
+  0x76, 0xC2, 0xE9, 0xDB, 0x9E, 0x2B, 0x5A, 0x62, 0x84, 0x31, 0xCE, 0xC8, 0x8F, 0x18, 0xB5, 0x24,
+  0xA8, 0x02, 0x6E, 0xB3, 0x42, 0xAA, 0xDA, 0xF2, 0x23, 0x16, 0x7C, 0x4D, 0x0E, 0x0F, 0x1A, 0xC2,
+  0x7E, 0x33, 0x1A, 0xEC, 0x4F, 0xDE, 0xCC, 0xAA, 0x8A, 0xEF, 0xF4, 0x87, 0x16, 0xC7, 0xDB, 0x92,
+  0xF0, 0x3B, 0x37, 0xAA, 0x02, 0xC3, 0x88, 0x02, 0xB8, 0x7F, 0xC4, 0x09, 0xF8, 0x5B, 0x7A, 0xB3,
+  0xF5, 0xF7, 0xD8, 0x7C, 0x27, 0xD7, 0x75, 0x05, 0x8B, 0xE5, 0xBD, 0x6B, 0x58, 0x71, 0x83, 0x37,
+  0xB7, 0x0C, 0x71, 0xE8, 0x1B, 0xF7, 0x05, 0xA5, 0x0C, 0x39, 0x6E, 0x32, 0xF5, 0xB2, 0x1A, 0x3C,
+  0x59, 0xFA, 0xA1, 0x1B, 0x52, 0xA9, 0x0F, 0x79, 0x29, 0x78, 0xCA, 0xD1, 0xF7, 0x07, 0x7F, 0x9B,
+  0x06, 0x6E, 0x76, 0x1A, 0xD3, 0x9B, 0xA8, 0x19, 0x3F, 0x31, 0xA4, 0xFA, 0xFF, 0x2A, 0x0D, 0xDD,
+  0x7F, 0x2F, 0xFF, 0x03, 0xFB, 0xF3, 0x01, 0xD8, 0xCD, 0x14, 0x00, 0x00
+};
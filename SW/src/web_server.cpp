@@ -5,6 +5,13 @@
 #include <avr/pgmspace.h>
 #include <Ethernet.h>
 #include "web_server.h"
+#include "web_page.h"
+#ifdef USE_METRICS
+#include "metrics.h"
+#endif
+#ifdef USE_WEBSOCKET
+#include "sha1.h"
+#endif
 #include "AR488_ComPorts.h"
 #include <StreamLib.h>
 
@@ -42,71 +49,6 @@ char *trim(char *s) {
 #include "AR488_GPIBbus.h"
 extern GPIBbus gpibBus;
 
-/**
- * @brief scan the GPIB bus and return all found instruments. 
- * It is heavily inspired by the fndl_h() function from the Prologix GPIB controller, with the parameter "all".
- * 
- * @return uint32_t bitmap: bit 1 = address 1, etc. Handy that addresses are 1-31
- */
-uint32_t fndl(void) {
-    uint16_t tmo = gpibBus.cfg.rtmo;
-    uint8_t i = 0;
-    uint8_t j = 0;
-    uint8_t pri = 0xFF;
-    uint32_t bitmap = 0;
-
-    // Set minimal timeout
-    gpibBus.cfg.rtmo = 35;
-
-    // Request 'all'
-    j = 31;
-
-    // Poll the range of GPIB adresses
-    while (i < j) {
-        pri = i;
-
-        // Ignore the controller address
-        if (pri == gpibBus.cfg.caddr) {
-            i++;
-            continue;
-        }
-
-        // Serial.print("PRI: ");
-        // Serial.println(pri);
-
-        // Send UNL + UNT + LAD (addressDevice function adds 0x20 to pri)
-        if (gpibBus.addressDevice(pri, 0xFF, TOLISTEN) == 1) {
-#ifdef LOG_WEB_DETAILS
-            debugPort.print(F("Error in addressDevice for primary address "));
-            debugPort.println(pri);            
-#endif
-            break;
-        }
-
-        gpibBus.clearSignal(ATN_BIT);
-        delayMicroseconds(1600);
-
-        if (gpibBus.isAsserted(NDAC_PIN)) {
-#ifdef LOG_WEB_DETAILS
-            debugPort.print(F("Found Device with primary address "));
-            debugPort.println(pri);            
-#endif
-            bitmap |= (1UL << pri);
-            // else.... I do no scan for secondary addresses
-        }  // End if NDAC aserted
-
-        gpibBus.setControls(CIDS);
-        //    delay(50);
-        i++;
-
-    }  // END while
-
-    gpibBus.cfg.rtmo = tmo;
-
-    gpibBus.setControls(CIDS);
-    return bitmap;
-}
-
 void gpibWrite(int address, const char *data) {
     if (address <= 0 || address > 31) {
         return;
@@ -119,23 +61,139 @@ void gpibWrite(int address, const char *data) {
     gpibBus.unAddressDevice();
 }
 
-void gpibRead(int address, Stream &dataStream) {
-    if (address <= 0 || address > 31) {
-        return;
-    }
-    // Send data to the GPIB bus
-    gpibBus.cfg.paddr = address;  // primary address is not used
-    gpibBus.cfg.saddr = 0xFF;  // secondary address is not used
-    gpibBus.addressDevice(address, 0xFF, TOTALK);
-    gpibBus.receiveData(dataStream, true, false, 0);
-    gpibBus.unAddressDevice();
-}
-
 // *********************************************** */
 // the web server
 // *********************************************** */
 
-// This is a simple web server that handles a single connection at a time.
+/**
+ * @brief Print that only counts the characters, to send the Content-Length of a reply before the reply itself.
+ */
+class LengthPrint : public Print {
+  public:
+    size_t length = 0;
+    size_t write(uint8_t) override {
+        length++;
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        length += size;
+        return size;
+    }
+};
+
+/**
+ * @brief Stream that collects the reply of an instrument in the staging buffer of a slot (see flushRead()), and counts the characters.
+ *
+ * What does not fit in the buffer is dropped, but still counted.
+ */
+class WebReadStream : public Stream {
+  public:
+    WebReadStream(char *buffer, size_t &length, size_t size) : buffer(buffer), length(length), size(size) {}
+    size_t count = 0;
+    size_t write(uint8_t c) override {
+        count++;
+        if (length >= size) {
+            return 0;
+        }
+        buffer[length++] = c;
+        return 1;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+  private:
+    char *buffer;
+    size_t &length;
+    size_t size;
+};
+
+/**
+ * @brief Decode the %NN encoded characters of a URL, in place.
+ *
+ * @param s the string to decode
+ * @return char* the end of the decoded string
+ */
+char *urlDecode(char *s) {
+    char *src = s;
+    char *dst = s;
+    bool copied = false;
+    while (*src) {
+        copied = false;
+        if (*src == '%') {
+            // this is a %NN encoded character
+            // convert the next two characters from a hex value
+            // and store it in the destination
+            char ch1 = *(src + 1);
+            char ch2 = *(src + 2);
+            if (ch1 && ch2) {
+                int val1 = decodeHexDigit(ch1);
+                int val2 = decodeHexDigit(ch2);
+                if (val1 >= 0 && val2 >= 0) {
+                    // this is a valid %NN encoded character
+                    // convert it to the character and store it in the destination
+                    *dst = (val1 << 4) | val2;
+                    src += 2; // move the source pointer
+                    copied = true;
+                }
+            }
+        }
+        if (!copied) {
+            // this is a normal character or something went wrong
+            // just copy it to the destination
+            *dst = *src;
+        }
+        src++;
+        dst++;
+    }
+    *dst = '\0'; // null terminate the string
+    return dst;
+}
+
+static const char deviceName[] PROGMEM = DEVICE_NAME;
+
+// The header line of a browser that has the current page, lower case
+static const char etagHeader[] PROGMEM = "if-none-match: " WEB_PAGE_ETAG;
+
+#ifdef USE_WEBSOCKET
+// The header line with the key of a WebSocket request, lower case
+static const char keyHeader[] PROGMEM = "sec-websocket-key: ";
+
+/**
+ * @brief Print data in base64, with padding.
+ */
+static void printBase64(Print& p, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < size) {
+            v |= (uint16_t)data[i + 1] << 8;
+        }
+        if (i + 2 < size) {
+            v |= data[i + 2];
+        }
+        for (uint8_t j = 0; j < 4; j++) {
+            uint8_t c = (v >> (18 - 6 * j)) & 0x3F;
+            if (i + j > size) {
+                p.print('=');
+            } else if (c < 26) {
+                p.print((char)('A' + c));
+            } else if (c < 52) {
+                p.print((char)('a' + c - 26));
+            } else if (c < 62) {
+                p.print((char)('0' + c - 52));
+            } else {
+                p.print(c == 62 ? '+' : '/');
+            }
+        }
+    }
+}
+#endif
+
+// This web server handles MAX_WEB_CLIENTS connections at a time, which stay open for the next request (HTTP/1.1 keep-alive).
+// Every slot has its own state (see webSlotState), and nothing waits for an instrument:
+// - requests that do not need the GPIB bus are answered immediately
+// - a reply of an instrument is read in small parts, one per pass of the loop, by the slot that holds the bus (busSlot)
+// - other requests that need the bus wait in WEB_PENDING until it is free again
 BasicWebServer::BasicWebServer() {
     // Constructor
 }
@@ -147,363 +205,936 @@ void BasicWebServer::begin() {
 int BasicWebServer::nr_connections(void) {
     int count = 0;
     for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
-        if (clients[i]) {
+        if (state[i] != WEB_FREE) {
             count++;
         }
     }
     return count;
 }
 
-bool BasicWebServer::have_free_connections(void) {
+void BasicWebServer::killClients(void) {
     for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
-        if (!clients[i]) {
-            return true;
+        if (state[i] != WEB_FREE) {
+            closeSlot(i);
         }
+    }    
+}
+
+void BasicWebServer::closeSlot(int slot) {
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("Closing Web connection of slot "));
+    debugPort.print(slot);
+    debugPort.print(F(" from remote port "));
+    debugPort.println(clients[slot].remotePort());
+#endif
+    if (busSlot == slot) {
+        // release the instrument, even if it did not finish its reply
+        releaseBus();
     }
-    return false;
+    clients[slot].stop();
+    state[slot] = WEB_FREE;
 }
 
-void BasicWebServer::killClients(void) {
+void BasicWebServer::finishRequest(int slot) {
+    if (!keepAlive[slot]) {
+        closeSlot(slot);
+        return;
+    }
+    // wait for the next request on the same connection
+    state[slot] = WEB_REQUEST;
+    currentLineIsBlank[slot] = true;
+    charsRead[slot] = 0;
+    etagPos[slot] = WEB_NO_MATCH;  // not on the start line
+    etagMatch[slot] = false;
+    streamPeriod[slot] = 0;
+#ifdef USE_WEBSOCKET
+    keyPos[slot] = WEB_NO_MATCH;
+    webSocket[slot] = false;
+#endif
+    memset(startreq[slot], 0, sizeof(startreq[slot]));
+    lastActivity[slot] = millis();
+}
+
+/**
+ * @brief Find the connection that waits the longest for a next request.
+ * 
+ * An idle console counts too: the page opens it again for its next command.
+ * A connection with a request that was not read yet is not idle.
+ * 
+ * @param minIdle only connections idle for at least this many ms
+ * @return int the slot, or -1 if every connection is busy
+ */
+int BasicWebServer::idleSlot(unsigned long minIdle) {
+    int slot = -1;
+    unsigned long idle = minIdle;
     for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
-        if (clients[i]) {
-            clients[i].stop(); 
+        bool waiting = state[i] == WEB_REQUEST && charsRead[i] == 0;
+#ifdef USE_WEBSOCKET
+        waiting = waiting || (state[i] == WEB_SOCKET && busSlot != i && socketIn[i].headLength == 0 && socketIn[i].prefix == 0);
+#endif
+        if (waiting && !clients[i].available() && millis() - lastActivity[i] >= idle) {
+            idle = millis() - lastActivity[i];
+            slot = i;
         }
-    }    
+    }
+    return slot;
+}
+
+/**
+ * @brief Close the connection that waits the longest for a next request, for a new VXI-11 link that found no free socket.
+ * 
+ * The page opens a new connection for its next request.
+ * 
+ * @return true if a connection was closed
+ */
+bool BasicWebServer::freeSocket(void) {
+    int slot = idleSlot(WEB_MIN_IDLE);
+    if (slot < 0) {
+        return false;
+    }
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("Socket needed: "));
+#endif
+    closeSlot(slot);
+    return true;
+}
+
+void BasicWebServer::acceptClient(void) {
+    EthernetClient newClient = server.accept();
+    if (!newClient) {
+        return;
+    }
+    int slot = -1;
+    for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
+        if (state[i] == WEB_FREE) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        // All slots are in use: make room by closing the connection that waits the longest for a next request
+        slot = idleSlot();
+        if (slot >= 0) {
+            closeSlot(slot);
+        }
+    }
+    if (slot < 0) {
+#ifdef LOG_WEB_DETAILS
+        debugPort.print(F("Web connection limit reached from remote port "));
+        debugPort.println(newClient.remotePort());
+#endif
+        newClient.stop();
+        return;
+    }
+
+    clients[slot] = newClient;
+    keepAlive[slot] = true;
+    finishRequest(slot);  // init the parser
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("New Web connection in slot "));
+    debugPort.print(slot);
+    debugPort.print(F(" from remote port "));
+    debugPort.println(newClient.remotePort());
+#endif
 }
 
 void BasicWebServer::loop(int nrConnections) {
     // simple TCP server based on 'server.accept()', meaning I must handle the lifecycle of the client
-    // It is not blocking for input, but blocks for output
 
-    // close any clients that are not connected
+    // close any clients that are not connected, or that did not send a request for too long
     for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
-        if (clients[i] && !clients[i].connected()) {
+        if (state[i] == WEB_FREE) {
+            continue;
+        }
+        if (!clients[i].connected()) {
 #ifdef LOG_WEB_DETAILS
-            debugPort.print(F("Force Closing Web connection of slot "));
-            debugPort.print(i);
-            debugPort.print(F(" from remote port "));
-            debugPort.println(clients[i].remotePort());
+            debugPort.print(F("Remote closed: "));
 #endif
-            clients[i].stop();            
-        }
-    }
-
-    if (have_free_connections()) {
-        // check if a new client is available
-        EthernetClient newClient = server.accept();
-        if (newClient) {
-            bool found = false;
-            for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
-                if (!clients[i]) {
-                    clients[i] = newClient;
-                    found = true;
-                    // init parser
-                    currentLineIsBlank[i] = true;
-                    charsRead[i] = 0;
-                    memset(startreq[i], 0, sizeof(startreq[i]));
+            closeSlot(i);
+        } else if (state[i] == WEB_REQUEST && millis() - lastActivity[i] > WEB_KEEPALIVE_TIMEOUT) {
 #ifdef LOG_WEB_DETAILS
-                    debugPort.print(F("New Web connection in slot "));
-                    debugPort.print(i);
-                    debugPort.print(F(" from remote port "));
-                    debugPort.println(newClient.remotePort());
+            debugPort.print(F("Idle: "));
 #endif
-                    break;
-                }
-            }
-
-            if (!found) {
-                // shouldn't happen, but still....
+            closeSlot(i);
+#ifdef USE_WEBSOCKET
+        } else if (state[i] == WEB_SOCKET && busSlot == i && millis() - lastActivity[i] > WEB_KEEPALIVE_TIMEOUT) {
+            // the client stopped in the middle of a command, and holds the bus
 #ifdef LOG_WEB_DETAILS
-                debugPort.print(F("Web connection limit reached from remote port "));
-                debugPort.println(newClient.remotePort());
+            debugPort.print(F("Incomplete command: "));
+#endif
+            closeSlot(i);
 #endif
-                newClient.stop();
-            }
         }
     }
 
-    // handle any incoming data
+    acceptClient();
+
+#ifdef USE_BUS_MAP
+    // refresh the map of the instruments for /fnd, while nobody uses the bus
+    // a probe addresses the instrument to listen: with REN asserted that puts it in remote, so only /fnd scans then
+    if (busSlot < 0 && gpibBus.isController() && !gpibBus.isAsserted(REN_PIN) && gpibBus.busMapDue()
+        && ((gpibBus.cfg.paddr == 0xFF && gpibBus.haveAddressedDevice() == TONONE) || gpibBus.idleTalker())) {
+        gpibBus.cfg.paddr = 0xFF;  // the probe untalks the talker left by a serial poll
+        gpibBus.busMapStep();
+    }
+#endif
+
+    // move every slot on
     for (int i = 0; i < MAX_WEB_CLIENTS; i++) {
-        // an http request ends with a blank line
-        while (clients[i].connected() && clients[i].available()) {
-            char c = clients[i].read();
-            // read the first line, until newline or end of buffer.
-            // The buffer was set to \0, and I leave 1 free at the end, so I'll always have a null terminated string, no matter the stop reason
-            if (charsRead[i] < sizeof(startreq[i]) - 1) {
-                if (c == '\r' || c == '\n') {
-                    // end the line
-                    charsRead[i] = sizeof(startreq[i]) - 1; // mark as full
-                } else {
-                    // store the character in the buffer
-                    startreq[i][charsRead[i]] = c;
-                    charsRead[i]++;
-                }
+        switch (state[i]) {
+            case WEB_REQUEST:
+                readRequest(i, nrConnections);
+                break;
+            case WEB_PENDING:
+                handleRequest(i, nrConnections);
+                break;
+            case WEB_READING:
+                readStep(i);
+                break;
+            case WEB_STREAM:
+                streamStep(i);
+                break;
+#ifdef USE_WEBSOCKET
+            case WEB_SOCKET:
+                socketStep(i);
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+};
+
+void BasicWebServer::readRequest(int slot, int nrConnections) {
+    // an http request ends with a blank line
+    while (clients[slot].available()) {
+        char c = clients[slot].read();
+        lastActivity[slot] = millis();
+        // match the header lines with etagHeader, to know if the browser has the page already
+        if (c == '\n') {
+            if (etagPos[slot] != WEB_NO_MATCH && pgm_read_byte(&etagHeader[etagPos[slot]]) == 0) {
+                etagMatch[slot] = true;
+            }
+            etagPos[slot] = 0;  // next line
+        } else if (c != '\r' && etagPos[slot] != WEB_NO_MATCH) {
+            if (tolower(c) == pgm_read_byte(&etagHeader[etagPos[slot]])) {
+                etagPos[slot]++;
+            } else {
+                etagPos[slot] = WEB_NO_MATCH;
             }
-            // if you've gotten to the end of the line (received a newline
-            // character) and the line is blank, the http request has ended,
-            // so you can send a reply
-            if (c == '\n' && currentLineIsBlank[i]) {
-                // doubly make sure we have a null terminated string
-                startreq[i][sizeof(startreq[i])-1] = '\0';
+        }
+#ifdef USE_WEBSOCKET
+        // and with keyHeader, to keep the key of a WebSocket request behind the request line, if that one is short enough
+        if (c == '\n') {
+            keyPos[slot] = 0;
+        } else if (c != '\r' && keyPos[slot] != WEB_NO_MATCH) {
+            uint8_t n = keyPos[slot] - (sizeof(keyHeader) - 1);
+            if (keyPos[slot] < sizeof(keyHeader) - 1) {
+                keyPos[slot] = tolower(c) == pgm_read_byte(&keyHeader[keyPos[slot]]) ? keyPos[slot] + 1 : WEB_NO_MATCH;
+            } else if (n < WEB_WS_KEY_SIZE && startreq[slot][WEB_WS_KEY - 1] == '\0') {
+                startreq[slot][WEB_WS_KEY + n] = c;
+                keyPos[slot]++;
+            }
+        }
+#endif
+        // read the first line, until newline or end of buffer.
+        // The buffer was set to \0, and I leave 1 free at the end, so I'll always have a null terminated string, no matter the stop reason
+        if (charsRead[slot] < (int)sizeof(startreq[slot]) - 1) {
+            if (c == '\r' || c == '\n') {
+                // end the line
+                charsRead[slot] = sizeof(startreq[slot]) - 1; // mark as full
+            } else {
+                // store the character in the buffer
+                startreq[slot][charsRead[slot]] = c;
+                charsRead[slot]++;
+            }
+        }
+        // if you've gotten to the end of the line (received a newline
+        // character) and the line is blank, the http request has ended,
+        // so you can send a reply
+        if (c == '\n' && currentLineIsBlank[slot]) {
+            // doubly make sure we have a null terminated string
+            startreq[slot][sizeof(startreq[slot])-1] = '\0';
 #ifdef LOG_WEB_DETAILS
-                debugPort.print(F("Got complete web request on slot "));
-                debugPort.print(i);
-                debugPort.print(F(": \""));
-                debugPort.print(startreq[i]);
-                debugPort.println(F("\""));
+            debugPort.print(F("Got complete web request on slot "));
+            debugPort.print(slot);
+            debugPort.print(F(": \""));
+            debugPort.print(startreq[slot]);
+            debugPort.println(F("\""));
 #endif
-                // got all data. Check what the request was for
-                // I only support GET requests
-                char *path = NULL;
-                char* token;
-                char* rest = startreq[i];
+            // got all data. Check what the request was for
+            // I only support GET requests
+            char *path = NULL;
+            char* token;
+            char* rest = startreq[slot];
 
-                // get the first token, must be GET
+            // get the first token, must be GET
+            token = strtok_r(rest, " ", &rest);
+            keepAlive[slot] = false;
+            if (token && (strcasecmp(token, "GET") == 0)) {
+                // This is a GET request
+                // get the path
+                path = strtok_r(rest, " ", &rest);
+                // HTTP/1.1 connections stay open, HTTP/1.0 ones do not.
+                // Other requests than GET are closed too, as I cannot skip their body.
                 token = strtok_r(rest, " ", &rest);
-                if (token && (strcasecmp(token, "GET") == 0)) {
-                    // This is a GET request
-                    // get the path
-                    token = strtok_r(rest, " ", &rest);
-                    if (token) {
-                        // this is the path
-                        path = token;
-                    }
-                }
-                handleRequest(clients[i], path, nrConnections);
+                keepAlive[slot] = token && (strcasecmp(token, "HTTP/1.1") == 0);
+            }
+            // keep only the path in startreq, the request may have to wait for the bus
+            if (path) {
+                memmove(startreq[slot], path, strlen(path) + 1);
+            } else {
+                startreq[slot][0] = '\0';
+            }
+            state[slot] = WEB_PENDING;
+            handleRequest(slot, nrConnections);
+            // a next request on the same connection is read in the next pass
+            return;
+        }
+        if (c == '\n') {
+            // you're starting a new line
+            currentLineIsBlank[slot] = true;
+        } else if (c != '\r') {
+            // you've gotten a character on the current line
+            currentLineIsBlank[slot] = false;
+        }
+    }
+}
 
-                delay(10);  // yield to send reply
+void BasicWebServer::releaseBus(void) {
+    gpibBus.unAddressDevice();
+    gpibBus.cfg.paddr = 0xFF;  // mark as unaddressed
+    busSlot = -1;
+}
+
+void BasicWebServer::startRead(int slot, int addr) {
+    // The reply is read by readStep(), with the bus held by this slot
+    state[slot] = WEB_READING;
+    busSlot = slot;
+    readAddr = addr;
+    readLen = 0;
+#ifdef USE_WEBSOCKET
+    readFragment = false;
+#endif
+    memset(readBytes, 0, sizeof(readBytes));
+    lastActivity[slot] = millis();
+    gpibBus.cfg.paddr = addr;
+    gpibBus.cfg.saddr = 0xFF;  // secondary address is not used
+    gpibBus.addressDevice(addr, 0xFF, TOTALK);
+}
+
+void BasicWebServer::flushRead(int slot, bool last) {
+    // The request line is not needed anymore while the reply is read, so startreq is the staging buffer.
+    // On a keep-alive connection, the data is sent as an HTTP chunk: size in 3 hex digits and CRLF, data, CRLF.
+    // On a WebSocket, it is a fragment of a binary message, the last one ends the message.
+    // Either way, it goes out in a single write, so in a single network packet.
+    char *buffer = startreq[slot];
+#ifdef USE_WEBSOCKET
+    if (webSocket[slot]) {
+        if (readLen == 0 && !last) {
+            return;
+        }
+        uint8_t *frame = (uint8_t *)buffer + WEB_CHUNK_HEAD;
+        if (readLen > 125) {
+            frame -= 4;
+            frame[1] = 126;
+            frame[2] = readLen >> 8;
+            frame[3] = readLen & 0xFF;
+        } else {
+            frame -= 2;
+            frame[1] = readLen;
+        }
+        frame[0] = (readFragment ? 0x00 : 0x02) | (last ? 0x80 : 0x00);
+        clients[slot].write(frame, (uint8_t *)buffer + WEB_CHUNK_HEAD + readLen - frame);
+        readFragment = !last;
+        readLen = 0;
+        return;
+    }
+#endif
+    if (readLen == 0) {
+        return;
+    }
+    if (keepAlive[slot]) {
+        size_t n = readLen;
+        for (int i = 2; i >= 0; i--) {
+            uint8_t digit = n & 0x0F;
+            buffer[i] = digit < 10 ? '0' + digit : 'A' - 10 + digit;
+            n >>= 4;
+        }
+        buffer[3] = '\r';
+        buffer[4] = '\n';
+        buffer[WEB_CHUNK_HEAD + readLen] = '\r';
+        buffer[WEB_CHUNK_HEAD + readLen + 1] = '\n';
+        clients[slot].write((const uint8_t *)buffer, WEB_CHUNK_HEAD + readLen + 2);
+    } else {
+        clients[slot].write((const uint8_t *)buffer + WEB_CHUNK_HEAD, readLen);
+    }
+    readLen = 0;
+}
+
+void BasicWebServer::readStep(int slot) {
+    if (clients[slot].availableForWrite() < MAX_START_LINE_LENGTH) {
+        // the client does not keep up: the handshake holds the instrument meanwhile, but not forever
+        if (millis() - lastActivity[slot] > WEB_KEEPALIVE_TIMEOUT) {
 #ifdef LOG_WEB_DETAILS
-                debugPort.print(F("Sent data and Closing Web connection of slot "));
-                debugPort.print(i);
-                debugPort.print(F(" from remote port "));
-                debugPort.println(clients[i].remotePort());                    
+            debugPort.print(F("Client stalled: "));
 #endif
-                clients[i].stop();
-                break;
+            closeSlot(slot);  // releases the bus
+        }
+        return;
+    }
+
+    // Another server may have used the bus in between. A talker continues its reply when it is addressed again.
+    if (gpibBus.cfg.paddr != readAddr || gpibBus.haveAddressedDevice() != TOTALK) {
+        gpibBus.cfg.paddr = readAddr;
+        gpibBus.cfg.saddr = 0xFF;
+        gpibBus.addressDevice(readAddr, 0xFF, TOTALK);
+    }
+
+    // A stream collects the whole reply for a single event, and drops what does not fit
+    bool stream = streamPeriod[slot] != 0;
+    size_t room = stream ? WEB_READ_BYTES : WEB_CHUNK_DATA - readLen;
+    if (room > WEB_READ_BYTES) {
+        room = WEB_READ_BYTES;
+    }
+    WebReadStream out(startreq[slot] + (stream ? WEB_STREAM_DATA : WEB_CHUNK_HEAD), readLen,
+        stream ? WEB_STREAM_REPLY : WEB_CHUNK_DATA);
+    // keep room for the EOT character
+    enum receiveState rstate = gpibBus.receiveDataPart(out, readBytes, true, false, 0, room - 1, WEB_READ_TIME);
+    if (out.count > 0) {
+        lastActivity[slot] = millis();
+    }
+    if (rstate == RECEIVE_INIT && millis() - lastActivity[slot] < gpibBus.cfg.rtmo) {
+        // the reply goes on: send what I have when the buffer is full, or when the instrument pauses
+        if (!stream && (readLen + 2 > WEB_CHUNK_DATA || out.count == 0)) {
+            flushRead(slot);
+        }
+        return;
+    }
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("Read from instrument ended with state "));
+    debugPort.println(rstate);
+#endif
+#ifdef USE_METRICS
+    if (rstate == RECEIVE_INIT) {
+        // the instrument stopped talking before the end of its reply
+        metrics.countRead(readAddr, 0, RECEIVE_ERR);
+    }
+#endif
+    if (stream) {
+        releaseBus();
+        sendEvent(slot, rstate == RECEIVE_INIT && readLen == 0);
+        return;
+    }
+#ifdef USE_WEBSOCKET
+    if (webSocket[slot]) {
+        // the reply is one message, and the console waits for the next one
+        flushRead(slot, true);
+        releaseBus();
+        state[slot] = WEB_SOCKET;
+        return;
+    }
+#endif
+    flushRead(slot);
+    releaseBus();
+    if (keepAlive[slot]) {
+        // last chunk
+        clients[slot].write((const uint8_t *)"0\r\n\r\n", 5);
+    }
+    finishRequest(slot);
+}
+
+void BasicWebServer::startStream(int slot, char *params, BufferedPrint& bp) {
+    // params is like "addr=5&q=MEAS%3F&period=500". The query must be URL encoded.
+    int addr = -1;
+    long period = WEB_STREAM_PERIOD;
+    char *query = NULL;
+    char *rest = params;
+    char *param;
+    while ((param = strtok_r(rest, "&", &rest)) != NULL) {
+        if (strncmp(param, "addr=", 5) == 0) {
+            addr = atoi(param + 5);
+        } else if (strncmp(param, "period=", 7) == 0) {
+            period = atol(param + 7);
+        } else if (strncmp(param, "q=", 2) == 0) {
+            query = param + 2;
+            urlDecode(query);
+        }
+    }
+    if (query) {
+        query = trim(query);
+    }
+    if (addr <= 0 || addr > 30 || !query || !*query || strlen(query) >= WEB_STREAM_QUERY_SIZE) {
+        sendResponseErr(bp);
+        bp.flush();
+        finishRequest(slot);
+        return;
+    }
+    if (period < WEB_STREAM_MIN_PERIOD) {
+        period = WEB_STREAM_MIN_PERIOD;
+    } else if (period > 0xFFFF) {
+        period = 0xFFFF;
+    }
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("Stream on slot "));
+    debugPort.print(slot);
+    debugPort.print(F(" every "));
+    debugPort.print(period);
+    debugPort.print(F(" ms from address "));
+    debugPort.print(addr);
+    debugPort.print(F(": \""));
+    debugPort.print(query);
+    debugPort.println(F("\""));
+#endif
+    // keep the query at the start of the buffer (see WEB_STREAM_DATA)
+    memmove(startreq[slot], query, strlen(query) + 1);
+    streamAddr[slot] = addr;
+    streamPeriod[slot] = period;
+    streamNext[slot] = millis();
+    // The events never end: the connection is closed by the browser
+    keepAlive[slot] = false;
+    bp.print(F("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-store\r\n\r\n"));
+    bp.flush();
+    state[slot] = WEB_STREAM;
+}
+
+void BasicWebServer::streamStep(int slot) {
+    // The query takes the bus like any other request: only when no other slot holds it
+    if ((long)(millis() - streamNext[slot]) < 0 || busSlot >= 0) {
+        return;
+    }
+    gpibWrite(streamAddr[slot], startreq[slot]);
+    startRead(slot, streamAddr[slot]);
+}
+
+void BasicWebServer::sendEvent(int slot, bool timeout) {
+    // One reply is one event. An event ends with a blank line, so the line ends of the reply become spaces.
+    char *event = startreq[slot] + WEB_STREAM_QUERY_SIZE;
+    while (readLen > 0 && isspace(event[6 + readLen - 1])) {
+        readLen--;
+    }
+    for (size_t i = 0; i < readLen; i++) {
+        if (event[6 + i] == '\r' || event[6 + i] == '\n') {
+            event[6 + i] = ' ';
+        }
+    }
+    if (timeout) {
+        static const char timeoutEvent[] = "event: timeout\ndata:\n\n";
+        clients[slot].write((const uint8_t *)timeoutEvent, sizeof(timeoutEvent) - 1);
+    } else {
+        memcpy(event, "data: ", 6);
+        event[6 + readLen] = '\n';
+        event[6 + readLen + 1] = '\n';
+        clients[slot].write((const uint8_t *)event, 6 + readLen + 2);
+    }
+    readLen = 0;
+    // the next query, without catching up on the ones that are late
+    streamNext[slot] += streamPeriod[slot];
+    if ((long)(millis() - streamNext[slot]) > 0) {
+        streamNext[slot] = millis();
+    }
+    state[slot] = WEB_STREAM;
+}
+
+#ifdef USE_WEBSOCKET
+// The console of the page is a WebSocket on /ws. Every message of the client is a command "T/ADDR/COMMAND", like the path of /ex:
+// T is 0 for a query, 1 for a write, 2 for a read, ADDR the GPIB address. The COMMAND can have any length and any character,
+// it is written to the instrument while it comes in, in blocks of WEB_READ_BYTES.
+// Every command gets one binary message back: the reply of the instrument, or an empty message when it is not read.
+// Commands wait in the socket while another slot holds the bus, so they are executed in order.
+
+void BasicWebServer::startSocket(int slot, BufferedPrint& bp) {
+    // The handshake: Sec-WebSocket-Accept is the base64 of the SHA-1 of the key and a fixed GUID
+    Sha1 sha;
+    sha.print(startreq[slot] + WEB_WS_KEY);
+    sha.print(F("258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+    uint8_t hash[SHA1_HASH_SIZE];
+    sha.result(hash);
+    bp.print(F("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "));
+    printBase64(bp, hash, sizeof(hash));
+    bp.print(F("\r\n\r\n"));
+    bp.flush();
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("WebSocket on slot "));
+    debugPort.println(slot);
+#endif
+    webSocket[slot] = true;
+    memset(&socketIn[slot], 0, sizeof(socketIn[slot]));
+    state[slot] = WEB_SOCKET;
+}
+
+void BasicWebServer::socketStep(int slot) {
+    // A command holds the bus from its address to its end
+    if (busSlot >= 0 && busSlot != slot) {
+        return;
+    }
+    WebSocketIn &in = socketIn[slot];
+    while (clients[slot].available() > 0) {
+        uint8_t c = clients[slot].read();
+        lastActivity[slot] = millis();
+        if (in.headLength < 2 || in.headLength < 2 + ((in.head[1] & 0x7F) == 126 ? 2 : 0) + 4) {
+            in.head[in.headLength++] = c;
+            if (in.headLength == 2) {
+                // Only masked frames (as sent by every client) of less than 64 KB, and control frames of at most 125 bytes in one piece
+                uint8_t opcode = in.head[0] & 0x0F;
+                uint8_t length = in.head[1] & 0x7F;
+                if ((in.head[0] & 0x70) || !(in.head[1] & 0x80) || length == 127 || (opcode > 2 && opcode < 8) || opcode > 10
+                    || ((opcode & 0x08) && (!(in.head[0] & 0x80) || length > WEB_WS_CONTROL_SIZE))) {
+                    closeSocket(slot, 1002);  // protocol error
+                    return;
+                }
+                in.left = length;
+            } else if (in.headLength == 4 && (in.head[1] & 0x7F) == 126) {
+                in.left = ((uint16_t)in.head[2] << 8) | in.head[3];
             }
-            if (c == '\n') {
-                // you're starting a new line
-                currentLineIsBlank[i] = true;
-            } else if (c != '\r') {
-                // you've gotten a character on the current line
-                currentLineIsBlank[i] = false;
+            if (in.headLength == 2 + ((in.head[1] & 0x7F) == 126 ? 2 : 0) + 4) {
+                // the payload follows
+                in.pos = 0;
+                if (in.left == 0 && !socketFrameEnd(slot)) {
+                    return;
+                }
             }
+            continue;
+        }
+        // the payload, unmasked with the last 4 bytes of the header
+        c ^= in.head[in.headLength - 4 + (in.pos & 3)];
+        in.left--;
+        if (in.head[0] & 0x08) {
+            startreq[slot][WEB_WS_CONTROL + in.pos] = c;
+        } else if (!socketCommand(slot, c)) {
+            return;
+        }
+        in.pos++;
+        if (in.left == 0 && !socketFrameEnd(slot)) {
+            return;
+        }
+        if (in.length == WEB_READ_BYTES) {
+            // one block per pass of the loop
+            socketWrite(slot, false);
+            return;
         }
     }
-};
+}
 
-void BasicWebServer::handleRequest(EthernetClient& client, char* path, int nrConnections) {
+bool BasicWebServer::socketFrameEnd(int slot) {
+    // returns false when the slot has to stop reading: at the end of a message, or when it is closed
+    WebSocketIn &in = socketIn[slot];
+    uint8_t opcode = in.head[0] & 0x0F;
+    in.headLength = 0;
+    if (opcode == 9) {
+        // ping: pong with the same payload
+        uint8_t *frame = (uint8_t *)startreq[slot] + WEB_WS_CONTROL - 2;
+        frame[0] = 0x8A;
+        frame[1] = in.pos;
+        clients[slot].write(frame, in.pos + 2);
+        return true;
+    }
+    if (opcode == 8) {
+        closeSocket(slot, 1000);  // normal closure
+        return false;
+    }
+    if (opcode == 10 || !(in.head[0] & 0x80)) {
+        // a pong, or a message that goes on in the next frame
+        return true;
+    }
+    socketMessageEnd(slot);
+    return false;
+}
+
+bool BasicWebServer::socketCommand(int slot, char c) {
+    // Parses "T/ADDR/" and stages the command that follows, returns false when the slot is closed
+    WebSocketIn &in = socketIn[slot];
+    if (in.prefix == WEB_WS_COMMAND) {
+        if (in.type < 2) {
+            // a read does not write its command, as for /ex2
+            startreq[slot][in.length++] = c;
+            if (!isspace(c)) {
+                in.last = c;
+            }
+        }
+        return true;
+    }
+    if (in.prefix == 0 && c >= '0' && c <= '2') {
+        in.type = c - '0';
+        in.prefix++;
+        return true;
+    }
+    if (in.prefix == 1 && c == '/') {
+        in.addr = 0;
+        in.prefix++;
+        return true;
+    }
+    if (in.prefix == 2 && c >= '0' && c <= '9' && in.addr * 10 + c - '0' <= 30) {
+        in.addr = in.addr * 10 + c - '0';
+        return true;
+    }
+    if (in.prefix == 2 && c == '/' && in.addr > 0) {
+        // the command takes the bus until its end
+        busSlot = slot;
+        readAddr = in.addr;
+        in.prefix = WEB_WS_COMMAND;
+        return true;
+    }
+    closeSocket(slot, 1007);  // invalid payload
+    return false;
+}
+
+void BasicWebServer::socketWrite(int slot, bool last) {
+    // Writes the staged command to the instrument. As for a VXI-11 write in parts, only the last part gets EOI and the terminator.
+    // The last character stays in the buffer until the end, so the last part is never empty.
+    WebSocketIn &in = socketIn[slot];
+    uint8_t n = last ? in.length : in.length - 1;
+    if (n == 0) {
+        return;
+    }
+    // Another server may have used the bus in between
+    if (gpibBus.cfg.paddr != readAddr || gpibBus.haveAddressedDevice() != TOLISTEN) {
+        gpibBus.cfg.paddr = readAddr;
+        gpibBus.cfg.saddr = 0xFF;
+        gpibBus.addressDevice(readAddr, 0xFF, TOLISTEN);
+    }
+    bool had_eoi = gpibBus.cfg.eoi;
+    uint8_t had_eos = gpibBus.cfg.eos;
+    if (!last) {
+        gpibBus.cfg.eoi = 0;
+        gpibBus.cfg.eos = 3;
+    }
+    gpibBus.sendData(startreq[slot], n, last);
+    gpibBus.cfg.eoi = had_eoi;
+    gpibBus.cfg.eos = had_eos;
+    startreq[slot][0] = startreq[slot][n];
+    in.length -= n;
+}
+
+void BasicWebServer::socketMessageEnd(int slot) {
+    WebSocketIn &in = socketIn[slot];
+    if (in.prefix == 2 && in.addr > 0) {
+        // "T/ADDR": no command
+        busSlot = slot;
+        readAddr = in.addr;
+        in.prefix = WEB_WS_COMMAND;
+    }
+    if (in.prefix != WEB_WS_COMMAND) {
+        closeSocket(slot, 1007);  // invalid payload
+        return;
+    }
+    socketWrite(slot, true);
+    gpibBus.unAddressDevice();
+    bool read = in.type == 2 || (in.type == 0 && in.last == '?');
+    in.prefix = 0;
+    in.last = 0;
+    if (read) {
+        // the reply is sent by readStep()
+        startRead(slot, in.addr);
+        return;
+    }
+    releaseBus();
+    // an empty message
+    static const uint8_t done[] = {0x82, 0x00};
+    clients[slot].write(done, sizeof(done));
+}
+
+void BasicWebServer::closeSocket(int slot, uint16_t status) {
+#ifdef LOG_WEB_DETAILS
+    debugPort.print(F("WebSocket closed with status "));
+    debugPort.println(status);
+#endif
+    uint8_t frame[4] = {0x88, 2, (uint8_t)(status >> 8), (uint8_t)(status & 0xFF)};
+    clients[slot].write(frame, sizeof(frame));
+    closeSlot(slot);
+}
+#endif
+
+void BasicWebServer::printInstruments(Print& p, uint32_t bitmap) {
+    for (int i = 0; i < 32; i++) {
+        if (bitmap & (1UL << i)) {
+            // this is a found instrument
+            printOption(p, "gpib,", i);
+        }
+    }
+}
+
+void BasicWebServer::handleRequest(int slot, int nrConnections) {
     // This is the main function that handles the request
-    // It will send a response to the client based on the request
+    // It will send a response to the client based on the request.
+    // A request that needs the GPIB bus while another slot holds it is left pending, and comes back in the next pass.
+
+    char *path = startreq[slot];
+#ifdef WEB_INTERACTIVE
+    // /fnd only needs the bus for a scan: when the map is not complete yet (after a boot or an IFC), when it is
+    // older than BUS_MAP_REFRESH (the background scan does not run while REN is asserted), or with ?force
+    bool scan = strcmp(path, "/fnd?force") == 0 || (strcmp(path, "/fnd") == 0 && gpibBus.busMapDue());
+    if (busSlot >= 0 && (scan || strncmp(path, "/ex", 3) == 0)) {
+        return;
+    }
+#endif
 
     char buff[512];
-    BufferedPrint bp(client, buff, sizeof(buff));
+    BufferedPrint bp(clients[slot], buff, sizeof(buff));
+    LengthPrint lp;
     bool isOK = false;       
-    if (path != NULL) {
-        if (strcmp(path,"/") == 0) {
-            // this is the root path
-            // send a response
-            sendResponseOK(bp, nrConnections);
-            isOK = true;                     
+    if (strcmp(path,"/") == 0) {
+        // this is the root path
+        // send a response
+        sendResponseOK(bp, etagMatch[slot]);
+        isOK = true;                     
+    } else if (strcmp(path,"/info") == 0) {
+        printInfo(lp, nrConnections);
+        bp.print(F("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nCache-Control: no-store\r\nContent-Length: "));
+        bp.print(lp.length);
+        bp.print(F("\r\n\r\n"));
+        printInfo(bp, nrConnections);
+        isOK = true;
+#ifdef USE_METRICS
+    } else if (strcmp(path,"/metrics") == 0 || strcmp(path,"/metrics.json") == 0
+               || strcmp(path,"/metrics?reset") == 0 || strcmp(path,"/metrics.json?reset") == 0) {
+        // Both passes must show the same values, so the gauges are read once, and ?reset clears the loop time after them
+        bool json = path[8] == '.';
+        metrics.snapshot();
+        metrics.print(lp, json);
+        bp.print(F("HTTP/1.1 200 OK\r\nContent-Type: "));
+        bp.print(json ? F("application/json") : F("text/plain; version=0.0.4"));
+        bp.print(F("\r\nCache-Control: no-store\r\nContent-Length: "));
+        bp.print(lp.length);
+        bp.print(F("\r\n\r\n"));
+        metrics.print(bp, json);
+        if (strchr(path, '?')) {
+            metrics.resetLoopMax();
+        }
+        isOK = true;
+#endif
 #ifdef WEB_INTERACTIVE            
-        } else if (strcmp(path,"/cnx") == 0) {
-            sendResponseHeaderPlainText(bp);
-            bp.print(nrConnections);
-            isOK = true;
-        } else if (strcmp(path,"/fnd") == 0) {
-            sendResponseHeaderPlainText(bp);
-            // this is the find command
-            // search for instruments on the bus, see fndl_h()
-            uint32_t bitmap = fndl();
-            for (int i = 0; i < 32; i++) {
-                if (bitmap & (1UL << i)) {
-                    // this is a found instrument
-                    printOption(bp, "gpib,", i);
-                }
-            }
-            isOK = true;
-        } else if (strncmp(path,"/ex",3) == 0) {
-            int cmd_type = -1;
-            int addr = -1;
-            int num_chars = -1;
-            int r = sscanf(path, "/ex%d/%d/%n", &cmd_type, &addr, &num_chars);
-            if (r == 2 && num_chars > 0 && cmd_type >= 0 && cmd_type < 3 && addr > 0 && addr < 32) {
-                // I have a path like /ex1/1/123
-                char *cmd = path + num_chars;
-                // now decode the command, in place. It can have %NN encoded characters
-                char *src = cmd;
-                char *dst = cmd;
-                bool copied = false;
-                while (*src) {
-                    copied = false;
-                    if (*src == '%') {
-                        // this is a %NN encoded character
-                        // convert the next two characters from a hex value
-                        // and store it in the destination
-                        char ch1 = *(src + 1);
-                        char ch2 = *(src + 2);
-                        if (ch1 && ch2) {
-                            int val1 = decodeHexDigit(ch1);
-                            int val2 = decodeHexDigit(ch2);
-                            if (val1 >= 0 && val2 >= 0) {
-                                // this is a valid %NN encoded character
-                                // convert it to the character and store it in the destination
-                                *dst = (val1 << 4) | val2;
-                                src += 2; // move the source pointer
-                                copied = true;
-                            }
-                        }
-                    }
-                    if (!copied) {
-                        // this is a normal character or something went wrong
-                        // just copy it to the destination
-                        *dst = *src;
-                    }
-                    src++;
-                    dst++;
-                }
-                *dst = '\0'; // null terminate the string
-                // now trim it
-                cmd = trim(cmd);
+    } else if (strcmp(path,"/fnd") == 0 || strcmp(path,"/fnd?force") == 0) {
+        // this is the find command
+        // the instruments on the bus come from the map of GPIBbus, Age tells how old it is in seconds
+        uint32_t bitmap = scan ? gpibBus.scanBusMap() : gpibBus.busMap;
+        printInstruments(lp, bitmap);
+        bp.print(F("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nAge: "));
+        bp.print((millis() - gpibBus.busMapTime) / 1000);
+        bp.print(F("\r\nContent-Length: "));
+        bp.print(lp.length);
+        bp.print(F("\r\n\r\n"));
+        printInstruments(bp, bitmap);
+        isOK = true;
+#ifdef USE_WEBSOCKET
+    } else if (strcmp(path,"/ws") == 0 && strlen(startreq[slot] + WEB_WS_KEY) == WEB_WS_KEY_SIZE) {
+        // the console of the page
+        startSocket(slot, bp);
+        return;
+#endif
+    } else if (strncmp(path,"/stream?",8) == 0) {
+        // Server-Sent Events: the query is repeated, and every reply is pushed as an event
+        startStream(slot, path + 8, bp);
+        return;
+    } else if (strncmp(path,"/ex",3) == 0) {
+        int cmd_type = -1;
+        int addr = -1;
+        int num_chars = -1;
+        int r = sscanf(path, "/ex%d/%d/%n", &cmd_type, &addr, &num_chars);
+        if (r == 2 && num_chars > 0 && cmd_type >= 0 && cmd_type < 3 && addr > 0 && addr < 32) {
+            // I have a path like /ex1/1/123
+            char *cmd = path + num_chars;
+            // now decode the command, in place. It can have %NN encoded characters
+            urlDecode(cmd);
+            // now trim it
+            cmd = trim(cmd);
 
 #ifdef LOG_WEB_DETAILS
-                debugPort.print(F("Got cmdtype "));
-                debugPort.print(cmd_type);
-                debugPort.print(F(" for address "));
-                debugPort.print(addr);
-                debugPort.print(F(": \""));
-                debugPort.print(cmd);
-                debugPort.println(F("\""));
+            debugPort.print(F("Got cmdtype "));
+            debugPort.print(cmd_type);
+            debugPort.print(F(" for address "));
+            debugPort.print(addr);
+            debugPort.print(F(": \""));
+            debugPort.print(cmd);
+            debugPort.println(F("\""));
 #endif                
 
-                // Handle the command
-                sendResponseHeaderPlainText(bp);
-                if (cmd_type == 0 || cmd_type == 1) {
-                    // this is the send command
-                    // send the command to the instrument
-                    gpibWrite(addr, cmd);
-                    isOK = true;
-                }
-                if ((cmd_type == 2) || (cmd_type == 0 && cmd[strlen(cmd)-1] == '?')) {
-                    // this is the read command
-                    // get the reply from the instrument
-                    // first print the header
-                    bp.flush();
-                    // and stream data directly to the client
-                    gpibRead(addr, client);
-                    isOK = true;
-                }
+            // Handle the command
+            if (cmd_type == 0 || cmd_type == 1) {
+                // this is the send command
+                // send the command to the instrument
+                gpibWrite(addr, cmd);
             }
-#endif            
+            if ((cmd_type == 2) || (cmd_type == 0 && *cmd && cmd[strlen(cmd)-1] == '?')) {
+                // this is the read command
+                // send the header, the reply of the instrument is streamed to the client by readStep()
+                sendResponseHeaderPlainText(bp, keepAlive[slot] ? WEB_LENGTH_CHUNKED : WEB_LENGTH_CLOSE);
+                bp.flush();
+                startRead(slot, addr);
+                return;
+            }
+            sendResponseHeaderPlainText(bp, 0);
+            isOK = true;
         }
+#endif            
     }
     if (!isOK) {
         // send an error response
         sendResponseErr(bp);
     }
     bp.flush();
+    finishRequest(slot);
 }
 
 void BasicWebServer::sendResponseErr(BufferedPrint& bp) {
-    bp.print(F("HTTP/1.1 404 Not Found\n"));
-}
-
-void BasicWebServer::sendResponseHeaderPlainText(BufferedPrint& bp){
-    // This is a simple response, no HTML
-    bp.print(F("HTTP/1.1 200 OK\nContent-Type: text/plain\nConnection: close\n\n"));
-}
-
-void BasicWebServer::printOption(BufferedPrint& bp, const char* name) {
-    bp.print(F("<option value=\""));
-    bp.print(name);
-    bp.print(F("\">"));
-    bp.print(name);
-    bp.print(F("</option>"));
-}
-
-void BasicWebServer::printOption(BufferedPrint& bp, const char* name, int nr) {
-    bp.print(F("<option value=\""));
-    bp.print(nr);
-    bp.print(F("\">"));
-    bp.print(name);
-    bp.print(nr);
-    bp.print(F("</option>"));
-}
-
-void BasicWebServer::sendResponseOK(BufferedPrint& bp, int nrConnections) {
-    // This is the main page of the server. All other valid URLs return to this page.
-    // The refresh is done via meta, allowing the page URL to be "reset" to the main page upon refresh
-    //
-    // The server construct the HTML streaming via buffer, as that greatly lowers the amount of network packets
-    // If I do client.print, 1 character is sent at a time, using up 2 network packets per character
-
-    // TODO: thoughts about ROM size optimisation:
-    // a function call in AVR GCC costs 6 or 8 bytes (depending if the called function is far away: RCALL or CALL)
-    // So: there is no use in splitting the HTML template into many smaller functions
-    
-    bp.print(F("HTTP/1.1 200 OK\nContent-Type: text/html\nConnection: close\n\n"));  
-    bp.print(F("<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\" /> "
-        "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\" /> "
-        "<title>Ethernet2GPIB</title><style> body { font-family: Arial, sans-serif; } "
-#if defined(INTERFACE_VXI11) || defined(WEB_INTERACTIVE)
-        "table { text-align: left; border-collapse: collapse; } "
-        "th, td { padding: 2px 8px; white-space: nowrap; vertical-align: top; } "
-        "th { padding-top: 8px; } "
-        "button { margin: 0px 2px; color: white; background-color: #666; padding: 2px 12px; border-radius: 4px; border: 1px solid #888; cursor: pointer; } "
-        "textarea { width: 100%; } input { width: 100%; } h2 { border-bottom: 2px solid grey; }"
-#endif
-        "</style></head><body><h1>" DEVICE_NAME "</h1><p>Number of client connections: <span id=\"cnx\">"));
-    bp.print(nrConnections);
-    bp.print(F("</span></p>\n"));
-#ifdef INTERFACE_PROLOGIX
-    bp.print(F("<h2>Prologix GPIB Ethernet Server</h2><p>IP Address: "));
-    bp.print(Ethernet.localIP());
-    bp.print(F("</p>"));
-#endif
-#ifdef INTERFACE_VXI11
-    bp.print(F("<h2>VXI-11, VISA connection strings</h2><table><tr><td>Controller:</td><td><b>TCPIP::"));
-    bp.print(Ethernet.localIP());
-    bp.print(F("::INSTR</b> (unless you have set the default instrument address to something else than 0)</td></tr><tr><td>Instruments:</td><td><b>TCPIP::"));
-    bp.print(Ethernet.localIP());
-    bp.print(F("::gpib,<i>N</i>::INSTR</b> or <b>...::inst<i>N</i>::INSTR</b>, where <i>N</i> is their address on the GPIB bus (1..30)</td></tr></table>"));
-#endif
-#ifdef WEB_INTERACTIVE
-    bp.print(F("<h2>Interactive IO</h2>"
-        "<table><tr><td colspan=\"3\">Send remote programming (SCPI) commands and queries to the instrument and view the responses returned by the instrument.<br /></td></tr> "
-        "<tr><th>Instruments</th><th colspan=\"2\">Command</th></tr> "
-        "<tr><td rowspan=\"4\"><select id=\"inst\" size=\"4\" style=\"width: 8ch; overflow-y: auto;\"></select><br /><button onclick=\"find()\">Find</button></td>"
-        "<td width=\"80%\"><input type=\"text\" id=\"cmd\" maxlength=100 value=\"\" /></td><td><button onclick=\"self.cmd.value=self.pre.value\">&lt;</button>"
-        "<select id=\"pre\">"));
-    printOption(bp, "*IDN?");
-    printOption(bp, "*RST");
-    printOption(bp, "*OPC?");
-    printOption(bp, "*CLS");
-    printOption(bp, ":SYSTem:ERRor?");
-    bp.print(F("</select></td></tr><tr><td colspan=\"2\">"
-        "<button id=\"ex\" onclick=\"ex(0)\">Query</button>"
-        "&nbsp;&nbsp;<button onclick=\"ex(1)\" style=\"background-color: #888;\">Send</button> "
-        "<button onclick=\"ex(2)\" style=\"background-color: #888;\">Read</button> "
-        "</td></tr>"
-        "<tr><th colspan=\"2\">History</th></tr><tr><td colspan=\"2\"><textarea id=\"r\" rows=\"10\" cols=\"80\" readonly></textarea><br /> "
-        "<button onclick=\"self.r.value=''; scroll()\">Clear history</button></td></tr></table>\n"
-        "<script>\nfunction tick() { fetch(\"/cnx\") .then((response) => { if (!response.ok) { return \"?\"; } return response.text(); }) .then((data) => { self.cnx.innerHTML = data; }); }\nsetInterval(tick, 5000);"
-        "function find() { fetch(\"/fnd\") .then((response) => { if (!response.ok) { throw new Error(\"ERR: \" + response.statusText); } return response.text(); }) .then((data) => { self.inst.innerHTML = data; }); };\n"
-        "function ex(t) { const inst = self.inst.value; const cmd = self.cmd.value;\nif (inst === \"\") { alert(\"Please select an instrument\"); return; }\n"
-        "var m = \"/ex\" + t.toString() + \"/\" + inst + \"/\";\n"
-        "if (t < 2) { if (cmd === \"\") { alert(\"Please enter a command\"); return; } m += cmd; }\n"  // no encodeURIComponent here, decoding that would require a lot of code and ROM
-        "self.r.value = \"\\n\" + self.r.value; document.body.style.cursor = 'wait'; document.getElementById(\"ex\").style.cursor = 'wait'; "
-        "fetch(m) .then((response) => { document.body.style.cursor = 'default'; document.getElementById(\"ex\").style.cursor = 'default'; if (!response.ok) { throw new Error(\"ERR: \" + response.statusText); } return response.text(); })\n"
-        ".then((data) => { "
-        "if ((t === 2)||((t === 0)&&(data !== \"\"))) { self.r.value = \"<= \" + inst + \": \" + data.trim() + \"\\n\" + self.r.value; }\n"
-        "if (t < 2) { self.r.value = \"=> \" + inst + \": \" + cmd + \"\\n\" + self.r.value; }\n" 
-        "scroll(); }); };\n"
-        "function scroll() { self.r.scrollTop = 0; }\n"
-        "document.querySelector(\"#cmd\").addEventListener(\"keyup\", event => { "
-        "if(event.key !== \"Enter\") return; "
-        "document.querySelector(\"#ex\").click(); "
-        "event.preventDefault(); });\n"
-        "</script>\n"));
-#endif
-    bp.print(F("</body></html>\n\n"));
+    bp.print(F("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"));
+}
+
+void BasicWebServer::sendResponseHeaderPlainText(BufferedPrint& bp, long length){
+    // This is a simple response, no HTML.
+    // The connection stays open if the length is known, or if the reply is sent in chunks.
+    // Otherwise (HTTP/1.0) the end of the reply is marked by closing the connection.
+    bp.print(F("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"));
+    if (length == WEB_LENGTH_CHUNKED) {
+        bp.print(F("Transfer-Encoding: chunked\r\n\r\n"));
+    } else if (length == WEB_LENGTH_CLOSE) {
+        bp.print(F("Connection: close\r\n\r\n"));
+    } else {
+        bp.print(F("Content-Length: "));
+        bp.print(length);
+        bp.print(F("\r\n\r\n"));
+    }
 }
-#endif
\ No newline at end of file
+
+void BasicWebServer::printOption(Print& p, const char* name, int nr) {
+    p.print(F("<option value=\""));
+    p.print(nr);
+    p.print(F("\">"));
+    p.print(name);
+    p.print(nr);
+    p.print(F("</option>"));
+}
+
+void BasicWebServer::sendResponseOK(BufferedPrint& bp, bool cached) {
+    // This is the main page of the server. It is static, and compressed at build time (see tools/gen_web_page.py):
+    // the browser checks its ETag on every load (no-cache), and only gets the page again after a firmware update.
+    // The values of the gateway come from /info.
+    if (cached) {
+        bp.print(F("HTTP/1.1 304 Not Modified\r\nETag: " WEB_PAGE_ETAG "\r\n\r\n"));
+        return;
+    }
+    bp.print(F("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\n"
+        "Cache-Control: no-cache\r\nETag: " WEB_PAGE_ETAG "\r\nContent-Length: "));
+    bp.print(WEB_PAGE_SIZE);
+    bp.print(F("\r\n\r\n"));
+    for (size_t i = 0; i < WEB_PAGE_SIZE; i++) {
+        bp.write(pgm_read_byte(&webPage[i]));
+    }
+}
+
+void BasicWebServer::printInfo(Print& p, int nrConnections) {
+    // JSON with the values shown on the page. DEVICE_NAME has no quotes, but ends with a newline.
+    p.print(F("{\"name\":\""));
+    for (size_t i = 0; i < sizeof(deviceName) - 1; i++) {
+        char c = pgm_read_byte(&deviceName[i]);
+        if (c >= ' ') {
+            p.print(c);
+        }
+    }
+    p.print(F("\",\"ip\":\""));
+    p.print(Ethernet.localIP());
+    p.print(F("\",\"cnx\":"));
+    p.print(nrConnections);
+    p.print('}');
+}
+#endif
@@ -4,30 +4,115 @@
 #include <StreamLib.h>
 #include "config.h"
 
-#define MAX_WEB_CLIENTS 1
-
 #define MAX_START_LINE_LENGTH 256
 
+// The reply of an instrument is collected in the request line buffer of the slot, and sent as HTTP chunks:
+// a chunk is a 3 digit hex size and CRLF, the data, and CRLF
+#define WEB_CHUNK_HEAD 5
+#define WEB_CHUNK_DATA (MAX_START_LINE_LENGTH - WEB_CHUNK_HEAD - 2)
+
+// A /stream slot keeps its query at the start of the same buffer, and collects the reply of the instrument
+// after it, behind the "data: " of a Server-Sent Event
+#define WEB_STREAM_DATA (WEB_STREAM_QUERY_SIZE + 6)
+#define WEB_STREAM_REPLY (MAX_START_LINE_LENGTH - WEB_STREAM_DATA - 2)
+
+// A /ws request keeps its Sec-WebSocket-Key at the end of the buffer, behind the request line
+#define WEB_WS_KEY_SIZE 24
+#define WEB_WS_KEY (MAX_START_LINE_LENGTH - WEB_WS_KEY_SIZE - 1)
+// A WebSocket stages the command for the instrument at the start of the buffer, and the payload of a ping at the end
+#define WEB_WS_CONTROL_SIZE 125
+#define WEB_WS_CONTROL (MAX_START_LINE_LENGTH - WEB_WS_CONTROL_SIZE)
+
+#define WEB_NO_MATCH 0xFF
+
+// Special lengths for sendResponseHeaderPlainText()
+#define WEB_LENGTH_CHUNKED -1
+#define WEB_LENGTH_CLOSE -2
+
+// State of a web client slot
+enum webSlotState {
+    WEB_FREE = 0,     // no client
+    WEB_REQUEST,      // reading a request, or waiting for the next one on a keep-alive connection
+    WEB_PENDING,      // complete request that needs the GPIB bus, waiting for it
+    WEB_READING,      // streaming the reply of an instrument to the client
+    WEB_STREAM,       // /stream: waiting for the next query
+    WEB_SOCKET        // /ws: reading the messages of the client, and writing the commands to the instrument
+};
+
+// Reading a WebSocket frame, and the command in its message. See BasicWebServer::socketStep().
+struct WebSocketIn {
+    uint8_t head[8];  // frame header: 2 bytes, 2 bytes of length if needed, 4 bytes of mask
+    uint8_t headLength; // bytes of the header read, the payload follows when it is complete
+    uint16_t left;    // bytes of the payload left
+    uint8_t pos;      // bytes of the payload read, for the mask and the payload of a ping
+    uint8_t prefix;   // position in the "T/ADDR/" before the command, WEB_WS_COMMAND once in the command
+    uint8_t type;     // T: 0 query, 1 write, 2 read, as for /ex
+    uint8_t addr;     // ADDR: the GPIB address
+    uint8_t length;   // bytes of the command staged in the buffer of the slot
+    char last;        // last character of the command that is not a space, a query ends with '?'
+};
+#define WEB_WS_COMMAND 3
+
 class BasicWebServer {
 public:
     BasicWebServer();
     void begin();
     void loop(int nrConnections);
     void killClients(void);
+    bool freeSocket(void);
 
 private:
     int nr_connections(void);
-    bool have_free_connections(void);
-    void handleRequest(EthernetClient& client, char* path, int nrConnections);
+    int idleSlot(unsigned long minIdle = 0);
+    void acceptClient(void);
+    void readRequest(int slot, int nrConnections);
+    void closeSlot(int slot);
+    void finishRequest(int slot);
+    void handleRequest(int slot, int nrConnections);
+    void startRead(int slot, int addr);
+    void readStep(int slot);
+    void flushRead(int slot, bool last = false);
+    void releaseBus(void);
+    void startStream(int slot, char *params, BufferedPrint& bp);
+    void streamStep(int slot);
+    void sendEvent(int slot, bool timeout);
+#ifdef USE_WEBSOCKET
+    void startSocket(int slot, BufferedPrint& bp);
+    void socketStep(int slot);
+    bool socketFrameEnd(int slot);
+    bool socketCommand(int slot, char c);
+    void socketWrite(int slot, bool last);
+    void socketMessageEnd(int slot);
+    void closeSocket(int slot, uint16_t status);
+#endif
     void sendResponseErr(BufferedPrint& bp);
-    void sendResponseOK(BufferedPrint& bp, int nrConnections);
-    void sendResponseHeaderPlainText(BufferedPrint& bp);
+    void sendResponseOK(BufferedPrint& bp, bool cached);
+    void printInfo(Print& p, int nrConnections);
+    void sendResponseHeaderPlainText(BufferedPrint& bp, long length);
     EthernetServer server = EthernetServer(80);
     EthernetClient clients[MAX_WEB_CLIENTS];
+    webSlotState state[MAX_WEB_CLIENTS];
     bool currentLineIsBlank[MAX_WEB_CLIENTS]; // if the current line is blank (marks the end of the request)
+    bool keepAlive[MAX_WEB_CLIENTS]; // keep the connection open after the reply (HTTP/1.1 GET)
+    uint8_t etagPos[MAX_WEB_CLIENTS]; // position in etagHeader of the current header line, WEB_NO_MATCH if it does not match
+    bool etagMatch[MAX_WEB_CLIENTS]; // the request has the ETag of the page: the browser has it already
+#ifdef USE_WEBSOCKET
+    uint8_t keyPos[MAX_WEB_CLIENTS]; // position in keyHeader of the current header line, then in the key, WEB_NO_MATCH if it does not match
+    bool webSocket[MAX_WEB_CLIENTS]; // the connection is a WebSocket
+    WebSocketIn socketIn[MAX_WEB_CLIENTS]; // the frame that is being read on a WebSocket
+    bool readFragment; // busSlot is a WebSocket that has sent a part of the reply already
+#endif
     int charsRead[MAX_WEB_CLIENTS]; // The total number of characters read into the startreq buffer
-    char startreq[MAX_WEB_CLIENTS][MAX_START_LINE_LENGTH]; // buffer for the request line
+    unsigned long lastActivity[MAX_WEB_CLIENTS]; // millis() of the last request data, or of the last data from the instrument
+    char startreq[MAX_WEB_CLIENTS][MAX_START_LINE_LENGTH]; // buffer for the request line, then the path of the request
+    int8_t busSlot = -1; // the slot whose job holds the GPIB bus, -1 if none
+    uint8_t readAddr; // address of the instrument being read by busSlot
+    size_t readLen; // number of bytes of the reply in the staging buffer of busSlot
+    uint8_t readBytes[3]; // last bytes of the reply, for the terminator detection of receiveDataPart()
+    uint8_t streamAddr[MAX_WEB_CLIENTS]; // /stream: address of the instrument
+    uint16_t streamPeriod[MAX_WEB_CLIENTS]; // /stream: time in ms between two queries, 0 if the slot is no stream
+    unsigned long streamNext[MAX_WEB_CLIENTS]; // /stream: millis() of the next query
 
-    void printOption(BufferedPrint& bp, const char* name);
-    void printOption(BufferedPrint& bp, const char* name, int nr);
+    void printOption(Print& p, const char* name, int nr);
+    void printInstruments(Print& p, uint32_t bitmap);
 };
@@ -0,0 +1,149 @@
+import argparse
+import socket
+import struct
+import time
+import pyvisa
+
+
+# HiSLIP message types, see IVI-6.1
+INITIALIZE = 0
+INITIALIZE_RESPONSE = 1
+FATAL_ERROR = 2
+ERROR = 3
+DATA = 6
+DATA_END = 7
+ASYNC_MAXIMUM_MESSAGE_SIZE = 15
+ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE = 16
+ASYNC_INITIALIZE = 17
+ASYNC_INITIALIZE_RESPONSE = 18
+ASYNC_STATUS_QUERY = 21
+ASYNC_STATUS_RESPONSE = 22
+
+HEADER = struct.Struct(">2sBBIQ")
+
+
+class HiSLIPClient:
+    """A minimal HiSLIP client in synchronized mode, enough to benchmark the gateway without a VISA that supports HiSLIP."""
+
+    def __init__(self, host: str, sub_address: str = "hislip0", port: int = 4880, timeout: float = 10.0):
+        self.message_id = 0xFFFFFF00
+        self.sync = socket.create_connection((host, port), timeout=timeout)
+        self.sync.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        # protocol version 1.0, vendor id "PY"
+        self._send(self.sync, INITIALIZE, 0, (0x0100 << 16) | 0x5059, sub_address.encode())
+        msg_type, control, parameter, _ = self._receive(self.sync)
+        if msg_type != INITIALIZE_RESPONSE:
+            raise IOError(f"Unexpected reply {msg_type} to Initialize")
+        self.session_id = parameter & 0xFFFF
+        self.overlap = bool(control & 1)
+        self.asynchronous = socket.create_connection((host, port), timeout=timeout)
+        self.asynchronous.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self._send(self.asynchronous, ASYNC_INITIALIZE, 0, self.session_id)
+        msg_type, _, parameter, _ = self._receive(self.asynchronous)
+        if msg_type != ASYNC_INITIALIZE_RESPONSE:
+            raise IOError(f"Unexpected reply {msg_type} to AsyncInitialize")
+        self.server_vendor = struct.pack(">H", parameter & 0xFFFF).decode(errors="replace")
+        self._send(self.asynchronous, ASYNC_MAXIMUM_MESSAGE_SIZE, 0, 0, struct.pack(">Q", 1 << 20))
+        msg_type, _, _, payload = self._receive(self.asynchronous)
+        if msg_type != ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE:
+            raise IOError(f"Unexpected reply {msg_type} to AsyncMaximumMessageSize")
+        self.max_message_size = struct.unpack(">Q", payload)[0]
+
+    @staticmethod
+    def _send(sock, msg_type: int, control: int, parameter: int, payload: bytes = b""):
+        sock.sendall(HEADER.pack(b"HS", msg_type, control, parameter, len(payload)) + payload)
+
+    @staticmethod
+    def _receive_exactly(sock, size: int) -> bytes:
+        data = b""
+        while len(data) < size:
+            chunk = sock.recv(size - len(data))
+            if not chunk:
+                raise IOError("Connection closed")
+            data += chunk
+        return data
+
+    def _receive(self, sock):
+        prologue, msg_type, control, parameter, length = HEADER.unpack(self._receive_exactly(sock, HEADER.size))
+        if prologue != b"HS":
+            raise IOError("Not a HiSLIP message")
+        payload = self._receive_exactly(sock, length) if length else b""
+        if msg_type in (FATAL_ERROR, ERROR):
+            raise IOError(f"HiSLIP error {control}: {payload.decode(errors='replace')}")
+        return msg_type, control, parameter, payload
+
+    def write(self, message: str):
+        data = message.encode()
+        while len(data) > self.max_message_size:
+            self._send(self.sync, DATA, 0, self.message_id, data[:self.max_message_size])
+            data = data[self.max_message_size:]
+            self.message_id = (self.message_id + 2) & 0xFFFFFFFF
+        self._send(self.sync, DATA_END, 0, self.message_id, data)
+        self.message_id = (self.message_id + 2) & 0xFFFFFFFF
+
+    def read(self) -> str:
+        data = b""
+        while True:
+            msg_type, _, _, payload = self._receive(self.sync)
+            data += payload
+            if msg_type == DATA_END:
+                return data.decode(errors="replace")
+
+    def query(self, message: str) -> str:
+        self.write(message)
+        return self.read()
+
+    def read_stb(self) -> int:
+        self._send(self.asynchronous, ASYNC_STATUS_QUERY, 0, self.message_id)
+        msg_type, control, _, _ = self._receive(self.asynchronous)
+        if msg_type != ASYNC_STATUS_RESPONSE:
+            raise IOError(f"Unexpected reply {msg_type} to AsyncStatusQuery")
+        return control
+
+    def close(self):
+        self.asynchronous.close()
+        self.sync.close()
+
+
+def benchmark(name: str, query, count: int, message: str):
+    print(f"{name}: ", end='', flush=True)
+    try:
+        reply = query(message).strip()
+        start = time.perf_counter()
+        for _ in range(count):
+            query(message)
+        delta_time = time.perf_counter() - start
+    except Exception as e:
+        print(f"Error: {e}")
+        return
+    print(f"\"{reply}\", {count} times in {delta_time:.2f} s, {delta_time * 1000 / count:.1f} ms per query.")
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Benchmark the HiSLIP server of the gateway against its VXI-11 server.",
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument("host", help="The IP address or hostname of the gateway.")
+    parser.add_argument("-a", type=int, default=0, help="GPIB address of the instrument, 0 is the gateway (or the default instrument).")
+    parser.add_argument("-n", type=int, default=100, help="Number of queries per protocol.")
+    parser.add_argument("-m", default="*IDN?", help="The query to send.")
+    parser.add_argument("-s", action="store_true", default=False, help="Also benchmark the status byte read.")
+    parser.add_argument("-t", type=int, default=10000, help="Timeout for any operation in milliseconds.")
+    args = parser.parse_args()
+
+    hislip = HiSLIPClient(args.host, f"hislip{args.a}", timeout=args.t / 1000)
+    print(f"HiSLIP session {hislip.session_id} with vendor \"{hislip.server_vendor}\", "
+          f"{'overlapped' if hislip.overlap else 'synchronized'} mode, maximum message size {hislip.max_message_size}.")
+    benchmark("HiSLIP query", hislip.query, args.n, args.m)
+    if args.s:
+        benchmark("HiSLIP read_stb", lambda m: str(hislip.read_stb()), args.n, "")
+    hislip.close()
+
+    rm = pyvisa.ResourceManager()
+    resource = f"TCPIP::{args.host}::gpib0,{args.a}::INSTR" if args.a else f"TCPIP::{args.host}::INSTR"
+    inst = rm.open_resource(resource, timeout=args.t)
+    benchmark("VXI-11 query", inst.query, args.n, args.m)
+    if args.s:
+        benchmark("VXI-11 read_stb", lambda m: str(inst.read_stb()), args.n, "")
+    inst.close()
+
+    print("Done.")
@@ -0,0 +1,126 @@
+import argparse
+import socket
+import struct
+import time
+
+
+MDNS_GROUP = "224.0.0.251"
+MDNS_PORT = 5353
+
+TYPES = {1: "A", 12: "PTR", 16: "TXT", 33: "SRV", 255: "ANY"}
+
+
+def encode_name(name: str) -> bytes:
+    data = b""
+    for label in name.rstrip(".").split("."):
+        data += bytes([len(label)]) + label.encode()
+    return data + b"\0"
+
+
+def decode_name(packet: bytes, pos: int):
+    """Returns the name at pos and the offset after it, following the compression pointers."""
+    labels = []
+    end = None
+    for _ in range(64):
+        length = packet[pos]
+        if length == 0:
+            return ".".join(labels), (end if end is not None else pos + 1)
+        if length & 0xC0 == 0xC0:
+            if end is None:
+                end = pos + 2
+            pos = ((length & 0x3F) << 8) | packet[pos + 1]
+            continue
+        labels.append(packet[pos + 1:pos + 1 + length].decode(errors="replace"))
+        pos += length + 1
+    raise ValueError("Compression loop")
+
+
+def parse_response(packet: bytes):
+    """Returns the id and the records of a DNS response as (name, type, ttl, cache flush, value)."""
+    qid, flags, nr_questions, nr_answers, nr_authority, nr_additional = struct.unpack(">HHHHHH", packet[:12])
+    if not flags & 0x8000:
+        raise ValueError("Not a response")
+    pos = 12
+    for _ in range(nr_questions):
+        _, pos = decode_name(packet, pos)
+        pos += 4
+    records = []
+    for _ in range(nr_answers + nr_authority + nr_additional):
+        name, pos = decode_name(packet, pos)
+        rtype, rclass, ttl, size = struct.unpack(">HHIH", packet[pos:pos + 10])
+        pos += 10
+        rdata = packet[pos:pos + size]
+        if rtype == 1:
+            value = socket.inet_ntoa(rdata)
+        elif rtype == 12:
+            value = decode_name(packet, pos)[0]
+        elif rtype == 33:
+            priority, weight, port = struct.unpack(">HHH", rdata[:6])
+            value = f"{decode_name(packet, pos + 6)[0]}:{port} (priority {priority}, weight {weight})"
+        elif rtype == 16:
+            strings, i = [], 0
+            while i < len(rdata):
+                strings.append(rdata[i + 1:i + 1 + rdata[i]].decode(errors="replace"))
+                i += rdata[i] + 1
+            value = " ".join(strings)
+        else:
+            value = rdata.hex()
+        records.append((name, TYPES.get(rtype, str(rtype)), ttl, bool(rclass & 0x8000), value))
+        pos += size
+    return qid, records
+
+
+def query(name: str, qtype: int, target: str, timeout: float):
+    """Sends a legacy unicast query (from another port than 5353) and returns the responses received within timeout."""
+    qid = int(time.time() * 1000) & 0xFFFF
+    packet = struct.pack(">HHHHHH", qid, 0, 1, 0, 0, 0) + encode_name(name) + struct.pack(">HH", qtype, 1)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 255)
+    sock.settimeout(timeout)
+    start = time.perf_counter()
+    sock.sendto(packet, (target, MDNS_PORT))
+    responses = []
+    while True:
+        remaining = timeout - (time.perf_counter() - start)
+        if remaining <= 0:
+            break
+        sock.settimeout(remaining)
+        try:
+            data, sender = sock.recvfrom(9000)
+        except socket.timeout:
+            break
+        elapsed = time.perf_counter() - start
+        try:
+            response_id, records = parse_response(data)
+        except (ValueError, IndexError, struct.error) as e:
+            print(f"Malformed response from {sender[0]}: {e}")
+            continue
+        if response_id == qid:
+            responses.append((sender[0], elapsed, records))
+    sock.close()
+    return responses
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Query the mDNS responder of the gateway and show its records.",
+                                     formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument("names", nargs="*", default=["_vxi-11._tcp.local", "_lxi._tcp.local", "_scpi-raw._tcp.local",
+                                                      "_hislip._tcp.local"],
+                        help="The names to query, e.g. a service type or ethernet2gpib-xxxx.local.")
+    parser.add_argument("-d", default=MDNS_GROUP, help="Send the queries to this address instead of the mDNS group, "
+                                                         "e.g. the IP address of the gateway.")
+    parser.add_argument("-t", type=int, default=1000, help="Time to wait for responses in milliseconds.")
+    args = parser.parse_args()
+
+    for name in args.names:
+        print(f"{name}:")
+        qtype = 12 if name.startswith("_") or "._tcp." in name else 1
+        responses = query(name, qtype, args.d, args.t / 1000)
+        if not responses:
+            print("    no response")
+        for sender, elapsed, records in responses:
+            print(f"    from {sender} after {elapsed * 1000:.1f} ms:")
+            for record_name, record_type, ttl, flush, value in records:
+                print(f"        {record_name} {record_type} ttl {ttl}{' (flush)' if flush else ''}: {value}")
+
+    print("Done.")
@@ -8,3 +8,73 @@ inst18 = rm.open_resource("GPIB::18::INSTR")
 print(inst1.query("*IDN?"))
 print(inst2.query("*IDN?"))
 print(inst18.query("*ID?"))
+
+# and a quick benchmark of the round trip through the gateway
+import time
+n = 100
+start = time.perf_counter()
+for _ in range(n):
+    inst1.query("*IDN?")
+delta_time = time.perf_counter() - start
+print(f"{n} queries in {delta_time:.2f} s, {delta_time * 1000 / n:.1f} ms per query.")
+
+
+# binary read via a raw socket with ++read bin: frames of a 3 byte header (size, receive state) and the data
+import socket
+import struct
+
+
+def receive_exactly(sock: socket.socket, size: int) -> bytes:
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise IOError("Connection closed")
+        data += chunk
+    return data
+
+
+def read_binary(sock: socket.socket) -> (bytes, int):
+    data = b""
+    while True:
+        size, state = struct.unpack(">HB", receive_exactly(sock, 3))
+        block = receive_exactly(sock, size)
+        data += block
+        if state != 7:  # 7: more frames follow, 4: EOI, 8: timeout
+            return data, state
+
+
+with socket.create_connection(("192.168.7.206", 1234), timeout=10) as sock:
+    sock.sendall(b"++auto 0\n++addr 1\n*IDN?\n")
+    start = time.perf_counter()
+    sock.sendall(b"++read bin\n")
+    data, state = read_binary(sock)
+    print(f"{len(data)} bytes, state {state}, in {(time.perf_counter() - start) * 1000:.1f} ms: {data!r}")
+
+
+# pipelined commands: all the lines of one segment are executed in one pass, the replies come back together
+with socket.create_connection(("192.168.7.206", 1234), timeout=10) as sock:
+    n = 50
+    start = time.perf_counter()
+    sock.sendall(b"++auto 0\n" + b"++ver\n" * n)
+    lines = b""
+    while lines.count(b"\n") < n:
+        lines += sock.recv(4096)
+    print(f"{n} pipelined ++ver in {(time.perf_counter() - start) * 1000:.1f} ms.")
+
+
+# timed acquisition: the adapter sends the query every 200 ms, we collect the samples in batches
+with socket.create_connection(("192.168.7.206", 1234), timeout=10) as sock:
+    sock.sendall(b"++auto 0\n++addr 1\n++repeat 20 200 *IDN?\n")
+    samples = []
+    while len(samples) < 20:
+        time.sleep(1)
+        sock.sendall(b"++repeat read\n++repeat\n")
+        lines = b""
+        while not lines.endswith(b"\n") or b"running" not in lines and b"stopped" not in lines:
+            lines += sock.recv(4096)
+        *data, status = lines.decode().splitlines()
+        samples += [line.split(",", 2) for line in data]
+        print(status)
+    times = [int(t) for _, t, _ in samples]
+    print(f"periods: {[round((b - a) / 1000, 3) for a, b in zip(times, times[1:])]} ms")
@@ -0,0 +1,151 @@
+"""
+Generates src/prologix_commands.h, the PROGMEM table of the Prologix ++ commands.
+
+getCmd() finds a command with a perfect hash of its token: the hash selects a slot in cmdSlots[],
+which holds the index of the command in cmdHidx[] (or 0xFF), and one strcasecmp_P() confirms the
+token. The hash has to match prologixHash() in prologix_server.cpp:
+
+    h = seed
+    for every character c: h = (uint16_t)(h * multiplier + (c | 0x20))
+    slot = (h ^ (h >> 8)) & (PROLOGIX_CMD_SLOTS - 1)
+
+This script searches for a seed and multiplier without collisions. To add a command, add it to
+COMMANDS below and rebuild: PlatformIO runs this script before every build (extra_scripts in
+platformio.ini), it can also be run by hand with "python tools/gen_prologix_commands.py".
+"""
+
+import os
+
+# token, mode (1=device; 2=controller; 3=both), handler
+COMMANDS = [
+    ("addr",        3, "addr_h"),
+    ("allspoll",    2, "aspoll_h"),
+    ("auto",        2, "amode_h"),
+    ("clr",         2, "clr_h"),
+    ("dcl",         2, "dcl_h"),
+    ("default",     3, "default_h"),
+    ("eoi",         3, "eoi_h"),
+    ("eor",         3, "eor_h"),
+    ("eos",         3, "eos_h"),
+    ("eot_char",    3, "eot_char_h"),
+    ("eot_enable",  3, "eot_en_h"),
+    ("flags",       2, "hflags_h"),
+    ("fndl",        2, "fndl_h"),
+    ("help",        3, "help_h"),
+    ("ifc",         2, "ifc_h"),
+    ("id",          3, "id_h"),
+    ("idn",         3, "idn_h"),
+    ("llo",         2, "llo_h"),
+    ("loc",         2, "loc_h"),
+    ("lon",         1, "lon_h"),
+    ("macro",       2, "macro_h"),
+    ("mode",        3, "cmode_h"),
+    ("ppoll",       2, "ppoll_h"),
+    ("prom",        1, "prom_h"),
+    ("read",        2, "read_h"),
+    ("read_tmo_ms", 2, "rtmo_h"),
+    ("ren",         2, "ren_h"),
+    ("repeat",      2, "repeat_h"),
+    ("rst",         3, "rst_h"),
+    ("trg",         2, "trg_h"),
+    ("savecfg",     3, "save_h"),
+    ("send",        2, "send_h"),
+    ("setvstr",     3, "setvstr_h"),
+    ("spoll",       2, "spoll_h"),
+    ("srq",         2, "srq_h"),
+    ("srqauto",     2, "srqa_h"),
+    ("status",      1, "stat_h"),
+    ("tct",         2, "tct_h"),
+    ("ton",         1, "ton_h"),
+    ("unl",         2, "unlisten_h"),
+    ("unt",         2, "untalk_h"),
+    ("ver",         3, "ver_h"),
+    ("verbose",     3, "verb_h"),
+    ("xdiag",       3, "xdiag_h"),
+]
+
+MULTIPLIERS = range(3, 256, 2)
+
+
+def command_hash(token: str, seed: int, multiplier: int) -> int:
+    h = seed
+    for c in token.encode():
+        h = (h * multiplier + (c | 0x20)) & 0xFFFF
+    return h ^ (h >> 8)
+
+
+def find_hash(tokens, slots: int):
+    """Returns the first (seed, multiplier) that maps every token to a different slot."""
+    for multiplier in MULTIPLIERS:
+        for seed in range(256):
+            used = {command_hash(t, seed, multiplier) & (slots - 1) for t in tokens}
+            if len(used) == len(tokens):
+                return seed, multiplier
+    return None
+
+
+def generate() -> str:
+    tokens = [t for t, _, _ in COMMANDS]
+    assert len(set(t.lower() for t in tokens)) == len(tokens), "Duplicate command token"
+    assert len(tokens) < 0xFF, "Too many commands for an 8 bit index"
+    slots = 128
+    while True:
+        found = find_hash(tokens, slots)
+        if found:
+            break
+        slots *= 2
+    seed, multiplier = found
+
+    table = [0xFF] * slots
+    for i, (token, _, _) in enumerate(COMMANDS):
+        table[command_hash(token, seed, multiplier) & (slots - 1)] = i
+
+    lines = [
+        "#pragma once",
+        "",
+        "/*!",
+        "  @file   prologix_commands.h",
+        "  @brief  Perfect hash table of the Prologix ++ commands, in PROGMEM.",
+        "",
+        "  GENERATED by tools/gen_prologix_commands.py, do not edit: change the script and rebuild.",
+        "  Included by prologix_server.cpp after the prototypes of the handlers.",
+        "*/",
+        "",
+        f"#define PROLOGIX_CMD_SLOTS {slots}  ///< Size of cmdSlots[], a power of 2",
+        f"#define PROLOGIX_CMD_SEED {seed}  ///< Start value of prologixHash()",
+        f"#define PROLOGIX_CMD_MULTIPLIER {multiplier}  ///< Multiplier of prologixHash()",
+        "",
+    ]
+    for i, (token, _, _) in enumerate(COMMANDS):
+        lines.append(f'static const char cmdToken{i}[] PROGMEM = "{token}";')
+    lines += ["", "/***** Commands, format: token, mode, handler *****/",
+              "static const cmdRec cmdHidx[] PROGMEM = {"]
+    for i, (token, mode, handler) in enumerate(COMMANDS):
+        sep = "," if i < len(COMMANDS) - 1 else ""
+        lines.append(f"  {{ cmdToken{i}, {mode}, (cmdHandler) {handler} }}{sep}")
+    lines += ["};", "", "/***** Index in cmdHidx[] of the command with this hash, 0xFF if none *****/",
+              "static const uint8_t cmdSlots[PROLOGIX_CMD_SLOTS] PROGMEM = {"]
+    for row in range(0, slots, 16):
+        sep = "," if row + 16 < slots else ""
+        lines.append("  " + ", ".join(f"0x{v:02X}" for v in table[row:row + 16]) + sep)
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def write_header(path: str):
+    content = generate()
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == content:
+                return
+    with open(path, "w", newline="\n") as f:
+        f.write(content)
+    print(f"Generated {path}")
+
+
+try:
+    Import("env")  # noqa: F821 - defined when run by PlatformIO
+    write_header(os.path.join(env.subst("$PROJECT_SRC_DIR"), "prologix_commands.h"))  # noqa: F821
+except NameError:
+    if __name__ == '__main__':
+        write_header(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "prologix_commands.h"))
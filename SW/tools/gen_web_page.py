@@ -0,0 +1,70 @@
+"""
+Generates src/web_page.h, the page of the web server, gzip compressed in PROGMEM.
+
+The page is written in src/web/index.html. This script drops its comments and indentation, compresses it,
+and derives the ETag from the result: the web server sends the page with "Content-Encoding: gzip", and
+answers "304 Not Modified" when the browser already has this version.
+
+PlatformIO runs this script before every build (extra_scripts in platformio.ini), it can also be run by
+hand with "python tools/gen_web_page.py".
+"""
+
+import gzip
+import hashlib
+import os
+import re
+
+
+def minify(html: str) -> str:
+    html = re.sub(r"<!--.*?-->", "", html, flags=re.DOTALL)
+    lines = (line.strip() for line in html.splitlines())
+    return "\n".join(line for line in lines if line and not line.startswith("//"))
+
+
+def generate(source: str) -> str:
+    with open(source, encoding="utf-8") as f:
+        page = minify(f.read()).encode()
+    data = gzip.compress(page, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(data).hexdigest()[:8]
+
+    lines = [
+        "#pragma once",
+        "",
+        "/*!",
+        "  @file   web_page.h",
+        "  @brief  The page of the web server, gzip compressed, in PROGMEM.",
+        "",
+        "  GENERATED by tools/gen_web_page.py from web/index.html, do not edit: change the page and rebuild.",
+        f"  {len(page)} bytes, {len(data)} bytes compressed.",
+        "*/",
+        "",
+        f"#define WEB_PAGE_SIZE {len(data)}  ///< Size of webPage[]",
+        f"#define WEB_PAGE_ETAG \"\\\"{etag}\\\"\"  ///< ETag of the page, quotes included",
+        "",
+        "static const uint8_t webPage[WEB_PAGE_SIZE] PROGMEM = {",
+    ]
+    for row in range(0, len(data), 16):
+        sep = "," if row + 16 < len(data) else ""
+        lines.append("  " + ", ".join(f"0x{v:02X}" for v in data[row:row + 16]) + sep)
+    lines += ["};", ""]
+    return "\n".join(lines)
+
+
+def write_header(src_dir: str):
+    path = os.path.join(src_dir, "web_page.h")
+    content = generate(os.path.join(src_dir, "web", "index.html"))
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == content:
+                return
+    with open(path, "w", newline="\n") as f:
+        f.write(content)
+    print(f"Generated {path}")
+
+
+try:
+    Import("env")  # noqa: F821 - defined when run by PlatformIO
+    write_header(env.subst("$PROJECT_SRC_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == '__main__':
+        write_header(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src"))